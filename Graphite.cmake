@@ -93,6 +93,24 @@ function(fonttest TESTNAME FONTFILE)
 endfunction(fonttest)
 
 
+# Runs a fonttest with an extra gr2fonttest OPTION and checks the output is
+# identical to that of the plain fonttest STANDARD.
+function(optfonttest TESTNAME STANDARD OPTION FONTFILE)
+    if (EXISTS ${PROJECT_SOURCE_DIR}/standards/${STANDARD}${CMAKE_SYSTEM_NAME}.log)
+        set(PLATFORM_TEST_SUFFIX ${CMAKE_SYSTEM_NAME})
+    endif (EXISTS ${PROJECT_SOURCE_DIR}/standards/${STANDARD}${CMAKE_SYSTEM_NAME}.log)
+    if (NOT (GRAPHITE2_NSEGCACHE OR GRAPHITE2_NFILEFACE))
+        add_test(NAME ${TESTNAME} COMMAND $<TARGET_FILE:gr2fonttest> ${OPTION} -log ${PROJECT_BINARY_DIR}/${TESTNAME}.log ${PROJECT_SOURCE_DIR}/fonts/${FONTFILE} -codes ${ARGN})
+        set_tests_properties(${TESTNAME} PROPERTIES TIMEOUT 3)
+        if (GRAPHITE2_ASAN)
+            set_property(TEST ${TESTNAME} APPEND PROPERTY ENVIRONMENT "ASAN_SYMBOLIZER_PATH=${ASAN_SYMBOLIZER}")
+        endif (GRAPHITE2_ASAN)
+        add_test(NAME ${TESTNAME}Output COMMAND ${CMAKE_COMMAND} -E compare_files ${PROJECT_BINARY_DIR}/${TESTNAME}.log ${PROJECT_SOURCE_DIR}/standards/${STANDARD}${PLATFORM_TEST_SUFFIX}.log)
+        set_tests_properties(${TESTNAME}Output PROPERTIES DEPENDS ${TESTNAME})
+    endif (NOT (GRAPHITE2_NSEGCACHE OR GRAPHITE2_NFILEFACE))
+endfunction(optfonttest)
+
+
 function(feattest TESTNAME FONTFILE)
     if (EXISTS ${PROJECT_SOURCE_DIR}/standards/${TESTNAME}${CMAKE_SYSTEM_NAME}.log)
         set(PLATFORM_TEST_SUFFIX ${CMAKE_SYSTEM_NAME})
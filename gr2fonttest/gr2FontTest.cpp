@@ -36,6 +36,7 @@ diagnostic log of the segment creation in grSegmentLog.txt
 #include <climits>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
 
 #include "UtfCodec.h"
 
@@ -80,6 +81,9 @@ public:
     void closeLog();
     bool loadFromArgs(int argc, char *argv[]);
     int testFileFont() const;
+    bool checkCoverage(const gr_face * face) const;
+    bool checkGlyphRun(gr_segment * seg, const gr_face * face, const gr_font * font) const;
+    bool checkCharMap(gr_segment * seg) const;
     gr_feature_val* parseFeatures(const gr_face * face) const;
     void printFeatures(const gr_face * face) const;
 public:
@@ -97,6 +101,13 @@ public:
     bool autoCodes;
     int justification;
     bool enableCache;
+    bool inMemory;
+    bool async;
+    bool coverage;
+    bool reuse;
+    bool batch;
+    bool glyphRun;
+    bool charMap;
     float width;
     int textArgIndex;
     unsigned int * pText32;
@@ -105,6 +116,8 @@ public:
     FILE * log;
     char * trace;
     char * alltrace;
+    char * snapshot;
+    long cmapBudget;
     int codesize;
     gr_face_options opts;
     
@@ -143,6 +156,13 @@ void Parameters::clear()
     noprint = false;
     justification = 0;
     enableCache = false;
+    inMemory = false;
+    async = false;
+    coverage = false;
+    reuse = false;
+    batch = false;
+    glyphRun = false;
+    charMap = false;
     width = 100.0f;
     pText32 = NULL;
     textArgIndex = 0;
@@ -152,6 +172,8 @@ void Parameters::clear()
     log = stdout;
     trace = NULL;
     alltrace = NULL;
+    snapshot = NULL;
+    cmapBudget = -1;
     opts = gr_face_preloadAll;
 }
 
@@ -219,6 +241,8 @@ bool Parameters::loadFromArgs(int argc, char *argv[])
         LOG,
         TRACE,
         ALLTRACE,
+        SNAPSHOT,
+        CMAP_BUDGET,
         SIZE
     } TestOptions;
     TestOptions option = NONE;
@@ -305,6 +329,15 @@ bool Parameters::loadFromArgs(int argc, char *argv[])
             alltrace = argv[a];
             option = NONE;
             break;
+        case SNAPSHOT:
+            snapshot = argv[a];
+            option = NONE;
+            break;
+        case CMAP_BUDGET:
+            pIntEnd = NULL;
+            cmapBudget = strtol(argv[a], &pIntEnd, 10);
+            option = NONE;
+            break;
         case SIZE :
             pIntEnd = NULL;
             codesize = strtol(argv[a],&pIntEnd, 10);
@@ -411,6 +444,64 @@ bool Parameters::loadFromArgs(int argc, char *argv[])
                     option = NONE;
                     opts = gr_face_default;
                 }
+                else if (strcmp(argv[a], "-mapfile") == 0)
+                {
+                    option = NONE;
+                    opts = gr_face_options(opts | gr_face_mapFile);
+                }
+                else if (strcmp(argv[a], "-memory") == 0)
+                {
+                    option = NONE;
+                    inMemory = true;
+                }
+                else if (strcmp(argv[a], "-async") == 0)
+                {
+                    option = NONE;
+                    async = true;
+                }
+                else if (strcmp(argv[a], "-lazy") == 0)
+                {
+                    option = NONE;
+                    opts = gr_face_options(opts | gr_face_lazyPasses);
+                }
+                else if (strcmp(argv[a], "-parallel") == 0)
+                {
+                    option = NONE;
+                    opts = gr_face_options(opts | gr_face_parallelLoad);
+                }
+                else if (strcmp(argv[a], "-snapshot") == 0)
+                {
+                    option = SNAPSHOT;
+                }
+                else if (strcmp(argv[a], "-cmapbudget") == 0)
+                {
+                    option = CMAP_BUDGET;
+                }
+                else if (strcmp(argv[a], "-reuse") == 0)
+                {
+                    option = NONE;
+                    reuse = true;
+                }
+                else if (strcmp(argv[a], "-batch") == 0)
+                {
+                    option = NONE;
+                    batch = true;
+                }
+                else if (strcmp(argv[a], "-run") == 0)
+                {
+                    option = NONE;
+                    glyphRun = true;
+                }
+                else if (strcmp(argv[a], "-charmap") == 0)
+                {
+                    option = NONE;
+                    charMap = true;
+                }
+                else if (strcmp(argv[a], "-coverage") == 0)
+                {
+                    option = NONE;
+                    coverage = true;
+                }
                 else
                 {
                     argError = true;
@@ -625,31 +716,227 @@ gr_feature_val * Parameters::parseFeatures(const gr_face * face) const
     return featureList;
 }
 
+// Reads the whole of a file into memory, returning NULL on failure.
+static void * readFile(const char * name, size_t & len)
+{
+    FILE * file = fopen(name, "rb");
+    if (!file) return NULL;
+    void * data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        len = ftell(file);
+        data = malloc(len);
+        if (data && (fseek(file, 0, SEEK_SET) || fread(data, 1, len, file) != len))
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+struct FontData
+{
+    const unsigned char * data;
+    size_t                len;
+};
+
+static unsigned long readBE(const unsigned char * p, int n)
+{
+    unsigned long v = 0;
+    while (n--) v = (v << 8) | *p++;
+    return v;
+}
+
+// Finds a table in a font read into memory by readFile, for faces made with
+// gr_make_face_async.
+static const void * getFontTable(const void * appFaceHandle, unsigned int name, size_t * len)
+{
+    const FontData & font = *static_cast<const FontData *>(appFaceHandle);
+    if (font.len < 12) return NULL;
+    const size_t numTables = readBE(font.data + 4, 2);
+    if (font.len < 12 + numTables * 16) return NULL;
+    for (const unsigned char * e = font.data + 12, * const end = e + numTables * 16; e != end; e += 16)
+    {
+        if (readBE(e, 4) != name) continue;
+        const size_t offset = readBE(e + 8, 4), length = readBE(e + 12, 4);
+        if (offset > font.len || length > font.len - offset) return NULL;
+        *len = length;
+        return font.data + offset;
+    }
+    return NULL;
+}
+
+// Checks the face coverage agrees with gr_face_is_char_supported over the BMP
+// and SMP, and finds the same first unsupported character in the text.
+bool Parameters::checkCoverage(const gr_face * face) const
+{
+    const gr_coverage * cov = gr_face_coverage(face);
+    if (!cov) return false;
+    for (gr_uint32 usv = 0; usv <= 0x1FFFF; ++usv)
+    {
+        if (!gr_coverage_has_char(cov, usv) != !gr_face_is_char_supported(face, usv, 0))
+            return false;
+    }
+
+    size_t expected = 0, count = 0;
+    while (expected < charLength && pText32[expected]
+            && gr_face_is_char_supported(face, pText32[expected], 0))
+        ++expected;
+    const void * stop = gr_coverage_first_unsupported(cov, gr_utf32, pText32, pText32 + charLength, &count);
+    return count == expected
+        && stop == (expected < charLength && pText32[expected] ? pText32 + expected : NULL);
+}
+
+// Checks gr_seg_glyph_run gives the same as asking each slot in turn.
+bool Parameters::checkGlyphRun(gr_segment * seg, const gr_face * face, const gr_font * font) const
+{
+    const size_t n = gr_seg_n_slots(seg);
+    unsigned short * gids = (unsigned short *)malloc(n * sizeof(unsigned short) + 1);
+    float * xs = (float *)malloc(3 * n * sizeof(float) + 1);
+    int * chars = (int *)malloc(3 * n * sizeof(int) + 1);
+    gr_glyph_run run = { gids, xs, xs + n, xs + 2 * n, chars, chars + n, chars + 2 * n };
+    bool ok = gids && xs && chars && gr_seg_glyph_run(seg, font, gr_runAll, &run, n) == n;
+    size_t i = 0;
+    for (const gr_slot * slot = gr_seg_first_slot(seg); ok && slot; slot = gr_slot_next_in_segment(slot), ++i)
+    {
+        const gr_slot * parent = gr_slot_attached_to(slot);
+        ok = i < n && gids[i] == gr_slot_gid(slot)
+            && run.x[i] == gr_slot_origin_X(slot) && run.y[i] == gr_slot_origin_Y(slot)
+            && run.advances[i] == gr_slot_advance_X(slot, face, font)
+            && run.before[i] == gr_slot_before(slot) && run.after[i] == gr_slot_after(slot)
+            && run.attached[i] == (parent ? int(gr_slot_index(parent)) : -1);
+    }
+    // A short buffer only gets what fits.
+    if (ok && n > 1)
+    {
+        gr_glyph_run first = { gids + n - 1, NULL, NULL, NULL, NULL, NULL, NULL };
+        ok = gr_seg_glyph_run(seg, font, gr_runGlyphs, &first, 1) == n
+            && gids[n - 1] == gr_slot_gid(gr_seg_first_slot(seg));
+    }
+    free(gids);
+    free(xs);
+    free(chars);
+    return ok && i == n;
+}
+
+// Checks gr_seg_char_map gives the same as asking each char info in turn,
+// and that its clusters cover the characters and glyphs without overlapping.
+bool Parameters::checkCharMap(gr_segment * seg) const
+{
+    const unsigned int n = gr_seg_n_cinfo(seg);
+    int * ints = (int *)malloc(3 * n * sizeof(int) + 1);
+    size_t * bases = (size_t *)malloc(n * sizeof(size_t) + 1);
+    unsigned int * clusters = (unsigned int *)malloc(2 * n * sizeof(unsigned int) + 1);
+    if (!ints || !bases || !clusters)
+    {
+        free(ints); free(bases); free(clusters);
+        return false;
+    }
+    const size_t num_clusters = gr_seg_char_map(seg, ints, ints + n, bases, ints + 2 * n, clusters);
+    bool ok = num_clusters <= n && (num_clusters || !n);
+    for (unsigned int i = 0; ok && i != n; ++i)
+    {
+        const gr_char_info * c = gr_seg_cinfo(seg, i);
+        ok = ints[i] == gr_cinfo_before(c) && ints[n + i] == gr_cinfo_after(c)
+            && bases[i] == gr_cinfo_base(c) && ints[2 * n + i] == gr_cinfo_break_weight(c);
+    }
+
+    // Each glyph, in character order, must fall in its cluster's characters.
+    const gr_slot * first = gr_seg_first_slot(seg), * last = gr_seg_last_slot(seg);
+    const bool backwards = first && gr_slot_before(first) > gr_slot_before(last);
+    const gr_slot * slot = backwards ? last : first;
+    unsigned int chars = 0, glyphs = 0;
+    for (size_t k = 0; ok && k != num_clusters; ++k)
+    {
+        const unsigned int cluster_chars = clusters[2 * k], cluster_glyphs = clusters[2 * k + 1];
+        for (unsigned int g = 0; ok && g != cluster_glyphs; ++g)
+        {
+            ok = slot && unsigned(gr_slot_before(slot)) >= chars
+                      && unsigned(gr_slot_after(slot)) < chars + cluster_chars;
+            slot = backwards ? gr_slot_prev_in_segment(slot) : gr_slot_next_in_segment(slot);
+        }
+        ok = ok && cluster_chars;
+        chars += cluster_chars;
+        glyphs += cluster_glyphs;
+    }
+    free(ints);
+    free(bases);
+    free(clusters);
+    return ok && chars == n && glyphs == gr_seg_n_slots(seg) && !slot;
+}
+
 int Parameters::testFileFont() const
 {
     int returnCode = 0;
 //    try
     {
         gr_face *face = NULL;
+        void * fontData = NULL;
+        FontData asyncFont = { NULL, 0 };
         if (alltrace) gr_start_logging(NULL, alltrace);
         if (enableCache)
             face = gr_make_file_face_with_seg_cache(fileName, 1000, opts | gr_face_dumbRendering);
+        else if (async)
+        {
+            // Nothing waits for the face explicitly, each call below does so as needed.
+            static const gr_face_ops ops = { sizeof(gr_face_ops), &getFontTable, NULL };
+            fontData = readFile(fileName, asyncFont.len);
+            asyncFont.data = static_cast<const unsigned char *>(fontData);
+            if (fontData)
+                face = gr_make_face_async(&asyncFont, &ops, opts, NULL, NULL);
+        }
+        else if (inMemory)
+        {
+            size_t fontLen = 0;
+            fontData = readFile(fileName, fontLen);
+            if (fontData)
+                face = gr_make_face_from_memory(fontData, fontLen, opts);
+        }
         else
             face = gr_make_file_face(fileName, opts);
 
+        // Round trip the face through a snapshot file.
+        if (face && snapshot && !enableCache)
+        {
+            size_t snapshot_len = gr_face_snapshot(face, NULL, 0);
+            void * image = malloc(snapshot_len);
+            FILE * snapshot_file = fopen(snapshot, "wb");
+            if (image && snapshot_file
+                    && gr_face_snapshot(face, image, snapshot_len) == snapshot_len)
+                fwrite(image, 1, snapshot_len, snapshot_file);
+            if (snapshot_file) fclose(snapshot_file);
+            free(image);
+            gr_face_destroy(face);
+            face = gr_make_file_face_from_snapshot(fileName, snapshot, opts);
+        }
+
+        if (face && cmapBudget >= 0)
+            gr_face_cmap_budget(face, size_t(cmapBudget));
+
         // use the -trace option to specify a file
     	if (trace)	gr_start_logging(face, trace);
 
         if (!face)
         {
             fprintf(stderr, "Invalid font, failed to read or parse tables\n");
+            free(fontData);
             return 3;
         }
+        if (coverage && !checkCoverage(face))
+        {
+            fprintf(stderr, "Face coverage does not match the characters supported\n");
+            gr_face_destroy(face);
+            free(fontData);
+            return 4;
+        }
         if (charLength == 0)
         {
             printFeatures(face);
             gr_stop_logging(face);
             gr_face_destroy(face);
+            free(fontData);
             return 0;
         }
 
@@ -685,6 +972,42 @@ int Parameters::testFileFont() const
             *ui = 0;
             pSeg = gr_make_seg(sizedFont, face, 0, features ? featureList : NULL, (gr_encform)codesize, pText8, textSrc.getLength(), rtl ? 1 : 0);
         }
+        else if (reuse)
+        {
+            // Shape the text twice over, then the text itself into the same
+            //  segment, which must come out as if shaped afresh.
+            const size_t len = textSrc.getLength();
+            unsigned int * pTwice = (unsigned int *)malloc(2 * len * sizeof(unsigned int));
+            memcpy(pTwice, pText32, len * sizeof(unsigned int));
+            memcpy(pTwice + len, pText32, len * sizeof(unsigned int));
+            gr_segment * pTwiceSeg = gr_make_seg(sizedFont, face, 0, features ? featureList : NULL, gr_utf32, pTwice, 2 * len, rtl ? 1 : 0);
+            free(pTwice);
+            if (pTwiceSeg)
+            {
+                pSeg = gr_make_seg_into(pTwiceSeg, sizedFont, face, 0, features ? featureList : NULL, textSrc.utfEncodingForm(),
+                    textSrc.get_utf_buffer_begin(), len, rtl ? 1 : 0);
+                if (!pSeg)  gr_seg_destroy(pTwiceSeg);
+            }
+        }
+        else if (batch)
+        {
+            // Shape the text and the text twice over as a batch, then again
+            //  swapped round so each segment is reused for the other length.
+            const size_t len = textSrc.getLength();
+            unsigned int * pTwice = (unsigned int *)malloc(2 * len * sizeof(unsigned int));
+            memcpy(pTwice, pText32, len * sizeof(unsigned int));
+            memcpy(pTwice + len, pText32, len * sizeof(unsigned int));
+            const void * texts[2] = { pText32, pTwice };
+            size_t lens[2] = { len, 2 * len };
+            gr_segment * segs[2] = { NULL, NULL };
+            gr_make_segs(sizedFont, face, 0, features ? featureList : NULL, gr_utf32, texts, lens, 2, rtl ? 1 : 0, segs);
+            std::swap(texts[0], texts[1]);
+            std::swap(lens[0], lens[1]);
+            gr_make_segs(sizedFont, face, 0, features ? featureList : NULL, gr_utf32, texts, lens, 2, rtl ? 1 : 0, segs);
+            free(pTwice);
+            if (segs[0])    gr_seg_destroy(segs[0]);
+            pSeg = segs[1];
+        }
         else
             pSeg = gr_make_seg(sizedFont, face, 0, features ? featureList : NULL, textSrc.utfEncodingForm(),
                 textSrc.get_utf_buffer_begin(), textSrc.getLength(), rtl ? 1 : 0);
@@ -744,12 +1067,23 @@ int Parameters::testFileFont() const
             }
             free(map);
         }
+        if (pSeg && glyphRun && !checkGlyphRun(pSeg, face, sizedFont))
+        {
+            fprintf(stderr, "Glyph run does not match the slots\n");
+            returnCode = 5;
+        }
+        if (pSeg && charMap && !checkCharMap(pSeg))
+        {
+            fprintf(stderr, "Char map does not match the char infos\n");
+            returnCode = 6;
+        }
         if (pSeg)
             gr_seg_destroy(pSeg);
         if (featureList) gr_featureval_destroy(featureList);
         gr_font_destroy(sizedFont);
         if (trace) gr_stop_logging(face);
         gr_face_destroy(face);
+        free(fontData);
         if (alltrace) gr_stop_logging(NULL);
     }
     return returnCode;
@@ -788,6 +1122,18 @@ int main(int argc, char *argv[])
         fprintf(stderr,"-log out.log\tSet log file to use rather than stdout\n");
         fprintf(stderr,"-trace trace.json\tDefine a file for the JSON trace log\n");
         fprintf(stderr,"-demand\tDemand load glyphs and cmap cache\n");
+        fprintf(stderr,"-mapfile\tMemory map the font file rather than reading tables\n");
+        fprintf(stderr,"-memory\tRead the whole font into memory and load the face from that\n");
+        fprintf(stderr,"-async\tLoad the face on a background thread\n");
+        fprintf(stderr,"-lazy\tDecode each pass the first time it is run\n");
+        fprintf(stderr,"-parallel\tUse several threads to load the face\n");
+        fprintf(stderr,"-snapshot file\tSave the face to a snapshot file and reload it from that\n");
+        fprintf(stderr,"-cmapbudget bytes\tLimit the memory the cmap cache may use\n");
+        fprintf(stderr,"-batch\tShape the text in a batch, into a segment that held the text twice over\n");
+        fprintf(stderr,"-run\tCheck the glyph run export against the slots\n");
+        fprintf(stderr,"-charmap\tCheck the char map export against the char infos\n");
+        fprintf(stderr,"-coverage\tCheck the face coverage against the characters supported\n");
+        fprintf(stderr,"-reuse\tShape the text into a segment that held the text twice over\n");
         fprintf(stderr,"-cache\tEnable Segment Cache\n");
         fprintf(stderr,"-bytes\tword size for character transfer [1,2,4] defaults to 4\n");
         return 1;
@@ -41,6 +41,7 @@ typedef struct gr_face          gr_face;
 typedef struct gr_font          gr_font;
 typedef struct gr_feature_ref   gr_feature_ref;
 typedef struct gr_feature_val   gr_feature_val;
+typedef struct gr_coverage      gr_coverage;
 
 /**
 * Returns version information on this engine
@@ -62,6 +63,16 @@ enum gr_face_options {
     gr_face_preloadGlyphs = 2,
     /** Cache the lookup from code point to glyph ID at construction time */
     gr_face_cacheCmap = 4,
+    /** Memory map font files and read tables in place rather than copying
+      * them. Only used by gr_make_file_face*(). The file must not be changed
+      * or truncated while the face is alive. */
+    gr_face_mapFile = 8,
+    /** Only check each pass's header at construction time, decoding its rules
+      * and state machine the first time a segment runs it. */
+    gr_face_lazyPasses = 16,
+    /** Spread pass decoding and glyph preloading over several threads at
+      * construction time. Ignored for passes if gr_face_lazyPasses is set. */
+    gr_face_parallelLoad = 32,
     /** Preload everything */
     gr_face_preloadAll = gr_face_preloadGlyphs | gr_face_cacheCmap
 };
@@ -130,6 +141,52 @@ typedef struct gr_face_ops	gr_face_ops;
   */
 GR2_API gr_face* gr_make_face_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *face_ops, unsigned int faceOptions);
 
+/** type describing function called once a face made by gr_make_face_async has
+  * finished loading. It is called on the thread that loaded the face, which may be
+  * the one that called gr_make_face_async. It may use the face but must not destroy it.
+  * Other threads waiting for the face carry on without waiting for it to return;
+  * gr_face_destroy does wait for it.
+  *
+  * @param face     The face that has finished loading.
+  * @param loaded   Non-zero if the face loaded, zero if it failed to load.
+  * @param data     The data passed to gr_make_face_async.
+  */
+typedef void (*gr_face_ready_fn)(gr_face *face, int loaded, void *data);
+
+/** Create a gr_face object that loads on a background thread, returning straight away.
+  *
+  * The face may be used as soon as this returns: any call that needs the face
+  * waits for the whole face to load first, not just the parts that call uses, after
+  * which a face that failed to load behaves as empty, making no fonts or segments.
+  * Combine with gr_face_lazyPasses, and leave out gr_face_preloadGlyphs, to make
+  * that wait shorter, as passes and glyphs are then read on first use instead. If
+  * no thread can be started the face is loaded before returning.
+  *
+  * @return gr_face or NULL if the face could not be allocated.
+  * @param appFaceHandle This is application specific information that is passed
+  *                      to the getTable function. The appFaceHandle must stay
+  *                      alive as long as the gr_face is alive.
+  * @param face_ops      Pointer to face specific callback structure for table
+  *                      management. Must stay alive for the duration of the
+  *                      call only.
+  * @param faceOptions   Bitfield describing various options. See enum gr_face_options for details.
+  * @param ready         Called once loading has finished. May be NULL.
+  * @param data          Passed to ready.
+  */
+GR2_API gr_face* gr_make_face_async(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *face_ops, unsigned int faceOptions, gr_face_ready_fn ready, void *data);
+
+/** Wait for a face made by gr_make_face_async to finish loading, but not for its ready
+  * callback to return. Returns straight away for any other face.
+  *
+  * @return Non-zero if the face loaded, zero if it failed to.
+  */
+GR2_API int gr_face_wait(const gr_face *face);
+
+/** Returns non-zero once a face made by gr_make_face_async has finished loading,
+  * whether it loaded or not, and always for any other face.
+  */
+GR2_API int gr_face_is_ready(const gr_face *face);
+
 /** Create a gr_face object given application information and a getTable function. This function is deprecated as of v1.2.0 in
   * favour of gr_make_face_with_ops.
   *
@@ -142,6 +199,55 @@ GR2_API gr_face* gr_make_face_with_ops(const void* appFaceHandle/*non-NULL*/, co
   */
 GR2_API gr_face* gr_make_face(const void* appFaceHandle/*non-NULL*/, gr_get_table_fn getTable, unsigned int faceOptions);
 
+/** Create a gr_face object from a font held in memory, such as one embedded in the
+  * application or read from its own store. Tables are used in place and the table
+  * directory is indexed once, so no table is copied or looked up by scanning.
+  *
+  * @return gr_face or NULL if the font fails to load for some reason.
+  * @param font          The sfnt font data. This must stay alive and unchanged
+  *                      as long as the gr_face is alive.
+  * @param font_len      The size of the font data in bytes.
+  * @param faceOptions   Bitfield describing various options. See enum gr_face_options for details.
+  */
+GR2_API gr_face* gr_make_face_from_memory(const void *font, size_t font_len, unsigned int faceOptions);
+
+/** Create a gr_face object using a snapshot of the same face, taken by gr_face_snapshot, to
+  * avoid decoding and checking the graphite tables again.
+  *
+  * A snapshot is only used if it was taken by this version of the library, on this kind of
+  * machine, from a face with the same head table; otherwise it is ignored and the face is
+  * loaded from the font as with gr_make_face_with_ops. Only the head table is read to check
+  * this, so a font whose other tables are changed must have its head checkSumAdjustment
+  * updated, as font tools do. Snapshots are checked for damage but should come from a
+  * trusted source, such as the application's own cache.
+  *
+  * @return gr_face or NULL if the font fails to load for some reason.
+  * @param appFaceHandle This is application specific information that is passed
+  *                      to the getTable function. The appFaceHandle must stay
+  *                      alive as long as the gr_face is alive.
+  * @param face_ops      Pointer to face specific callback structure for table
+  *                      management. Must stay alive for the duration of the
+  *                      call only.
+  * @param snapshot      The snapshot. It is only read during the call and may be
+  *                      mapped at any address. May be NULL.
+  * @param snapshot_len  The size of the snapshot in bytes.
+  * @param faceOptions   Bitfield describing various options. See enum gr_face_options for details.
+  *                      All glyphs are preloaded from the snapshot whatever the options.
+  */
+GR2_API gr_face* gr_make_face_from_snapshot_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *face_ops, const void *snapshot, size_t snapshot_len, unsigned int faceOptions);
+
+/** Take a relocatable snapshot of a face's decoded graphite tables and glyphs for passing
+  * to gr_make_face_from_snapshot_with_ops or gr_make_file_face_from_snapshot later,
+  * typically by another process. Any glyphs not yet loaded are loaded.
+  *
+  * @return The size of the snapshot in bytes, which is only written if buffer_len is at
+  *         least this large. Returns 0 if the face has no graphite tables.
+  * @param pFace         The face to snapshot.
+  * @param buffer        Where to write the snapshot. May be NULL to query the size.
+  * @param buffer_len    The size of buffer in bytes.
+  */
+GR2_API size_t gr_face_snapshot(const gr_face *pFace, void *buffer, size_t buffer_len);
+
 //#ifndef GRAPHITE2_NSEGCACHE
 /** Create a gr_face object given application information, with subsegmental caching support
   *
@@ -195,6 +301,35 @@ GR2_API void gr_tag_to_str(gr_uint32 tag, char *str);
   */
 GR2_API gr_feature_val* gr_face_featureval_for_lang(const gr_face* pFace, gr_uint32 langname);
 
+/** Get the default feature values for a given language without copying them
+  *
+  * @return the feature values gr_face_featureval_for_lang would copy, interned as by
+  *          gr_face_intern_featureval. This data is part of the gr_face and will be freed when
+  *          the face is destroyed. Copy it with gr_featureval_clone() to change any values.
+  * @param pFace The font face to get feature values from
+  * @param langname The language tag to get feature values for, as for gr_face_featureval_for_lang.
+  */
+GR2_API const gr_feature_val* gr_face_lang_featureval(const gr_face* pFace, gr_uint32 langname);
+
+/** Intern feature values with a face
+  *
+  * Equal feature values intern to the same immutable object, so interned values may be
+  * compared by pointer. Segments made with any feature values intern them, so passing
+  * interned values to gr_make_seg saves hashing and looking them up each time.
+  *
+  * A face interns at most 1024 distinct sets of values besides its own language defaults.
+  * Past that, values it hasn't interned are refused, and segments made with them use a
+  * copy of their own instead, which is slower as they can't share a segment cache.
+  *
+  * @return the interned feature values, or NULL if out of memory or the face holds all the
+  *          sets it will. This data is part of the gr_face and will be freed when the face
+  *          is destroyed, so every distinct set of values interned stays until then. It must
+  *          not be changed or destroyed; copy it with gr_featureval_clone() to change any values.
+  * @param pFace The font face to intern the feature values with.
+  * @param pFeats The feature values to intern.
+  */
+GR2_API const gr_feature_val* gr_face_intern_featureval(const gr_face* pFace, const gr_feature_val* pFeats);
+
 /** Get feature reference for a given feature id from a face
   *
   * @return a feature reference corresponding to the given id. This data is part of the gr_face and
@@ -219,6 +354,35 @@ GR2_API gr_uint32 gr_face_lang_by_index(const gr_face* pFace, gr_uint16 i);
 /** Destroy the given face and free its memory **/
 GR2_API void gr_face_destroy(gr_face *face);
 
+/** Release the font tables a face has cached but is no longer using.
+  *
+  * A face fetches, checks and decompresses each font table once and shares it
+  * between its users. Tables still needed, for instance for glyphs loaded on demand,
+  * are kept. Loading a face trims it, so this is only useful after querying names
+  * or similar. It is safe to call while the face is in use by other threads, and
+  * waits for a face made by gr_make_face_async to finish loading first.
+  */
+GR2_API void gr_face_trim_tables(const gr_face *face);
+
+/** Limit the memory the cmap cache of a face made with gr_face_cacheCmap may grow to.
+  *
+  * The cache fills a page of 256 characters at a time, as they are first looked
+  * up, and a table of 256 pages for each plane they are in. Pages that would take
+  * it past the budget are not cached, their characters are looked up in the font's
+  * cmap table each time instead, until the budget is next set. Setting it again
+  * lets those pages be cached if they now fit, but never frees pages already
+  * cached. There is no limit by default.
+  *
+  * @param face     The face whose cmap cache to limit.
+  * @param bytes    The most memory the cache should use.
+  */
+GR2_API void gr_face_cmap_budget(gr_face *face, size_t bytes);
+
+/** Returns the memory, in bytes, the cmap cache of a face currently uses, or 0 if
+  * the face was not made with gr_face_cacheCmap.
+  */
+GR2_API size_t gr_face_cmap_footprint(const gr_face *face);
+
 /** Returns the number of glyphs in the face **/
 GR2_API unsigned short gr_face_n_glyphs(const gr_face* pFace);
 
@@ -226,6 +390,10 @@ GR2_API unsigned short gr_face_n_glyphs(const gr_face* pFace);
 GR2_API const gr_faceinfo *gr_face_info(const gr_face *pFace, gr_uint32 script);
 
 /** Returns whether the font supports a given Unicode character
+  *
+  * A character is supported if the cmap maps it, or if it is a pseudo glyph of
+  * the script's silf subtable. gr_face_coverage takes every script's pseudo
+  * glyphs instead, since a fallback font is chosen before the script is known.
   *
   * @return true if the character is supported.
   * @param pFace    face to test within
@@ -234,6 +402,29 @@ GR2_API const gr_faceinfo *gr_face_info(const gr_face *pFace, gr_uint32 script);
   */
 GR2_API int gr_face_is_char_supported(const gr_face *pFace, gr_uint32 usv, gr_uint32 script);
 
+/** Returns the set of Unicode characters a face supports, for testing many
+  * characters against quickly, as when choosing fallback fonts.
+  *
+  * The set is built the first time it is asked for and never changes. It holds
+  * every character the cmap maps to a glyph, and the pseudo glyphs of all the
+  * face's scripts, so it may include a character gr_face_is_char_supported
+  * rejects for a particular script, but never one it accepts for any script.
+  * Building it reads the cmap table directly, so it leaves the cmap cache of a
+  * face made with gr_face_cacheCmap as it was. It belongs to the face and lives
+  * as long.
+  *
+  * @return the coverage of the face, or NULL if it could not be built.
+  * @param pFace    face whose characters to gather
+  */
+GR2_API const gr_coverage *gr_face_coverage(const gr_face *pFace);
+
+/** Returns whether a Unicode character is in the coverage of a face
+  *
+  * @param pCoverage    coverage from gr_face_coverage
+  * @param usv          Unicode Scalar Value of character to test
+  */
+GR2_API int gr_coverage_has_char(const gr_coverage *pCoverage, gr_uint32 usv);
+
 #ifndef GRAPHITE2_NFILEFACE
 /** Create gr_face from a font file
   *
@@ -243,6 +434,17 @@ GR2_API int gr_face_is_char_supported(const gr_face *pFace, gr_uint32 usv, gr_ui
   */
 GR2_API gr_face* gr_make_file_face(const char *filename, unsigned int faceOptions);
 
+/** Create gr_face from a font file using a snapshot file, as written out from
+  * gr_face_snapshot. See gr_make_face_from_snapshot_with_ops for when the snapshot
+  * is used. The snapshot file is mapped for the duration of the call only.
+  *
+  * @return gr_face that accesses a font file directly. Returns NULL on failure.
+  * @param filename Full path and filename to font file
+  * @param snapshot_filename Full path and filename to the snapshot. The file need not exist.
+  * @param faceOptions Bitfile from enum gr_face_options to control face options.
+  */
+GR2_API gr_face* gr_make_file_face_from_snapshot(const char *filename, const char *snapshot_filename, unsigned int faceOptions);
+
 //#ifndef GRAPHITE2_NSEGCACHE
 /** Create gr_face from a font file, with subsegment caching support.
   *
@@ -177,10 +177,40 @@ enum gr_bidirtl {
     gr_nomirror = 4
 };
 
+enum gr_glyphRunFlags {
+    /// Fill in gids
+    gr_runGlyphs = 1,
+    /// Fill in x and y
+    gr_runPositions = 2,
+    /// Fill in advances
+    gr_runAdvances = 4,
+    /// Fill in before and after
+    gr_runChars = 8,
+    /// Fill in attached
+    gr_runAttachments = 16,
+    /// Fill in everything
+    gr_runAll = 31
+};
+
 typedef struct gr_char_info     gr_char_info;
 typedef struct gr_segment       gr_segment;
 typedef struct gr_slot          gr_slot;
 
+/** Arrays, one element per glyph, to be filled in by gr_seg_glyph_run.
+  *
+  * Only the arrays asked for need be given, each must have room for as many glyphs
+  * as are asked for.
+  */
+typedef struct gr_glyph_run {
+    unsigned short *    gids;           /**< glyph ids, as gr_slot_gid */
+    float *             x;              /**< glyph origins, as gr_slot_origin_X */
+    float *             y;              /**< glyph origins, as gr_slot_origin_Y */
+    float *             advances;       /**< glyph advances, as gr_slot_advance_X */
+    int *               before;         /**< first char in the glyph's cluster, as gr_slot_before */
+    int *               after;          /**< last char in the glyph's cluster, as gr_slot_after */
+    int *               attached;       /**< index of the glyph this attaches to, or -1 */
+} gr_glyph_run;
+
 /** Returns Unicode character for a charinfo.
   * 
   * @param p Pointer to charinfo to return information on.
@@ -241,6 +271,40 @@ GR2_API size_t gr_cinfo_base(const gr_char_info* p/*not NULL*/);
   */
 GR2_API size_t gr_count_unicode_characters(enum gr_encform enc, const void* buffer_begin, const void* buffer_end, const void** pError);
 
+/** Decodes the unicode characters in a string, counting them as it goes.
+  *
+  * Stops at the same places gr_count_unicode_characters does, or once usv_len
+  * characters have been decoded. The decoded characters may be passed to
+  * gr_make_seg as gr_utf32, saving a segment decoding the string a second time.
+  *
+  * @return number of characters decoded
+  * @param enc Specifies the type of data in the string: utf8, utf16, utf32
+  * @param buffer_begin The start of the string
+  * @param buffer_end Decode up to the first nul or when end is reached, whichever is earliest.
+  *            This parameter may be NULL.
+  * @param usv Receives the decoded characters
+  * @param usv_len The most characters usv has room for
+  * @param pError Set as by gr_count_unicode_characters. May be NULL.
+  */
+GR2_API size_t gr_decode_unicode_characters(enum gr_encform enc, const void* buffer_begin, const void* buffer_end, gr_uint32* usv, size_t usv_len, const void** pError);
+
+/** Finds the first character in a string not in a face's coverage.
+  *
+  * Reads the string as gr_count_unicode_characters does. A structural fault in
+  * the string counts as an unsupported character.
+  *
+  * @return the position of the first unsupported character, or NULL if every
+  *         character up to the end of the string is supported.
+  * @param pCoverage    coverage from gr_face_coverage
+  * @param enc Specifies the type of data in the string: utf8, utf16, utf32
+  * @param buffer_begin The start of the string
+  * @param buffer_end Test up to the first nul or when end is reached, whichever is earliest.
+  *            This parameter may be NULL.
+  * @param pCount Receives the number of characters before the one returned, or in
+  *               the whole string. May be NULL.
+  */
+GR2_API const void* gr_coverage_first_unsupported(const gr_coverage* pCoverage, enum gr_encform enc, const void* buffer_begin, const void* buffer_end, size_t* pCount);
+
 /** Creates and returns a segment.
   *
   * @return a segment that needs seg_destroy called on it. May return NULL if bad problems
@@ -268,6 +332,42 @@ GR2_API size_t gr_count_unicode_characters(enum gr_encform enc, const void* buff
   */
 GR2_API gr_segment* gr_make_seg(const gr_font* font, const gr_face* face, gr_uint32 script, const gr_feature_val* pFeats, enum gr_encform enc, const void* pStart, size_t nChars, int dir);
 
+/** Shapes new text into an existing segment, reusing its memory.
+  *
+  * Shaping a stream of text one segment after another into the same segment saves
+  * allocating and freeing memory for each: once the segment has held text as long as
+  * any to come it needs no more. Anything previously got from the segment, such as its
+  * slots or char infos, is no longer valid.
+  *
+  * To shape a batch of strings, such as a list of labels, use gr_make_segs.
+  *
+  * @return pSeg, holding the new segment, or a new segment if pSeg is NULL. On failure
+  *     NULL is returned and pSeg is left empty; it must still be destroyed with
+  *     gr_seg_destroy.
+  * @param pSeg The segment to reuse, or NULL to make a new one as gr_make_seg does.
+  * @param font, face, script, pFeats, enc, pStart, nChars, dir As for gr_make_seg.
+  */
+GR2_API gr_segment* gr_make_seg_into(gr_segment* pSeg, const gr_font* font, const gr_face* face, gr_uint32 script, const gr_feature_val* pFeats, enum gr_encform enc, const void* pStart, size_t nChars, int dir);
+
+/** Shapes many strings at once, each into its own segment.
+  *
+  * This does what calling gr_make_seg_into for each string would, but waits for the
+  * face and resolves the features only once, and shapes every string in the same
+  * working space. Passing the segments from one call back in to the next reuses their
+  * memory, so shaping a stream of short strings batch by batch allocates nothing once
+  * they have grown to fit.
+  *
+  * @return the number of strings successfully shaped.
+  * @param font, face, script, pFeats, enc, dir As for gr_make_seg, used for every string.
+  * @param texts The strings to shape.
+  * @param lens The number of unicode characters in each string.
+  * @param n The number of strings.
+  * @param out On entry, a segment to reuse or NULL for each string. On return, the
+  *     segment for each string, or NULL if it could not be shaped, in which case any
+  *     segment given for it has been destroyed.
+  */
+GR2_API size_t gr_make_segs(const gr_font* font, const gr_face* face, gr_uint32 script, const gr_feature_val* pFeats, enum gr_encform enc, const void* const* texts, const size_t* lens, size_t n, int dir, gr_segment** out/*not NULL*/);
+
 /** Destroys a segment, freeing the memory.
   *
   * @param p The segment to destroy
@@ -305,6 +405,37 @@ GR2_API const gr_slot* gr_seg_first_slot(gr_segment* pSeg/*not NULL*/);    //may
   */
 GR2_API const gr_slot* gr_seg_last_slot(gr_segment* pSeg/*not NULL*/);    //may give a base slot or a slot which is attached to another
 
+/** Copies the glyphs of a segment out into arrays in one go.
+  *
+  * This gives the same values as walking the slots with gr_slot_next_in_segment and
+  * asking each for them, for much less work.
+  *
+  * @return the number of glyphs in the segment. If this is more than cap only the first
+  *     cap glyphs were copied.
+  * @param pSeg The segment to copy the glyphs of.
+  * @param font The font to scale advances by as for gr_slot_advance_X, or NULL.
+  * @param flags Which arrays to fill in, from enum gr_glyphRunFlags.
+  * @param pRun The arrays to fill in.
+  * @param cap The number of glyphs the arrays have room for.
+  */
+GR2_API size_t gr_seg_glyph_run(const gr_segment* pSeg/*not NULL*/, const gr_font* font, unsigned int flags, gr_glyph_run* pRun/*not NULL*/, size_t cap);
+
+/** Copies the character to glyph mapping of a segment out into arrays in one go.
+  *
+  * Each array given must have room for gr_seg_n_cinfo() values, which are as
+  * gr_cinfo_before, gr_cinfo_after, gr_cinfo_base and gr_cinfo_break_weight would give
+  * for each character. Any array may be NULL.
+  *
+  * The clusters array receives the segment's clusters in character order, each as two
+  * values: the number of characters in it then the number of glyphs. The characters
+  * and the glyphs of a cluster are contiguous and no glyph belongs to two clusters. It
+  * must have room for twice gr_seg_n_cinfo() values.
+  *
+  * @return the number of clusters, or 0 if clusters is NULL.
+  * @param pSeg The segment to copy the mapping of.
+  */
+GR2_API size_t gr_seg_char_map(const gr_segment* pSeg/*not NULL*/, int* before, int* after, size_t* base, int* breakweight, unsigned int* clusters);
+
 /** Justifies a linked list of slots for a line to a given width
   *
   * Passed a pointer to the start of a linked list of slots corresponding to a line, as
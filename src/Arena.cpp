@@ -0,0 +1,133 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include "inc/Main.h"
+#include "inc/Arena.h"
+#include "inc/Atomic.h"
+
+using namespace graphite2;
+
+namespace
+{
+    const size_t BLOCK_SIZE = 8192,
+                 ALIGNMENT  = sizeof(double) > sizeof(void *) ? sizeof(double) : sizeof(void *);
+
+    inline size_t align(size_t n) { return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+}
+
+struct Arena::block
+{
+    block         * next;
+    long            size;
+    volatile long   used;
+
+    byte * data() { return reinterpret_cast<byte *>(this) + align(sizeof(block)); }
+
+    static block * create(size_t size, block * next, long used) throw()
+    {
+        block * const b = static_cast<block *>(malloc(align(sizeof(block)) + size));
+        if (b)
+        {
+            b->next = next;
+            b->size = long(size);
+            b->used = used;
+        }
+        return b;
+    }
+};
+
+
+Arena::~Arena() throw()
+{
+    release();
+}
+
+
+void Arena::release() throw()
+{
+    for (block * b = _current, * nb; b; b = nb) { nb = b->next; free(b); }
+    for (block * b = _large, * nb; b; b = nb)   { nb = b->next; free(b); }
+    _current = _large = 0;
+}
+
+
+void Arena::reset() throw()
+{
+    size_t total = 0;
+    int blocks = 0;
+    for (block * b = _current; b; b = b->next)  { total += b->size; ++blocks; }
+    for (block * b = _large; b; b = b->next)    { total += b->size; ++blocks; }
+
+    if (blocks == 1 && _current)
+    {
+        _current->used = 0;
+        return;
+    }
+
+    release();
+    _current = total ? block::create(total < BLOCK_SIZE ? BLOCK_SIZE : total, 0, 0) : 0;
+}
+
+
+void * Arena::allocate(size_t n) throw()
+{
+    n = align(n);
+
+    // Anything big enough to waste much of a block gets one to itself, unless
+    //  the current block has room to spare, as one left by reset() may.
+    if (n > BLOCK_SIZE/4)
+    {
+        block * const curr = atomic::load(_current);
+        for (long used; curr && (used = atomic::load(curr->used)) + long(n) <= curr->size;)
+            if (atomic::compare_exchange(curr->used, used, used + long(n)))
+                return curr->data() + used;
+
+        block * b = block::create(n, 0, long(n));
+        if (!b) return 0;
+        do b->next = atomic::load(_large);
+        while (!atomic::compare_exchange(_large, b->next, b));
+        return b->data();
+    }
+
+    for (;;)
+    {
+        block * const curr = atomic::load(_current);
+        if (curr)
+        {
+            const long offset = atomic::fetch_add(curr->used, long(n));
+            if (offset + long(n) <= curr->size)
+                return curr->data() + offset;
+        }
+
+        // The current block is full. Whoever installs a new one first has its
+        //  allocation come from it, the rest retry in the winner's block.
+        block * const b = block::create(BLOCK_SIZE, curr, long(n));
+        if (!b) return 0;
+        if (atomic::compare_exchange(_current, curr, b))
+            return b->data();
+        free(b);
+    }
+}
@@ -51,10 +51,13 @@ bool CachedFace::setupCache(unsigned int cacheSize)
 }
 
 
-bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf) const
+bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf, VMScratch & scratch) const
 {
     assert(pSilf);
-    pSilf->runGraphite(seg, 0, pSilf->substitutionPass());
+    // Caches are kept per interned feature settings, anything else goes uncached.
+    if (!seg->getFeatures(0).interned())
+        return Face::runGraphite(seg, pSilf, scratch);
+    pSilf->runGraphite(seg, scratch, 0, pSilf->substitutionPass());
 
     unsigned int silfIndex = 0;
     for (; silfIndex < m_numSilf && &(m_silfs[silfIndex]) != pSilf; ++silfIndex);
@@ -100,7 +103,7 @@ bool CachedFace::runGraphite(Segment *seg, const Silf *pSilf) const
                 if (!entry)
                 {
                     SegmentScopeState scopeState = seg->setScope(subSegStartSlot, subSegEndSlot, length);
-                    pSilf->runGraphite(seg, pSilf->substitutionPass(), pSilf->numPasses());
+                    pSilf->runGraphite(seg, scratch, pSilf->substitutionPass(), pSilf->numPasses());
                     if (length < eMaxSpliceSize)
                     {
                         seg->associateChars(subSegStart, length);
@@ -25,11 +25,16 @@ License, as published by the Free Software Foundation, either version 2
 of the License or (at your option) any later version.
 */
 
+#include <climits>
+#include <cstring>
+
 #include "inc/Main.h"
 #include "inc/CmapCache.h"
 #include "inc/Face.h"
 #include "inc/TtfTypes.h"
 #include "inc/TtfUtil.h"
+#include "inc/Endian.h"
+#include "inc/bits.h"
 
 
 using namespace graphite2;
@@ -57,95 +62,361 @@ const void * smp_subtable(const Face::Table & cmap)
     return 0;
 }
 
-template <unsigned int (*NextCodePoint)(const void *, unsigned int, int *),
-          uint16 (*LookupCodePoint)(const void *, unsigned int, int)>
-bool cache_subtable(uint16 * blocks[], const void * cst, const unsigned int limit)
+void Cmap::map(const uint32 * usv, uint16 * gids, size_t n) const throw()
+{
+    for (const uint32 * const end = usv + n; usv != end; ++usv, ++gids)
+        *gids = (*this)[*usv];
+}
+
+
+struct CachedCmap::Page
+{
+    uint8   first,      // low byte of the first character mapped
+            last,       // and of the last
+            linear;     // the characters from first to last map to consecutive glyphs
+    uint16  delta;      // added to the low byte to give the glyph of a linear page
+    uint16  gids[1];    // last - first + 1 glyphs unless linear
+
+    uint16 operator [] (const uint8 lo) const throw()
+    {
+        if (lo < first || lo > last)    return 0;
+        return linear ? uint16(lo + delta) : gids[lo - first];
+    }
+};
+
+const CachedCmap::Page CachedCmap::empty_page = { 1, 0, 0, 0, {0} },
+                       CachedCmap::uncached_page = { 1, 0, 0, 0, {0} };
+
+
+CachedCmap::CachedCmap(const Face & face)
+: _cmap(face, Tag::cmap),
+  _smp(smp_subtable(_cmap)),
+  _bmp(bmp_subtable(_cmap)),
+  _limit(_smp ? 0x10FFFF : 0xFFFF),
+  _footprint(sizeof(CachedCmap)),
+  _budget(LONG_MAX)
+{
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
+        _planes[plane] = 0;
+}
+
+CachedCmap::~CachedCmap() throw()
 {
-    int rangeKey = 0;
-    uint32          codePoint = NextCodePoint(cst, 0, &rangeKey),
-                    prevCodePoint = 0;
-    while (codePoint < limit)
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
     {
-        unsigned int block = codePoint >> 8;
-        if (!blocks[block])
+        page_ref * const pages = _planes[plane];
+        if (!pages) continue;
+        for (unsigned int i = 0; i != 0x100; ++i)
         {
-            blocks[block] = grzeroalloc<uint16>(0x100);
-            if (!blocks[block])
-                return false;
+            if (pages[i] != &empty_page && pages[i] != &uncached_page)
+                free((void *)pages[i]);
         }
-        blocks[block][codePoint & 0xFF] = LookupCodePoint(cst, codePoint, rangeKey);
-        // prevent infinite loop
-        if (codePoint <= prevCodePoint)
-            codePoint = prevCodePoint + 1;
-        prevCodePoint = codePoint;
-        codePoint =  NextCodePoint(cst, codePoint, &rangeKey);
+        free((void *)pages);
     }
-    return true;
 }
 
+// The subtable 12 covers the BMP as well, it fills any gaps in the subtable 4.
+uint16 CachedCmap::lookup(const uint32 usv) const throw()
+{
+    if (usv > 0xFFFF)
+        return _smp ? TtfUtil::CmapSubtable12Lookup(_smp, usv, 0) : 0;
+    const uint16 gid = _bmp ? TtfUtil::CmapSubtable4Lookup(_bmp, usv, 0) : 0;
+    return !gid && _smp ? TtfUtil::CmapSubtable12Lookup(_smp, usv, 0) : gid;
+}
 
-CachedCmap::CachedCmap(const Face & face)
-: m_isBmpOnly(true),
-  m_blocks(0)
+const CachedCmap::Page * CachedCmap::page(const uint32 block) const throw()
 {
-    const Face::Table cmap(face, Tag::cmap);
-    if (!cmap)  return;
+    page_ref * pages = atomic::load(_planes[block >> 8]);
+    if (!pages)
+    {
+        // A plane's page table counts against the budget like its pages.
+        if (long(0x100 * sizeof(page_ref)) > atomic::load(_budget) - atomic::load(_footprint))
+            return &uncached_page;
+        page_ref * const fresh = grzeroalloc<page_ref>(0x100);
+        if (!fresh) return &uncached_page;
+        if (atomic::compare_exchange(_planes[block >> 8], (page_ref *)0, fresh))
+        {
+            atomic::fetch_add(_footprint, 0x100 * sizeof(page_ref));
+            pages = fresh;
+        }
+        else
+        {
+            free((void *)fresh);
+            pages = atomic::load(_planes[block >> 8]);
+        }
+    }
+    const Page * const p = atomic::load(pages[block & 0xFF]);
+    if (p) return p;
 
-    const void * bmp_cmap = bmp_subtable(cmap);
-    const void * smp_cmap = smp_subtable(cmap);
-    m_isBmpOnly = !smp_cmap;
+    // Other threads may be filling the same page, the first to publish it wins.
+    const Page * const fresh = fill(block);
+    if (atomic::compare_exchange(pages[block & 0xFF], (const Page *)0, fresh))
+    {
+        if (fresh != &empty_page && fresh != &uncached_page)
+            atomic::fetch_add(_footprint, long(sizeof(Page) + (fresh->linear ? 0 : fresh->last - fresh->first) * sizeof(uint16)));
+        return fresh;
+    }
+    if (fresh != &empty_page && fresh != &uncached_page)
+        free((void *)fresh);
+    return atomic::load(pages[block & 0xFF]);
+}
 
-    m_blocks = grzeroalloc<uint16 *>(m_isBmpOnly ? 0x100 : 0x1100);
-    if (m_blocks && smp_cmap)
+const CachedCmap::Page * CachedCmap::fill(const uint32 block) const throw()
+{
+    const uint32 base = block << 8;
+    uint16 gids[0x100];
+    for (int lo = 0; lo != 0x100; ++lo)
+        gids[lo] = base <= 0xFFFF && _bmp ? TtfUtil::CmapSubtable4Lookup(_bmp, base + lo, 0) : 0;
+
+    // As in lookup(), the subtable 12 fills the gaps, but with one pass over
+    //  its groups for the whole page rather than one per character.
+    if (_smp)
     {
-        if (!cache_subtable<TtfUtil::CmapSubtable12NextCodepoint, TtfUtil::CmapSubtable12Lookup>(m_blocks, smp_cmap, 0x10FFFF))
-            return;
+        const TtfUtil::Sfnt::CmapSubTableFormat12 & t = *reinterpret_cast<const TtfUtil::Sfnt::CmapSubTableFormat12 *>(_smp);
+        for (uint32 i = 0, n = be::swap(t.num_groups); i != n; ++i)
+        {
+            const uint32 start = be::swap(t.group[i].start_char_code),
+                         end = be::swap(t.group[i].end_char_code);
+            if (end < base || start > base + 0xFF)  continue;
+            const uint32 gid = be::swap(t.group[i].start_glyph_id);
+            for (uint32 c = max(start, base), ce = min(end, base + 0xFF); c <= ce; ++c)
+                if (!gids[c - base])    gids[c - base] = uint16(gid + c - start);
+        }
     }
 
-    if (m_blocks && bmp_cmap)
+    int first = -1, last = -1;
+    for (int lo = 0; lo != 0x100; ++lo)
     {
-        if (!cache_subtable<TtfUtil::CmapSubtable4NextCodepoint, TtfUtil::CmapSubtable4Lookup>(m_blocks, bmp_cmap, 0xFFFF))
-            return;
+        if (gids[lo])
+        {
+            if (first < 0)  first = lo;
+            last = lo;
+        }
     }
+    if (first < 0)  return &empty_page;
+
+    bool linear = true;
+    for (int lo = first; linear && lo <= last; ++lo)
+        linear = gids[lo] == uint16(gids[first] + lo - first);
+
+    const size_t size = sizeof(Page) + (linear ? 0 : last - first) * sizeof(uint16);
+    if (long(size) > atomic::load(_budget) - atomic::load(_footprint))
+        return &uncached_page;
+    Page * const p = reinterpret_cast<Page *>(gralloc<byte>(size));
+    if (!p) return &uncached_page;
+
+    p->first = uint8(first);
+    p->last = uint8(last);
+    p->linear = linear;
+    p->delta = uint16(gids[first] - first);
+    if (!linear)
+        memcpy(p->gids, gids + first, (last - first + 1) * sizeof(uint16));
+    return p;
 }
 
-CachedCmap::~CachedCmap() throw()
+uint16 CachedCmap::operator [] (const uint32 usv) const throw()
 {
-    if (!m_blocks) return;
-    unsigned int numBlocks = (m_isBmpOnly)? 0x100 : 0x1100;
-    for (unsigned int i = 0; i < numBlocks; i++)
-        free(m_blocks[i]);
-    free(m_blocks);
+    if (usv > _limit)   return 0;
+    const Page * const p = page(usv >> 8);
+    return p == &uncached_page ? lookup(usv) : (*p)[usv & 0xFF];
 }
 
-uint16 CachedCmap::operator [] (const uint32 usv) const throw()
+// Consecutive characters mostly come from the same page, so each run of them
+//  is mapped against a page looked up once.
+void CachedCmap::map(const uint32 * usv, uint16 * gids, size_t n) const throw()
 {
-    if ((m_isBmpOnly && usv > 0xFFFF) || (usv > 0x10FFFF))
-        return 0;
-    const uint32 block = 0xFFFF & (usv >> 8);
-    if (m_blocks[block])
-        return m_blocks[block][usv & 0xFF];
-    return 0;
-};
+    for (const uint32 * const end = usv + n; usv != end;)
+    {
+        const uint32 block = *usv >> 8;
+        const Page * const p = *usv <= _limit ? page(block) : &empty_page;
+        if (p == &uncached_page)
+        {
+            do *gids++ = lookup(*usv);
+            while (++usv != end && *usv >> 8 == block);
+        }
+        else
+        {
+            do *gids++ = (*p)[*usv & 0xFF];
+            while (++usv != end && *usv >> 8 == block);
+        }
+    }
+}
 
 CachedCmap::operator bool() const throw()
 {
-    return m_blocks != 0;
+    return _cmap;
 }
 
+// Pages left uncached under the old budget are given another chance under
+//  the new one, the next time they are looked up.
+void CachedCmap::budget(const size_t bytes) throw()
+{
+    atomic::store(_budget, bytes > size_t(LONG_MAX) ? LONG_MAX : long(bytes));
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
+    {
+        page_ref * const pages = atomic::load(_planes[plane]);
+        if (!pages) continue;
+        for (unsigned int i = 0; i != 0x100; ++i)
+            atomic::compare_exchange(pages[i], &uncached_page, (const Page *)0);
+    }
+}
+
+size_t CachedCmap::footprint() const throw()
+{
+    return size_t(atomic::load(_footprint));
+}
+
+
+struct DirectCmap::Segment
+{
+    uint16  start,
+            delta;
+    uint32  glyphs;     // where in the subtable, in uint16s, start's glyph is, or 0
+};
 
 DirectCmap::DirectCmap(const Face & face)
 : _cmap(face, Tag::cmap),
   _smp(smp_subtable(_cmap)),
-  _bmp(bmp_subtable(_cmap))
+  _bmp(bmp_subtable(_cmap)),
+  _ends(0),
+  _segs(0),
+  _latin(0),
+  _num_segs(0),
+  _num_groups(0)
+{
+    if (_bmp && !index())
+    {
+        free(_ends);
+        free(_segs);
+        free(_latin);
+        _ends = 0;
+        _segs = 0;
+        _latin = 0;
+    }
+
+    // The subtable 12 groups can be binary searched if they are in order.
+    if (_smp)
+    {
+        const TtfUtil::Sfnt::CmapSubTableFormat12 & t = *reinterpret_cast<const TtfUtil::Sfnt::CmapSubTableFormat12 *>(_smp);
+        const uint32 n = be::swap(t.num_groups);
+        uint32 i = 0;
+        for (; i != n; ++i)
+        {
+            const uint32 start = be::swap(t.group[i].start_char_code);
+            if (start > be::swap(t.group[i].end_char_code)
+                    || (i && start <= be::swap(t.group[i-1].end_char_code)))
+                break;
+        }
+        if (i == n) _num_groups = n;
+    }
+}
+
+DirectCmap::~DirectCmap() throw()
+{
+    free(_ends);
+    free(_segs);
+    free(_latin);
+}
+
+// Lays the segments out in Eytzinger (breadth first) order from index 1, so
+//  the first few steps of every search read the same few cache lines.
+size_t DirectCmap::place(const uint16 * const ends, size_t i, const size_t k) throw()
+{
+    if (k > _num_segs) return i;
+    i = place(ends, i, 2*k);
+
+    const uint16 * const range = ends + 3*_num_segs + 1 + i;
+    const uint16 offset = be::peek<uint16>(range);
+    Segment & s = _segs[k];
+    _ends[k] = be::peek<uint16>(ends + i);
+    s.start  = be::peek<uint16>(ends + _num_segs + 1 + i);
+    s.delta  = be::peek<uint16>(ends + 2*_num_segs + 1 + i);
+    s.glyphs = offset ? uint32((offset >> 1) + (range - static_cast<const uint16 *>(_bmp))) : 0;
+
+    return place(ends, i + 1, 2*k + 1);
+}
+
+// Only a subtable whose segments are in order can be searched this way,
+//  otherwise lookups are left to TtfUtil.
+bool DirectCmap::index() throw()
+{
+    const TtfUtil::Sfnt::CmapSubTableFormat4 & t = *static_cast<const TtfUtil::Sfnt::CmapSubTableFormat4 *>(_bmp);
+    const size_t n = be::swap(t.seg_count_x2) >> 1;
+    for (size_t i = 1; i < n; ++i)
+        if (be::peek<uint16>(t.end_code + i - 1) >= be::peek<uint16>(t.end_code + i))
+            return false;
+
+    _ends = gralloc<uint16>(n + 1);
+    _segs = gralloc<Segment>(n + 1);
+    _latin = gralloc<uint16>(0x100);
+    if (!_ends || !_segs || !_latin) return false;
+
+    _num_segs = n;
+    place(t.end_code, 0, 1);
+
+    for (uint32 usv = 0; usv != 0x100; ++usv)
+        _latin[usv] = bmpLookup(usv);
+    return true;
+}
+
+uint16 DirectCmap::bmpLookup(const uint32 usv) const throw()
+{
+    // Find the first segment ending at or after usv. The path taken down the
+    //  tree ends in a run of right turns below it, one bit each, shifted out.
+    size_t k = 1;
+    while (k <= _num_segs)
+        k = 2*k + (_ends[k] < usv);
+    k >>= bit_set_count(k ^ (k + 1));
+    if (!k) return 0;
+
+    const Segment & s = _segs[k];
+    if (usv < s.start)  return 0;
+    if (!s.glyphs)      return uint16(usv + s.delta);
+
+    const size_t offset = s.glyphs + (usv - s.start);
+    if (offset * 2 + 1 >= be::swap(static_cast<const TtfUtil::Sfnt::CmapSubTableFormat4 *>(_bmp)->length))
+        return 0;
+    const uint16 gid = be::peek<uint16>(static_cast<const uint16 *>(_bmp) + offset);
+    return gid ? uint16(gid + s.delta) : 0;
+}
+
+inline
+uint16 DirectCmap::smpLookup(const uint32 usv) const throw()
+{
+    const TtfUtil::Sfnt::CmapSubTableFormat12 & t = *reinterpret_cast<const TtfUtil::Sfnt::CmapSubTableFormat12 *>(_smp);
+    uint32 lo = 0, hi = _num_groups;
+    while (lo != hi)
+    {
+        const uint32 mid = (lo + hi) >> 1;
+        if (be::swap(t.group[mid].end_char_code) < usv)   lo = mid + 1;
+        else                                            hi = mid;
+    }
+    if (lo == _num_groups)  return 0;
+    const uint32 start = be::swap(t.group[lo].start_char_code);
+    return usv < start ? 0 : uint16(be::swap(t.group[lo].start_glyph_id) + usv - start);
+}
+
+uint16 DirectCmap::lookup(const uint32 usv) const throw()
 {
+    if (usv > 0xFFFF)
+    {
+        if (!_smp)  return 0;
+        return _num_groups ? smpLookup(usv) : TtfUtil::CmapSubtable12Lookup(_smp, usv, 0);
+    }
+    if (!_latin)
+        return TtfUtil::CmapSubtable4Lookup(_bmp, usv, 0);
+    return usv < 0x100 ? _latin[usv] : bmpLookup(usv);
 }
 
 uint16 DirectCmap::operator [] (const uint32 usv) const throw()
 {
-    return usv > 0xFFFF
-            ? (_smp ? TtfUtil::CmapSubtable12Lookup(_smp, usv, 0) : 0)
-            : TtfUtil::CmapSubtable4Lookup(_bmp, usv, 0);
+    return lookup(usv);
+}
+
+void DirectCmap::map(const uint32 * usv, uint16 * gids, size_t n) const throw()
+{
+    for (const uint32 * const end = usv + n; usv != end; ++usv, ++gids)
+        *gids = lookup(*usv);
 }
 
 DirectCmap::operator bool () const throw()
@@ -153,3 +424,147 @@ DirectCmap::operator bool () const throw()
     return _cmap && _bmp;
 }
 
+
+
+namespace
+{
+    // Marks the characters a subtable 4 maps to a glyph, straight from its
+    //  segments. Only segments indexing the glyph id array need a lookup.
+    void cover_subtable4(uint32 * bits, const void * cst)
+    {
+        const TtfUtil::Sfnt::CmapSubTableFormat4 & t = *reinterpret_cast<const TtfUtil::Sfnt::CmapSubTableFormat4 *>(cst);
+        const uint16 num_segs = be::swap(t.seg_count_x2) >> 1;
+        const uint16 * const ends = t.end_code,
+                     * const starts = ends + num_segs + 1,
+                     * const deltas = starts + num_segs,
+                     * const offsets = deltas + num_segs;
+        for (uint16 i = 0; i != num_segs; ++i)
+        {
+            const uint32 start = be::peek<uint16>(starts + i),
+                         end = be::peek<uint16>(ends + i);
+            const uint16 delta = be::peek<uint16>(deltas + i);
+            const bool indexed = be::peek<uint16>(offsets + i) != 0;
+            for (uint32 c = start; c <= end; ++c)
+            {
+                if (indexed ? TtfUtil::CmapSubtable4Lookup(cst, c, i) : uint16(c + delta))
+                    bits[c >> 5] |= 1U << (c & 0x1F);
+            }
+        }
+    }
+
+    // Marks the characters a subtable 12 maps to a glyph, group by group.
+    void cover_subtable12(uint32 * bits, const void * cst)
+    {
+        const TtfUtil::Sfnt::CmapSubTableFormat12 & t = *reinterpret_cast<const TtfUtil::Sfnt::CmapSubTableFormat12 *>(cst);
+        for (uint32 i = 0, n = be::swap(t.num_groups); i != n; ++i)
+        {
+            const uint32 start = be::swap(t.group[i].start_char_code),
+                         end = min(be::swap(t.group[i].end_char_code), uint32(0x10FFFF)),
+                         gid = be::swap(t.group[i].start_glyph_id);
+            for (uint32 c = start; c <= end; ++c)
+            {
+                if (uint16(gid + c - start))
+                    bits[c >> 5] |= 1U << (c & 0x1F);
+            }
+        }
+    }
+
+    enum { EMPTY, MIXED, FULL };
+
+    int block_kind(const uint32 * const block)
+    {
+        uint32 any = 0, all = ~0U;
+        for (int i = 0; i != 8; ++i)
+        {
+            any |= block[i];
+            all &= block[i];
+        }
+        return any ? (~all ? MIXED : FULL) : EMPTY;
+    }
+}
+
+const uint32 Coverage::full_block[8] = { ~0U, ~0U, ~0U, ~0U, ~0U, ~0U, ~0U, ~0U };
+
+Coverage::Coverage(const Face & face, const Silf * silfs, const uint16 num_silfs)
+: _blocks(0),
+  _bits(0)
+{
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
+        _planes[plane] = 0;
+
+    // Gather the whole set as one bitmap, then keep only the blocks with a
+    //  mix of characters in and out.
+    uint32 * const bits = grzeroalloc<uint32>(0x110000 >> 5);
+    if (!bits) return;
+
+    // A character is covered if either subtable maps it, as CachedCmap has it.
+    const Face::Table table(face, Tag::cmap);
+    if (const void * const smp = smp_subtable(table))
+        cover_subtable12(bits, smp);
+    if (const void * const bmp = bmp_subtable(table))
+        cover_subtable4(bits, bmp);
+    for (const Silf * s = silfs, * const se = s + num_silfs; s != se; ++s)
+        for (uint16 i = 0; i != s->numPseudo(); ++i)
+        {
+            const Pseudo & p = s->pseudo(i);
+            if (p.gid && p.uid <= 0x10FFFF)
+                bits[p.uid >> 5] |= 1U << (p.uid & 0x1F);
+        }
+
+    size_t num_planes = 0, num_mixed = 0;
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
+    {
+        bool any = false;
+        for (const uint32 * b = bits + (plane << 11), * const be = b + 0x800; b != be; b += 8)
+        {
+            const int kind = block_kind(b);
+            any |= kind != EMPTY;
+            num_mixed += kind == MIXED;
+        }
+        num_planes += any;
+    }
+
+    _blocks = grzeroalloc<const uint32 *>(num_planes * 0x100 + 1);
+    _bits = gralloc<uint32>(num_mixed * 8 + 1);
+    if (!_blocks || !_bits)
+    {
+        free(_blocks);
+        free(_bits);
+        free(bits);
+        _blocks = 0;
+        _bits = 0;
+        return;
+    }
+
+    const uint32 ** blocks = _blocks;
+    uint32 * mixed = _bits;
+    for (unsigned int plane = 0; plane != 0x11; ++plane)
+    {
+        const uint32 * const pb = bits + (plane << 11);
+        bool any = false;
+        for (unsigned int i = 0; i != 0x100; ++i)
+        {
+            switch (block_kind(pb + i * 8))
+            {
+            case FULL:  blocks[i] = full_block; break;
+            case MIXED:
+                memcpy(mixed, pb + i * 8, 8 * sizeof(uint32));
+                blocks[i] = mixed;
+                mixed += 8;
+                break;
+            default:    continue;
+            }
+            any = true;
+        }
+        if (!any) continue;
+        _planes[plane] = blocks;
+        blocks += 0x100;
+    }
+    free(bits);
+}
+
+Coverage::~Coverage() throw()
+{
+    free(_blocks);
+    free(_bits);
+}
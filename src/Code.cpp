@@ -41,6 +41,7 @@ of the License or (at your option) any later version.
 #include "inc/Machine.h"
 #include "inc/Rule.h"
 #include "inc/Silf.h"
+#include "inc/Snapshot.h"
 
 #include <cstdio>
 
@@ -729,6 +730,91 @@ void Machine::Code::release_buffers() throw()
     _own  = false;
 }
 
+// The size of the instructions and data together, as laid out in memory.
+size_t Machine::Code::programSize() const throw()
+{
+    return _code ? ((_instr_count+1) + (_data_size + sizeof(instr)-1)/sizeof(instr))*sizeof(instr) : 0;
+}
+
+
+namespace {
+    // Marks a program stored in line after its header rather than in a pool.
+    const uint32 INLINE_PROGRAM = 0xFFFFFFFF;
+}
+
+// Programs in a pool are written by the owner of the pool, and their
+//  instructions are converted in place in pool_image.  Instructions are
+//  snapshotted as opcode numbers as the implementation addresses differ
+//  between processes.
+bool Machine::Code::writeSnapshot(SnapshotWriter & w, const byte * pool, byte * pool_image) const throw()
+{
+    const uint32 offset = pool && _code ? uint32(reinterpret_cast<const byte *>(_code) - pool) : INLINE_PROGRAM,
+                 instr_count = _code ? uint32(_instr_count) : 0,
+                 data_size = uint32(_data_size);
+    const uint8  flags = uint8(_constraint | (_modify << 1) | (_delete << 2));
+    w.write(offset);
+    w.write(instr_count);
+    w.write(data_size);
+    w.write(_max_ref);
+    w.write(flags);
+    if (!_code) return true;
+
+    byte * const image = pool ? (pool_image ? pool_image + offset : 0) : w.reserve(programSize());
+    if (!image) return true;        // Only sizing the snapshot.
+    if (!pool)  memcpy(image, _code, programSize());
+
+    const opcode_t * const op_to_fn = Machine::getOpcodeTable();
+    for (size_t i = 0; i <= _instr_count; ++i)
+    {
+        size_t opc = 0;
+        while (opc <= MAX_OPCODE && op_to_fn[opc].impl[_constraint] != _code[i]) ++opc;
+        if (opc > MAX_OPCODE) return false;
+        const instr op = reinterpret_cast<instr>(opc);
+        memcpy(image + i*sizeof(instr), &op, sizeof(instr));
+    }
+    return true;
+}
+
+bool Machine::Code::readSnapshot(SnapshotReader & r, byte * pool, size_t pool_size) throw()
+{
+    assert(!_code);
+    uint32  offset = 0, instr_count = 0, data_size = 0;
+    uint8   flags = 0;
+    if (!r.read(offset) || !r.read(instr_count) || !r.read(data_size)
+            || !r.read(_max_ref) || !r.read(flags))
+        return false;
+    _constraint = flags & 1;
+    _modify     = (flags >> 1) & 1;
+    _delete     = (flags >> 2) & 1;
+    if (instr_count == 0)   return true;     // An empty program.
+
+    _instr_count = instr_count;
+    _data_size   = data_size;
+    const size_t sz = ((_instr_count+1) + (_data_size + sizeof(instr)-1)/sizeof(instr))*sizeof(instr);
+    if (offset == INLINE_PROGRAM)
+    {
+        _code = reinterpret_cast<instr *>(r.read_array<byte>(sz));
+        _own  = true;
+    }
+    else if (pool && offset % sizeof(instr) == 0 && offset <= pool_size && sz <= pool_size - offset)
+        _code = reinterpret_cast<instr *>(pool + offset);
+    if (!_code) return r.fail();
+    _data = reinterpret_cast<byte *>(_code + (_instr_count+1));
+
+    const opcode_t * const op_to_fn = Machine::getOpcodeTable();
+    for (instr * ip = _code, * const end = ip + _instr_count + 1; ip != end; ++ip)
+    {
+        const size_t opc = reinterpret_cast<size_t>(*ip);
+        if (opc > MAX_OPCODE || !op_to_fn[opc].impl[_constraint])
+        {
+            release_buffers();
+            return r.fail();
+        }
+        *ip = op_to_fn[opc].impl[_constraint];
+    }
+    return true;
+}
+
 
 int32 Machine::Code::run(Machine & m, slotref * & map) const
 {
@@ -1074,25 +1074,24 @@ void SlotCollision::initFromSlot(Segment *seg, Slot *slot)
 	// GrcSymbolTable::AssignInternalGlyphAttrIDs.
     uint16 gid = slot->gid();
     uint16 aCol = seg->silf()->aCollision(); // flags attr ID
-    const GlyphFace * glyphFace = seg->getFace()->glyphs().glyphSafe(gid);
-    if (!glyphFace)
+    const GlyphCache & glyphs = seg->getFace()->glyphs();
+    if (gid >= glyphs.numGlyphs())
         return;
-    const sparse &p = glyphFace->attrs();
-    _flags = p[aCol];
-    _limit = Rect(Position(p[aCol+1], p[aCol+2]),
-                  Position(p[aCol+3], p[aCol+4]));
-    _margin = p[aCol+5];
-    _marginWt = p[aCol+6];
-
-    _seqClass = p[aCol+7];
-	_seqProxClass = p[aCol+8];
-    _seqOrder = p[aCol+9];
-	_seqAboveXoff = p[aCol+10];
-	_seqAboveWt = p[aCol+11];
-	_seqBelowXlim = p[aCol+12];
-	_seqBelowWt = p[aCol+13];
-	_seqValignHt = p[aCol+14];
-	_seqValignWt = p[aCol+15];    
+    _flags = glyphs.glyphAttr(gid, aCol);
+    _limit = Rect(Position(glyphs.glyphAttr(gid, aCol+1), glyphs.glyphAttr(gid, aCol+2)),
+                  Position(glyphs.glyphAttr(gid, aCol+3), glyphs.glyphAttr(gid, aCol+4)));
+    _margin = glyphs.glyphAttr(gid, aCol+5);
+    _marginWt = glyphs.glyphAttr(gid, aCol+6);
+
+    _seqClass = glyphs.glyphAttr(gid, aCol+7);
+	_seqProxClass = glyphs.glyphAttr(gid, aCol+8);
+    _seqOrder = glyphs.glyphAttr(gid, aCol+9);
+	_seqAboveXoff = glyphs.glyphAttr(gid, aCol+10);
+	_seqAboveWt = glyphs.glyphAttr(gid, aCol+11);
+	_seqBelowXlim = glyphs.glyphAttr(gid, aCol+12);
+	_seqBelowWt = glyphs.glyphAttr(gid, aCol+13);
+	_seqValignHt = glyphs.glyphAttr(gid, aCol+14);
+	_seqValignWt = glyphs.glyphAttr(gid, aCol+15);    
 
     // These attributes do not have corresponding glyph attribute:
     _exclGlyph = 0;
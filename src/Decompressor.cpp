@@ -33,32 +33,17 @@ using namespace lz4;
 
 namespace {
 
+// Adds the bytes of an extended length, returning false if it runs off the
+//  end of the input.
 inline
-u32 read_literal(u8 const * &s, u8 const * const e, u32 l) {
-    if (l == 15 && s != e)
+bool read_length(u8 const * &s, u8 const * const e, size_t & l) {
+    u8 b;
+    do
     {
-        u8 b = 0;
-        do { l += b = *s++; } while(b==0xff && s != e);
-    }
-    return l;
-}
-
-bool read_sequence(u8 const * &src, u8 const * const end, u8 const * &literal, u32 & literal_len, u32 & match_len, u32 & match_dist)
-{
-    u8 const token = *src++;
-    
-    literal_len = read_literal(src, end, token >> 4);
-    literal = src;
-    src += literal_len;
-    
-    if (src > end - 2 || src < literal)
-        return false;
-    
-    match_dist  = *src++;
-    match_dist |= *src++ << 8;
-    match_len = read_literal(src, end, token & 0xf);
-    
-    return src <= end-5;
+        if (s == e) return false;
+        l += b = *s++;
+    } while (b == 0xff);
+    return true;
 }
 
 }
@@ -69,47 +54,66 @@ int lz4::decompress(void const *in, size_t in_size, void *out, size_t out_size)
         return -1;
     
     u8 const *       src     = static_cast<u8 const *>(in),
-             *       literal = 0,
              * const src_end = src + in_size;
 
     u8 *       dst     = static_cast<u8*>(out),
        * const dst_end = dst + out_size;
     
-    u32 literal_len = 0,
-        match_len = 0,
-        match_dist = 0;
-    
-    while (read_sequence(src, src_end, literal, literal_len, match_len, match_dist))
+    // Each pass starts with src before src_end, so the token can be read.
+    for (;;)
     {
-        if (literal_len != 0)
+        u8 const token = *src++;
+        
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !read_length(src, src_end, literal_len))
+            return -1;
+        if (literal_len > size_t(src_end - src) || literal_len > size_t(dst_end - dst))
+            return -1;
+        u8 const * const literal = src;
+        src += literal_len;
+        
+        // The last sequence is literals only and ends the block.
+        if (src == src_end)
         {
-            // Copy in literal. At this point the last full sequence must be at
-            // least MINMATCH + 5 from the end of the output buffer.
-            if (align(literal_len) > unsigned(dst_end - dst - (MINMATCH+5)) || dst_end - dst < MINMATCH + 5)
-                return -1;
-            dst = overrun_copy(dst, literal, literal_len);
+            ::memcpy(dst, literal, literal_len);
+            return int(dst + literal_len - static_cast<u8*>(out));
         }
         
-        // Copy, possibly repeating, match from earlier in the
-        //  decoded output.
-        u8 const * const pcpy = dst - match_dist;
-        if (pcpy < static_cast<u8*>(out)
-                  || pcpy >= dst
-                  || match_len > unsigned(dst_end - dst - (MINMATCH+5))
-                  || dst_end - dst < MINMATCH + 5)
+        if (size_t(dst_end - dst) >= literal_len + WILDCOPY
+                && size_t(src_end - literal) >= literal_len + WILDCOPY)
+            dst = wild_copy<32>(dst, literal, literal_len);
+        else
+        {
+            ::memcpy(dst, literal, literal_len);
+            dst += literal_len;
+        }
+        
+        if (src_end - src < 2)
+            return -1;
+        size_t const match_dist = src[0] | src[1] << 8;
+        src += 2;
+        size_t match_len = token & 0xf;
+        if (match_len == 15 && !read_length(src, src_end, match_len))
+            return -1;
+        match_len += MINMATCH;
+        
+        // A match can't end the block, nor refer to before the start of the
+        //  output or write past its end.
+        if (src == src_end
+                || match_dist == 0
+                || match_dist > size_t(dst - static_cast<u8*>(out))
+                || match_len > size_t(dst_end - dst))
             return -1;
-        if (dst > pcpy+sizeof(unsigned long) 
-            && dst + align(match_len + MINMATCH) <= dst_end)
-            dst = overrun_copy(dst, pcpy, match_len + MINMATCH);
-        else 
-            dst = safe_copy(dst, pcpy, match_len + MINMATCH);
+        
+        // Copy, possibly repeating, match from earlier in the decoded output.
+        u8 const * const pcpy = dst - match_dist;
+        if (size_t(dst_end - dst) < match_len + WILDCOPY)
+            dst = safe_copy(dst, pcpy, match_len);
+        else if (match_dist >= 32)
+            dst = wild_copy<32>(dst, pcpy, match_len);
+        else if (match_dist >= 16)
+            dst = wild_copy<16>(dst, pcpy, match_len);
+        else
+            dst = pattern_copy(dst, match_dist, match_len);
     }
-    
-    if (literal_len > src_end - literal
-              || literal_len > dst_end - dst)
-        return -1;
-    dst = fast_copy(dst, literal, literal_len);
-    
-    return dst - (u8*)out;
 }
-
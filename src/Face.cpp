@@ -32,12 +32,16 @@ of the License or (at your option) any later version.
 #include "inc/Endian.h"
 #include "inc/Face.h"
 #include "inc/FileFace.h"
+#include "inc/Font.h"
 #include "inc/GlyphFace.h"
 #include "inc/json.h"
+#include "inc/MemoryFace.h"
 #include "inc/SegCacheStore.h"
 #include "inc/Segment.h"
 #include "inc/NameTable.h"
 #include "inc/Error.h"
+#include "inc/Snapshot.h"
+#include "inc/Thread.h"
 
 using namespace graphite2;
 
@@ -49,16 +53,39 @@ enum compression
     LZ4
 };
 
+// A snapshot holds structures copied out of memory, so it can only be read
+//  back by the same version of the library built for the same kind of
+//  machine.  The magic number also catches a byte swapped snapshot.
+struct snapshot_header
+{
+    uint32  magic,
+            version,
+            abi,
+            font,       // fingerprint of the font the snapshot was made from
+            length,     // of the body that follows
+            check;      // hash of the body
+};
+
+const uint32 SNAPSHOT_MAGIC   = 0x47725332,   // 'GrS2'
+             SNAPSHOT_VERSION = (GR2_VERSION_MAJOR << 16) | (GR2_VERSION_MINOR << 8) | GR2_VERSION_BUGFIX,
+             SNAPSHOT_ABI     = sizeof(void *) | (sizeof(long) << 8) | (sizeof(GlyphBox) << 16);
+
 }
 
 Face::Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops)
 : m_appFaceHandle(appFaceHandle),
   m_pFileFace(NULL),
+  m_pMemoryFace(NULL),
   m_pGlyphFaceCache(NULL),
   m_cmap(NULL),
+  m_coverage(NULL),
   m_pNames(NULL),
   m_logger(NULL),
   m_error(0), m_errcntxt(0),
+  m_tables(NULL),
+  m_pSilfTable(NULL),
+  m_advanceCaches(NULL),
+  m_loadState(LOAD_DONE),
   m_silfs(NULL),
   m_numSilf(0),
   m_ascent(0),
@@ -71,13 +98,24 @@ Face::Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops)
 
 Face::~Face()
 {
+    m_loader.join();
     setLogger(0);
     delete m_pGlyphFaceCache;
     delete m_cmap;
+    delete m_coverage;
     delete[] m_silfs;
+    delete m_pSilfTable;
+    while (m_advanceCaches)
+    {
+        AdvanceCache * const c = m_advanceCaches;
+        m_advanceCaches = c->next;
+        delete c;
+    }
+    trimTables();
 #ifndef GRAPHITE2_NFILEFACE
     delete m_pFileFace;
 #endif
+    delete m_pMemoryFace;
     delete m_pNames;
 }
 
@@ -88,6 +126,91 @@ float Face::default_glyph_advance(const void* font_ptr, gr_uint16 glyphid)
     return font.face().glyphs().glyph(glyphid)->theAdvance().x * font.scale();
 }
 
+bool Face::loadInBackground(parallel::task load, void * data)
+{
+    atomic::store(m_loadState, LOAD_PENDING);
+    if (m_loader.start(load, data)) return true;
+
+    atomic::store(m_loadState, LOAD_DONE);
+    return false;
+}
+
+void Face::loaded(bool ok)
+{
+    atomic::store(m_loadState, ok ? LOAD_DONE : LOAD_FAILED);
+    m_loader.finish();
+}
+
+bool Face::waitLoaded() const
+{
+    long state = atomic::load(m_loadState);
+    if (state == LOAD_PENDING)
+    {
+        m_loader.wait();
+        state = atomic::load(m_loadState);
+    }
+    return state == LOAD_DONE;
+}
+
+bool Face::loading() const
+{
+    return atomic::load(m_loadState) == LOAD_PENDING;
+}
+
+const AdvanceCache * Face::advanceCache(float ppm) const
+{
+    SpinLock::holder lock(m_advanceLock);
+
+    for (AdvanceCache * c = m_advanceCaches; c; c = c->next)
+        if (c->ppm() == ppm)
+        {
+            ++c->refs;
+            return c;
+        }
+
+    AdvanceCache * const c = new AdvanceCache(glyphs().numGlyphs(), ppm);
+    if (!c || !*c)
+    {
+        delete c;
+        return 0;
+    }
+    c->refs = 1;
+    c->next = m_advanceCaches;
+    m_advanceCaches = c;
+    return c;
+}
+
+void Face::releaseAdvanceCache(const AdvanceCache * c) const
+{
+    if (!c) return;
+    SpinLock::holder lock(m_advanceLock);
+
+    for (AdvanceCache * * p = &m_advanceCaches; *p; p = &(*p)->next)
+        if (*p == c)
+        {
+            if (--(*p)->refs == 0)
+            {
+                *p = c->next;
+                delete c;
+            }
+            return;
+        }
+}
+
+// Threads asking at once may each build the coverage, the first to publish
+//  it wins.
+const Coverage * Face::coverage() const
+{
+    Coverage * const cov = atomic::load(m_coverage);
+    if (cov) return cov;
+
+    Coverage * const fresh = new Coverage(*this, m_silfs, m_numSilf);
+    if (!fresh) return 0;
+    if (!*fresh || !atomic::compare_exchange(m_coverage, (Coverage *)0, fresh))
+        delete fresh;
+    return atomic::load(m_coverage);
+}
+
 bool Face::readGlyphs(uint32 faceOptions)
 {
     Error e;
@@ -117,7 +240,7 @@ bool Face::readGlyphs(uint32 faceOptions)
     return true;
 }
 
-bool Face::readGraphite(const Table & silf)
+bool Face::readGraphite(const Table & silf, uint32 faceOptions)
 {
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _silf_cat(tele.silf);
@@ -135,6 +258,9 @@ bool Face::readGraphite(const Table & silf)
 
     be::skip<uint16>(p);            // reserved
 
+    // Decoding passes in parallel reads them lazily and then finishes them all at once.
+    const bool lazy = faceOptions & gr_face_lazyPasses,
+               threaded = !lazy && (faceOptions & gr_face_parallelLoad) && parallel::concurrency() > 1;
     bool havePasses = false;
     m_silfs = new Silf[m_numSilf];
     if (e.test(!m_silfs, E_OUTOFMEM)) return error(e);
@@ -146,22 +272,45 @@ bool Face::readGraphite(const Table & silf)
         if (e.test(next > silf.size() || offset >= next, E_BADSIZE))
             return error(e);
 
-        if (!m_silfs[i].readGraphite(silf + offset, next - offset, *this, version))
+        if (!m_silfs[i].readGraphite(silf + offset, next - offset, *this, version, lazy || threaded)
+            || (threaded && !m_silfs[i].readPendingPasses(*this)))
             return false;
 
         if (m_silfs[i].numPasses())
             havePasses = true;
     }
 
+    // Lazily read passes decode out of the table later, so keep hold of it.
+    if (havePasses && lazy)
+    {
+        m_pSilfTable = new Table(silf);
+        if (e.test(!m_pSilfTable, E_OUTOFMEM)) return error(e);
+    }
+
+    if (havePasses)
+        denseGlyphAttrs();
     return havePasses;
 }
 
+// Lays out the glyph attributes every Silf reads per slot in dense columns,
+//  an out of memory failure simply leaves them sparse.
+void Face::denseGlyphAttrs()
+{
+    uint16 * const attrs = gralloc<uint16>(m_numSilf * Silf::MAX_DENSE_ATTRS);
+    if (!attrs) return;
+    size_t n = 0;
+    for (const Silf * s = m_silfs, * const se = s + m_numSilf; s != se; ++s)
+        n += s->denseAttrs(attrs + n);
+    m_pGlyphFaceCache->denseAttrs(attrs, n);
+    free(attrs);
+}
+
 bool Face::readFeatures()
 {
     return m_Sill.readFace(*this);
 }
 
-bool Face::runGraphite(Segment *seg, const Silf *aSilf) const
+bool Face::runGraphite(Segment *seg, const Silf *aSilf, VMScratch & scratch) const
 {
 #if !defined GRAPHITE2_NTRACING
     json * dbgout = logger();
@@ -177,14 +326,14 @@ bool Face::runGraphite(Segment *seg, const Silf *aSilf) const
 //        seg->reverseSlots();
     if ((seg->dir() & 3) == 3 && aSilf->bidiPass() == 0xFF)
         seg->doMirror(aSilf->aMirror());
-    bool res = aSilf->runGraphite(seg, 0, aSilf->positionPass(), true);
+    bool res = aSilf->runGraphite(seg, scratch, 0, aSilf->positionPass(), true);
     if (res)
     {
         seg->associateChars(0, seg->charInfoCount());
         if (aSilf->flags() & 0x20)
             res &= seg->initCollisions();
         if (res)
-            res &= aSilf->runGraphite(seg, aSilf->positionPass(), aSilf->numPasses(), false);
+            res &= aSilf->runGraphite(seg, scratch, aSilf->positionPass(), aSilf->numPasses(), false);
     }
 
 #if !defined GRAPHITE2_NTRACING
@@ -256,6 +405,103 @@ void Face::takeFileFace(FileFace* pFileFace GR_MAYBE_UNUSED/*takes ownership*/)
 #endif
 }
 
+void Face::takeMemoryFace(MemoryFace* pMemoryFace/*takes ownership*/)
+{
+    if (m_pMemoryFace==pMemoryFace)
+      return;
+
+    delete m_pMemoryFace;
+    m_pMemoryFace = pMemoryFace;
+}
+
+// Identifies the font a snapshot was made from without reading the tables
+// it was derived from, which would cost much of what loading a snapshot
+// saves. The head table holds the checksum adjustment, which font tools
+// recompute whenever any table changes, along with the font revision and
+// modification date.
+uint32 Face::fingerprint() const
+{
+    size_t sz = 0;
+    const void * const p = (*m_ops.get_table)(m_appFaceHandle, Tag::head, &sz);
+    const uint32 h = snapshot::hash(p, p ? sz : 0, Tag::head);
+    if (p && m_ops.release_table)
+        (*m_ops.release_table)(m_appFaceHandle, p);
+    return h;
+}
+
+size_t Face::snapshot(byte * buf, size_t len) const
+{
+    if (m_numSilf == 0) return 0;
+
+    SnapshotWriter w(buf, len);
+    snapshot_header hdr = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, SNAPSHOT_ABI, fingerprint(), 0, 0 };
+    w.reserve(sizeof hdr);      // filled in once the body is written.
+
+    m_pGlyphFaceCache->writeSnapshot(w);
+    w.write(m_numSilf);
+    for (const Silf * s = m_silfs, * const se = s + m_numSilf; s != se; ++s)
+        if (!s->writeSnapshot(w, *this)) return 0;
+
+    if (w.size() - sizeof hdr > 0xFFFFFFFF) return 0;
+    hdr.length = uint32(w.size() - sizeof hdr);
+    if (w.fits())
+    {
+        hdr.check = snapshot::hash(buf + sizeof hdr, hdr.length);
+        memcpy(buf, &hdr, sizeof hdr);
+    }
+    return w.size();
+}
+
+bool Face::matchSnapshot(SnapshotReader & snap) const
+{
+    snapshot_header hdr;
+    if (!snap.read(hdr)
+        || hdr.magic != SNAPSHOT_MAGIC || hdr.version != SNAPSHOT_VERSION || hdr.abi != SNAPSHOT_ABI
+        || hdr.length != snap.remaining())
+        return false;
+
+    const byte * const body = snap.take(0);
+    return hdr.check == snapshot::hash(body, hdr.length)
+        && hdr.font == fingerprint();
+}
+
+// The snapshot must already have been matched against this face, we trust it
+//  to have been made from a face that loaded without errors.
+bool Face::readSnapshot(SnapshotReader & snap, uint32 faceOptions)
+{
+    Error e;
+    if (!readGlyphs(faceOptions & ~(gr_face_preloadGlyphs | gr_face_dumbRendering)))
+        return false;
+    error_context(EC_READSNAPSHOT);
+    if (e.test(!m_pGlyphFaceCache->readSnapshot(snap), E_BADSNAPSHOT))
+        return error(e);
+    if (faceOptions & gr_face_preloadGlyphs)
+        nameTable();
+
+    if (!readFeatures())
+        return false;
+
+    error_context(EC_READSNAPSHOT);
+    snap.read(m_numSilf);
+    if (e.test(!snap || m_numSilf == 0, E_BADSNAPSHOT)) return error(e);
+    m_silfs = new Silf[m_numSilf];
+    if (e.test(!m_silfs, E_OUTOFMEM)) return error(e);
+
+    bool havePasses = false;
+    for (Silf * s = m_silfs, * const se = s + m_numSilf; s != se; ++s)
+    {
+        if (!s->readSnapshot(snap, *this))
+            return false;
+        if (s->numPasses())
+            havePasses = true;
+    }
+
+    if (e.test(snap.remaining() != 0, E_BADSNAPSHOT)) return error(e);
+    if (havePasses)
+        denseGlyphAttrs();
+    return havePasses;
+}
+
 NameTable * Face::nameTable() const
 {
     if (m_pNames) return m_pNames;
@@ -276,53 +522,120 @@ uint16 Face::languageForLocale(const char * locale) const
 
 
 Face::Table::Table(const Face & face, const Tag n, uint32 version) throw()
-: _f(&face), _compressed(false)
+: _e(face.openTable(n, version))
 {
-    size_t sz = 0;
-    _p = static_cast<const byte *>((*_f->m_ops.get_table)(_f->m_appFaceHandle, n, &sz));
-    _sz = uint32(sz);
+}
+
+Face::Table & Face::Table::operator = (const Table & rhs) throw()
+{
+    if (_e == rhs._e)   return *this;
+
+    this->~Table();
+    new (this) Table(rhs);
+    return *this;
+}
 
-    if (!TtfUtil::CheckTable(n, _p, _sz))
+Face::TableEntry * Face::findTable(const Tag n, uint32 version) const
+{
+    for (TableEntry * t = m_tables; t; t = t->next)
+        if (t->tag == n && t->version == version)
+        {
+            atomic::fetch_add(t->refs, 1);
+            return t;
+        }
+    return 0;
+}
+
+Face::TableEntry * Face::openTable(const Tag n, uint32 version) const
+{
     {
-        releaseBuffers();     // Make sure we release the table buffer even if the table failed it's checks
-        return;
+        SpinLock::holder lock(m_tableLock);
+        TableEntry * const t = findTable(n, version);
+        if (t) return t;
     }
 
-    if (be::peek<uint32>(_p) >= version)
-        decompress();
+    // Fetch the table outside the lock as providers and decompression can be
+    //  slow. Should another thread get there first we use its copy instead.
+    TableEntry * t = new TableEntry(n, version);
+    if (!t) return 0;
+    t->load(*this);
+
+    TableEntry * other;
+    {
+        SpinLock::holder lock(m_tableLock);
+        other = findTable(n, version);
+        if (!other)
+        {
+            t->next = m_tables;
+            m_tables = t;
+            return t;
+        }
+    }
+    t->release(*this);
+    delete t;
+    return other;
 }
 
-void Face::Table::releaseBuffers()
+void Face::trimTables() const
 {
-    if (_compressed)
-        free(const_cast<byte *>(_p));
-    else if (_p && _f->m_ops.release_table)
-        (*_f->m_ops.release_table)(_f->m_appFaceHandle, _p);
-    _p = 0; _sz = 0;
+    SpinLock::holder lock(m_tableLock);
+    for (TableEntry ** t = &m_tables; *t;)
+    {
+        TableEntry * const e = *t;
+        if (atomic::load(e->refs) == 0)
+        {
+            *t = e->next;
+            e->release(*this);
+            delete e;
+        }
+        else
+            t = &e->next;
+    }
 }
 
-Face::Table & Face::Table::operator = (const Table & rhs) throw()
+Face::TableEntry::TableEntry(const Tag n, uint32 v) throw()
+: p(0), sz(0), tag(n), version(v), refs(1), compressed(false), next(0)
 {
-    if (_p == rhs._p)   return *this;
+}
 
-    this->~Table();
-    new (this) Table(rhs);
-    return *this;
+void Face::TableEntry::load(const Face & face) throw()
+{
+    size_t len = 0;
+    p = static_cast<const byte *>((*face.m_ops.get_table)(face.m_appFaceHandle, tag, &len));
+    sz = uint32(len);
+
+    if (!TtfUtil::CheckTable(tag, p, sz))
+    {
+        release(face);     // Make sure we release the table buffer even if the table failed it's checks
+        return;
+    }
+
+    if (be::peek<uint32>(p) >= version)
+        decompress(face);
+}
+
+void Face::TableEntry::release(const Face & face) throw()
+{
+    if (compressed)
+        free(const_cast<byte *>(p));
+    else if (p && face.m_ops.release_table)
+        (*face.m_ops.release_table)(face.m_appFaceHandle, p);
+    p = 0; sz = 0;
 }
 
-Error Face::Table::decompress()
+Error Face::TableEntry::decompress(const Face & face) throw()
 {
     Error e;
-    if (e.test(_sz < 5 * sizeof(uint32), E_BADSIZE))
+    if (e.test(sz < 5 * sizeof(uint32), E_BADSIZE))
         return e;
     byte * uncompressed_table = 0;
     size_t uncompressed_size = 0;
 
-    const byte * p = _p;
-    const uint32 version = be::read<uint32>(p);    // Table version number.
+    const byte * src = p;
+    const uint32 table_version = be::read<uint32>(src);    // Table version number.
 
     // The scheme is in the top 5 bits of the 1st uint32.
-    const uint32 hdr = be::read<uint32>(p);
+    const uint32 hdr = be::read<uint32>(src);
     switch(compression(hdr >> 27))
     {
     case NONE: return e;
@@ -336,7 +649,7 @@ Error Face::Table::decompress()
             memset(uncompressed_table, 0, 4);   // make sure version number is initialised
             // coverity[forward_null : FALSE] - uncompressed_table has been checked so can't be null
             // coverity[checked_return : FALSE] - we test e later
-            e.test(lz4::decompress(p, _sz - 2*sizeof(uint32), uncompressed_table, uncompressed_size) != signed(uncompressed_size), E_SHRINKERFAILED);
+            e.test(lz4::decompress(src, sz - 2*sizeof(uint32), uncompressed_table, uncompressed_size) != signed(uncompressed_size), E_SHRINKERFAILED);
         }
         break;
     }
@@ -349,11 +662,11 @@ Error Face::Table::decompress()
     if (!e)
         // coverity[forward_null : FALSE] - uncompressed_table has already been tested so can't be null
         // coverity[checked_return : FALSE] - we test e later
-        e.test(be::peek<uint32>(uncompressed_table) != version, E_SHRINKERFAILED);
+        e.test(be::peek<uint32>(uncompressed_table) != table_version, E_SHRINKERFAILED);
 
     // Tell the provider to release the compressed form since were replacing
     //   it anyway.
-    releaseBuffers();
+    release(face);
 
     if (e)
     {
@@ -362,9 +675,9 @@ Error Face::Table::decompress()
         uncompressed_size  = 0;
     }
 
-    _p = uncompressed_table;
-    _sz = uncompressed_size;
-    _compressed = true;
+    p = uncompressed_table;
+    sz = uncompressed_size;
+    compressed = true;
 
     return e;
 }
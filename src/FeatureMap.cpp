@@ -48,6 +48,23 @@ namespace
         return (a < b ? -1 : (b < a ? 1 : 0));
     }
 
+    template <typename T>
+    int cmpLang(const void *ap, const void *bp)
+    {
+        const T & a = *static_cast<const T *>(ap),
+                & b = *static_cast<const T *>(bp);
+        if (a.m_lang != b.m_lang)   return a.m_lang < b.m_lang ? -1 : 1;
+        return a.m_index < b.m_index ? -1 : (a.m_index > b.m_index ? 1 : 0);
+    }
+
+    template <typename T>
+    int cmpLangTag(const void *kp, const void *ep)
+    {
+        const uint32 k = *static_cast<const uint32 *>(kp),
+                     e = static_cast<const T *>(ep)->m_lang;
+        return k < e ? -1 : (e < k ? 1 : 0);
+    }
+
     const size_t    FEAT_HEADER     = sizeof(uint32) + 2*sizeof(uint16) + sizeof(uint32),
                     FEATURE_SIZE    = sizeof(uint32)
                                     + 2*sizeof(uint16)
@@ -189,6 +206,8 @@ bool FeatureMap::readFeats(const Face & face)
 bool SillMap::readFace(const Face & face)
 {
     if (!m_FeatureMap.readFeats(face)) return false;
+    m_default = face.featureSets().intern(m_FeatureMap.m_defaultFeatures, true);
+    if (!m_default) return false;
     if (!readSill(face)) return false;
     return true;
 }
@@ -209,14 +228,16 @@ bool SillMap::readSill(const Face & face)
     p += 6;     // skip the fast search
     if (sill.size() < m_numLanguages * 8U + 12) return false;
 
+    // Add the language id feature which is always feature id 1
+    const FeatureRef * const pLangRef = m_FeatureMap.findFeatureRef(1);
+
     for (int i = 0; i < m_numLanguages; i++)
     {
         uint32 langid = be::read<uint32>(p);
         uint16 numSettings = be::read<uint16>(p);
         uint16 offset = be::read<uint16>(p);
         if (offset + 8U * numSettings > sill.size() && numSettings > 0) return false;
-        Features* feats = new Features(m_FeatureMap.m_defaultFeatures);
-        if (!feats) return false;
+        Features feats(m_FeatureMap.m_defaultFeatures);
         const byte *pLSet = sill + offset;
 
         // Apply langauge specific settings
@@ -226,44 +247,152 @@ bool SillMap::readSill(const Face & face)
             uint16 val = be::read<uint16>(pLSet);
             pLSet += 2;
             const FeatureRef* pRef = m_FeatureMap.findFeatureRef(name);
-            if (pRef)   pRef->applyValToFeature(val, *feats);
+            if (pRef)   pRef->applyValToFeature(val, feats);
         }
-        // Add the language id feature which is always feature id 1
-        const FeatureRef* pRef = m_FeatureMap.findFeatureRef(1);
-        if (pRef)   pRef->applyValToFeature(langid, *feats);
+        if (pLangRef)   pLangRef->applyValToFeature(langid, feats);
 
         m_langFeats[i].m_lang = langid;
-        m_langFeats[i].m_pFeatures = feats;
+        m_langFeats[i].m_pFeatures = face.featureSets().intern(feats, true);
+        if (!m_langFeats[i].m_pFeatures) return false;
+    }
+
+    // Index the languages by tag, keeping the first of any repeated tag.
+    if (!m_numLanguages) return true;
+    m_langIndex = gralloc<LangIndex>(m_numLanguages);
+    if (!m_langIndex) return false;
+    for (uint16 i = 0; i < m_numLanguages; i++)
+    {
+        m_langIndex[i].m_lang = m_langFeats[i].m_lang;
+        m_langIndex[i].m_index = i;
+    }
+    qsort(m_langIndex, m_numLanguages, sizeof(LangIndex), &cmpLang<LangIndex>);
+    m_numIndexed = 0;
+    for (uint16 i = 0; i < m_numLanguages; i++)
+    {
+        if (m_numIndexed && m_langIndex[m_numIndexed-1].m_lang == m_langIndex[i].m_lang)
+            continue;
+        m_langIndex[m_numIndexed++] = m_langIndex[i];
     }
     return true;
 }
 
 
-Features* SillMap::cloneFeatures(uint32 langname/*0 means default*/) const
+const Features & SillMap::features(uint32 langname/*0 means default*/) const
 {
-    if (langname)
+    if (langname && m_langIndex)
     {
-        // the number of languages in a font is usually small e.g. 8 in Doulos
-        // so this loop is not very expensive
-        for (uint16 i = 0; i < m_numLanguages; i++)
-        {
-            if (m_langFeats[i].m_lang == langname)
-                return new Features(*m_langFeats[i].m_pFeatures);
-        }
+        const LangIndex * const it = static_cast<const LangIndex *>(
+            bsearch(&langname, m_langIndex, m_numIndexed, sizeof(LangIndex), &cmpLangTag<LangIndex>));
+        if (it) return *m_langFeats[it->m_index].m_pFeatures;
     }
-    return new Features (m_FeatureMap.m_defaultFeatures);
+    return m_default ? *m_default : m_FeatureMap.m_defaultFeatures;
+}
+
+
+Features* SillMap::cloneFeatures(uint32 langname/*0 means default*/) const
+{
+    return new Features(features(langname));
 }
 
 
 
 const FeatureRef *FeatureMap::findFeatureRef(uint32 name) const
 {
-    NameAndFeatureRef *it;
-    
-    for (it = m_pNamedFeats; it < m_pNamedFeats + m_numFeats; ++it)
-        if (it->m_name == name)
-            return it->m_pFRef;
-    return NULL;
+    if (!m_pNamedFeats) return NULL;
+
+    const NameAndFeatureRef key(name);
+    const NameAndFeatureRef * const it = static_cast<const NameAndFeatureRef *>(
+        bsearch(&key, m_pNamedFeats, m_numFeats, sizeof(NameAndFeatureRef), &cmpNameAndFeatures));
+    return it ? it->m_pFRef : NULL;
+}
+
+// Readers may still be probing a table that has been outgrown, so every
+//  table is kept until the FeatureSets goes.
+struct FeatureSets::Table
+{
+    Table             * prev;       // outgrown
+    size_t              capacity;   // a power of 2
+    FeatureVal * volatile sets[1];
+};
+
+FeatureSets::~FeatureSets()
+{
+    if (m_table)
+        for (size_t i = 0; i != m_table->capacity; ++i)
+            delete m_table->sets[i];
+    for (Table * t = m_table, * prev; t; t = prev)
+    {
+        prev = t->prev;
+        free(t);
+    }
+}
+
+uint32 FeatureSets::hash(const FeatureVal & feats)
+{
+    uint32 h = 2166136261U;
+    for (FeatureVal::const_iterator v = feats.begin(), e = feats.end(); v != e; ++v)
+        h = (h ^ *v) * 16777619U;
+    return h ^ (h >> 16);
+}
+
+const FeatureVal * FeatureSets::find(const Table * t, const FeatureVal & feats, const uint32 h)
+{
+    if (!t) return NULL;
+    for (size_t i = h & (t->capacity - 1);; i = (i + 1) & (t->capacity - 1))
+    {
+        const FeatureVal * const s = atomic::load(t->sets[i]);
+        if (!s) return NULL;
+        if (s->m_hash == h && s->m_pMap == feats.m_pMap && *s == feats)
+            return s;
+    }
+}
+
+const FeatureVal * FeatureSets::intern(const FeatureVal & feats, bool always)
+{
+    if (feats.m_pSets == this)  return &feats;
+
+    const uint32 h = hash(feats);
+    if (const FeatureVal * const s = find(atomic::load(m_table), feats, h))
+        return s;
+
+    // Another thread may have added feats, or grown the table, since.
+    SpinLock::holder lock(m_lock);
+    if (const FeatureVal * const s = find(m_table, feats, h))
+        return s;
+    if (m_count >= MAX_SETS && !always)     return NULL;
+    if ((!m_table || 2*(m_count + 1) > m_table->capacity) && !grow())  return NULL;
+
+    FeatureVal * const s = new FeatureVal(feats);
+    if (!s) return NULL;
+    s->m_pSets = this;
+    s->m_hash = h;
+
+    Table * const t = m_table;
+    size_t i = h & (t->capacity - 1);
+    while (t->sets[i])  i = (i + 1) & (t->capacity - 1);
+    atomic::compare_exchange(t->sets[i], (FeatureVal *)0, s);
+    ++m_count;
+    return s;
+}
+
+bool FeatureSets::grow()
+{
+    const size_t capacity = m_table ? 2*m_table->capacity : 16;
+    Table * const t = reinterpret_cast<Table *>(grzeroalloc<byte>(sizeof(Table) + (capacity - 1) * sizeof(FeatureVal *)));
+    if (!t)  return false;
+    t->prev = m_table;
+    t->capacity = capacity;
+
+    for (size_t i = 0; m_table && i != m_table->capacity; ++i)
+    {
+        FeatureVal * const s = m_table->sets[i];
+        if (!s) continue;
+        size_t j = s->m_hash & (capacity - 1);
+        while (t->sets[j]) j = (j + 1) & (capacity - 1);
+        t->sets[j] = s;
+    }
+    atomic::compare_exchange(m_table, t->prev, t);
+    return true;
 }
 
 bool FeatureRef::applyValToFeature(uint32 val, Features & pDest) const
@@ -30,11 +30,21 @@ of the License or (at your option) any later version.
 
 #ifndef GRAPHITE2_NFILEFACE
 
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#define GRAPHITE2_MAPFILE
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define GRAPHITE2_MAPFILE
+#endif
+
 using namespace graphite2;
 
-FileFace::FileFace(const char *filename)
+FileFace::FileFace(const char *filename, bool map)
 : _file(fopen(filename, "rb")),
   _file_len(0),
+  _map(NULL),
   _header_tbl(NULL),
   _table_dir(NULL)
 {
@@ -46,6 +56,23 @@ FileFace::FileFace(const char *filename)
 
     size_t tbl_offset, tbl_len;
 
+    // Map the file if asked to, in which case the header and table directory
+    //  are read in place, otherwise fall back to reading them in.
+    if (map && (_map = map_file(_file, _file_len)) != NULL)
+    {
+        fclose(_file);
+        _file = NULL;
+
+        if (!TtfUtil::GetHeaderInfo(tbl_offset, tbl_len)
+            || tbl_len > _file_len) return;
+        if (!TtfUtil::CheckHeader(_map)) return;
+        if (!TtfUtil::GetTableDirInfo(_map, tbl_offset, tbl_len)
+            || tbl_offset > _file_len || tbl_len > _file_len - tbl_offset) return;
+        _header_tbl = (TtfUtil::Sfnt::OffsetSubTable*)(_map);
+        _table_dir = (TtfUtil::Sfnt::OffsetSubTable::Entry*)(_map + tbl_offset);
+        return;
+    }
+
     // Get the header.
     if (!TtfUtil::GetHeaderInfo(tbl_offset, tbl_len)) return;
     if (fseek(_file, tbl_offset, SEEK_SET)) return;
@@ -70,13 +97,50 @@ FileFace::FileFace(const char *filename)
 
 FileFace::~FileFace()
 {
-    free(_table_dir);
-    free(_header_tbl);
+    if (_map)
+        unmap_file(_map, _file_len);
+    else
+    {
+        free(_table_dir);
+        free(_header_tbl);
+    }
     if (_file)
         fclose(_file);
 }
 
 
+// Returns a read-only view of the first len bytes of file, or NULL if the
+//  file cannot be mapped.
+const byte * FileFace::map_file(FILE * file, size_t len)
+{
+    if (!file || len == 0) return NULL;
+#if defined(_WIN32)
+    HANDLE h = HANDLE(_get_osfhandle(_fileno(file)));
+    if (h == INVALID_HANDLE_VALUE) return NULL;
+    HANDLE mapping = CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return NULL;
+    // The view holds its own reference to the mapping object.
+    const byte * const view = static_cast<const byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, len));
+    CloseHandle(mapping);
+    return view;
+#elif defined(GRAPHITE2_MAPFILE)
+    void * const view = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(file), 0);
+    return view == MAP_FAILED ? NULL : static_cast<const byte *>(view);
+#else
+    return NULL;
+#endif
+}
+
+void FileFace::unmap_file(const byte * map GR_MAYBE_UNUSED, size_t len GR_MAYBE_UNUSED)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(map);
+#elif defined(GRAPHITE2_MAPFILE)
+    munmap(const_cast<byte *>(map), len);
+#endif
+}
+
+
 const void *FileFace::get_table_fn(const void* appFaceHandle, unsigned int name, size_t *len)
 {
     if (appFaceHandle == 0)     return 0;
@@ -87,8 +151,17 @@ const void *FileFace::get_table_fn(const void* appFaceHandle, unsigned int name,
     if (!TtfUtil::GetTableInfo(name, file_face._header_tbl, file_face._table_dir, tbl_offset, tbl_len))
         return 0;
 
-    if (tbl_offset > file_face._file_len || tbl_len > file_face._file_len - tbl_offset
-            || fseek(file_face._file, tbl_offset, SEEK_SET) != 0)
+    if (tbl_offset > file_face._file_len || tbl_len > file_face._file_len - tbl_offset)
+        return 0;
+
+    // Mapped files hand out the table in place.
+    if (file_face._map)
+    {
+        if (len) *len = tbl_len;
+        return file_face._map + tbl_offset;
+    }
+
+    if (fseek(file_face._file, tbl_offset, SEEK_SET) != 0)
         return 0;
 
     tbl = malloc(tbl_len);
@@ -105,8 +178,11 @@ const void *FileFace::get_table_fn(const void* appFaceHandle, unsigned int name,
 void FileFace::rel_table_fn(const void* appFaceHandle, const void *table_buffer)
 {
     if (appFaceHandle == 0)     return;
+    const FileFace & file_face = *static_cast<const FileFace *>(appFaceHandle);
 
-    free(const_cast<void *>(table_buffer));
+    // Tables from a mapped file are views onto the mapping and owned by it.
+    if (!file_face._map)
+        free(const_cast<void *>(table_buffer));
 }
 
 const gr_face_ops FileFace::ops = { sizeof FileFace::ops, &FileFace::get_table_fn, &FileFace::rel_table_fn };
@@ -42,19 +42,56 @@ Font::Font(float ppm, const Face & f, const void * appFontHandle, const gr_font_
     else
         m_ops.glyph_advance_x = &Face::default_glyph_advance;
 
-    size_t nGlyphs = f.glyphs().numGlyphs();
-    m_advances = gralloc<float>(nGlyphs);
-    if (m_advances)
-    {
-        for (float *advp = m_advances; nGlyphs; --nGlyphs, ++advp)
-            *advp = INVALID_ADVANCE;
-    }
+    // Unhinted advances depend only on the face and the ppm so fonts that
+    // agree on both can share them; hinted ones are private to this font.
+    m_advances = m_hinted ? new AdvanceCache(f.glyphs().numGlyphs(), ppm)
+                          : f.advanceCache(ppm);
 }
 
 
 /*virtual*/ Font::~Font()
 {
-    free(m_advances);
+    if (m_hinted)
+        delete m_advances;
+    else
+        m_face.releaseAdvanceCache(m_advances);
+}
+
+
+AdvanceCache::AdvanceCache(uint16 num_glyphs, float ppm)
+: next(0),
+  refs(0),
+  _pages(grzeroalloc<uint32 * volatile>((num_glyphs + PAGE_SIZE - 1) >> PAGE_BITS)),
+  _num_glyphs(_pages ? num_glyphs : 0),
+  _ppm(ppm)
+{
+}
+
+
+AdvanceCache::~AdvanceCache()
+{
+    if (!_pages) return;
+    for (uint32 * volatile * p = _pages, * volatile * const e = p + ((_num_glyphs + PAGE_SIZE - 1) >> PAGE_BITS); p != e; ++p)
+        free(*p);
+    free(const_cast<uint32 **>(_pages));
+}
+
+
+uint32 * AdvanceCache::page(uint16 gid) const throw()
+{
+    uint32 * volatile & slot = _pages[gid >> PAGE_BITS];
+    uint32 * p = atomic::load(slot);
+    if (p) return p;
+
+    p = gralloc<uint32>(PAGE_SIZE);
+    if (!p) return 0;
+    memset(p, 0xFF, PAGE_SIZE * sizeof(uint32));   // every entry EMPTY
+    if (atomic::compare_exchange(slot, static_cast<uint32 *>(0), p))
+        return p;
+
+    // Another thread published its page first, use that one instead.
+    free(p);
+    return atomic::load(slot);
 }
 
 
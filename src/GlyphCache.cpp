@@ -31,6 +31,9 @@ of the License or (at your option) any later version.
 #include "inc/GlyphCache.h"
 #include "inc/GlyphFace.h"
 #include "inc/Endian.h"
+#include "inc/Snapshot.h"
+#include "inc/Thread.h"
+#include "inc/Atomic.h"
 #include "inc/bits.h"
 
 using namespace graphite2;
@@ -92,7 +95,7 @@ public:
     unsigned short int num_attrs() const throw();
     bool has_boxes() const throw();
 
-    const GlyphFace * read_glyph(unsigned short gid, GlyphFace &, int *numsubs) const throw();
+    const GlyphFace * read_glyph(unsigned short gid, GlyphFace &, int *numsubs, Arena * arena = 0) const throw();
     GlyphBox * read_box(uint16 gid, GlyphBox *curr, const GlyphFace & face) const throw();
 
     CLASS_NEW_DELETE;
@@ -120,11 +123,29 @@ GlyphCache::GlyphCache(const Face & face, const uint32 face_options)
         ? grzeroalloc<const GlyphFace *>(_glyph_loader->num_glyphs()) : 0),
   _boxes(_glyph_loader && _glyph_loader->has_boxes() && _glyph_loader->num_glyphs()
         ? grzeroalloc<GlyphBox *>(_glyph_loader->num_glyphs()) : 0),
+  _dense_attrs(0),
+  _dense_column(0),
+  _num_dense(0),
   _num_glyphs(_glyphs ? _glyph_loader->num_glyphs() : 0),
   _num_attrs(_glyphs ? _glyph_loader->num_attrs() : 0),
   _upem(_glyphs ? _glyph_loader->units_per_em() : 0)
 {
-    if ((face_options & gr_face_preloadGlyphs) && _glyph_loader && _glyphs)
+    if ((face_options & gr_face_preloadGlyphs) && _glyph_loader && _glyphs
+        && (face_options & gr_face_parallelLoad) && parallel::concurrency() > 1)
+    {
+        GlyphFace * const glyphs = new GlyphFace [_num_glyphs];
+        if (!glyphs)
+            return;
+
+        if (!preloadParallel(glyphs))
+        {
+            _glyphs[0] = 0;
+            delete [] glyphs;
+        }
+        delete _glyph_loader;
+        _glyph_loader = 0;
+    }
+    else if ((face_options & gr_face_preloadGlyphs) && _glyph_loader && _glyphs)
     {
         int numsubs = 0;
         GlyphFace * const glyphs = new GlyphFace [_num_glyphs];
@@ -132,14 +153,14 @@ GlyphCache::GlyphCache(const Face & face, const uint32 face_options)
             return;
 
         // The 0 glyph is definately required.
-        _glyphs[0] = _glyph_loader->read_glyph(0, glyphs[0], &numsubs);
+        _glyphs[0] = _glyph_loader->read_glyph(0, glyphs[0], &numsubs, &_glyph_arena);
 
         // glyphs[0] has the same address as the glyphs array just allocated,
         //  thus assigning the &glyphs[0] to _glyphs[0] means _glyphs[0] points
         //  to the entire array.
         const GlyphFace * loaded = _glyphs[0];
         for (uint16 gid = 1; loaded && gid != _num_glyphs; ++gid)
-            _glyphs[gid] = loaded = _glyph_loader->read_glyph(gid, glyphs[gid], &numsubs);
+            _glyphs[gid] = loaded = _glyph_loader->read_glyph(gid, glyphs[gid], &numsubs, &_glyph_arena);
 
         if (!loaded)
         {
@@ -180,64 +201,308 @@ GlyphCache::GlyphCache(const Face & face, const uint32 face_options)
 }
 
 
+// Preloads the glyphs in fixed size runs spread over several threads. The
+//  boxes are placed exactly where a serial preload would have put them, the
+//  start of each run's being known once every glyph's sub-box count is.
+class GlyphCache::Preloader
+{
+public:
+    static const uint16 RUN = 512;
+
+    struct run
+    {
+        int         numsubs;
+        GlyphBox  * boxes;
+        bool        ok;
+    };
+
+    GlyphCache    & cache;
+    GlyphFace     * glyphs;
+    run           * runs;
+
+    static void read_glyphs(void * data, size_t n)
+    {
+        Preloader & p = *static_cast<Preloader *>(data);
+        run & r = p.runs[n];
+        const uint16 gid_end = uint16(min(size_t(p.cache._num_glyphs), (n + 1) * RUN));
+        r.ok = true;
+        for (uint16 gid = uint16(n * RUN); r.ok && gid != gid_end; ++gid)
+            r.ok = (p.cache._glyphs[gid] = p.cache._glyph_loader->read_glyph(gid, p.glyphs[gid], &r.numsubs, &p.cache._glyph_arena)) != 0;
+    }
+
+    static void read_boxes(void * data, size_t n)
+    {
+        Preloader & p = *static_cast<Preloader *>(data);
+        run & r = p.runs[n];
+        const uint16 gid_end = uint16(min(size_t(p.cache._num_glyphs), (n + 1) * RUN));
+        GlyphBox * currbox = r.boxes;
+        for (uint16 gid = uint16(n * RUN); currbox && gid != gid_end; ++gid)
+        {
+            p.cache._boxes[gid] = currbox;
+            currbox = p.cache._glyph_loader->read_box(gid, currbox, *p.cache._glyphs[gid]);
+        }
+        r.ok = currbox != 0;
+    }
+};
+
+
+bool GlyphCache::preloadParallel(GlyphFace * const glyphs)
+{
+    const size_t num_runs = (_num_glyphs + Preloader::RUN - 1) / Preloader::RUN;
+    Preloader p = { *this, glyphs, grzeroalloc<Preloader::run>(num_runs) };
+    if (!p.runs) return false;
+
+    parallel::run(num_runs, &Preloader::read_glyphs, &p);
+
+    int numsubs = 0;
+    bool loaded = true;
+    for (Preloader::run * r = p.runs, * const re = r + num_runs; r != re; ++r)
+    {
+        loaded &= r->ok;
+        numsubs += r->numsubs;
+    }
+
+    if (loaded && numsubs > 0 && _boxes)
+    {
+        GlyphBox * boxes = (GlyphBox *)gralloc<char>(_num_glyphs * sizeof(GlyphBox) + numsubs * 8 * sizeof(float));
+        if (boxes)
+        {
+            char * currbox = reinterpret_cast<char *>(boxes);
+            for (Preloader::run * r = p.runs, * const re = r + num_runs; r != re; ++r)
+            {
+                r->boxes = reinterpret_cast<GlyphBox *>(currbox);
+                currbox += Preloader::RUN * sizeof(GlyphBox) + r->numsubs * 8 * sizeof(float);
+            }
+            parallel::run(num_runs, &Preloader::read_boxes, &p);
+        }
+
+        bool boxed = boxes != 0;
+        for (Preloader::run * r = p.runs, * const re = r + num_runs; r != re; ++r)
+            boxed &= r->ok;
+        if (!boxed)
+        {
+            free(boxes);
+            _boxes[0] = 0;
+        }
+    }
+
+    free(p.runs);
+    return loaded;
+}
+
+
 GlyphCache::~GlyphCache()
 {
     if (_glyphs)
     {
         if (_glyph_loader)
-        {
-            const GlyphFace *  * g = _glyphs;
-            for(unsigned short n = _num_glyphs; n; --n, ++g)
-                delete *g;
-        }
+            releaseLoaded();
         else
             delete [] _glyphs[0];
         free(_glyphs);
     }
     if (_boxes)
     {
-        if (_glyph_loader)
-        {
-            GlyphBox *  * g = _boxes;
-            for (uint16 n = _num_glyphs; n; --n, ++g)
-                free(*g);
-        }
-        else
+        if (!_glyph_loader)
             free(_boxes[0]);
         free(_boxes);
     }
+    free(_dense_attrs);
+    free(_dense_column);
     delete _glyph_loader;
 }
 
+// Glyphs loaded on demand, their attributes and their boxes all live in the
+//  arena, only the glyphs need their destructors run.
+void GlyphCache::releaseLoaded()
+{
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+    {
+        if (_glyphs[gid])
+        {
+            _glyphs[gid]->~GlyphFace();
+            _glyphs[gid] = 0;
+        }
+        if (_boxes)
+            _boxes[gid] = 0;
+    }
+}
+
 const GlyphFace *GlyphCache::glyph(unsigned short glyphid) const      //result may be changed by subsequent call with a different glyphid
 { 
     if (glyphid >= numGlyphs())
         return _glyphs[0];
-    const GlyphFace * & p = _glyphs[glyphid];
+    const GlyphFace * p = atomic::load(_glyphs[glyphid]);
     if (p == 0 && _glyph_loader)
     {
+        // Other threads may be loading the same glyph. The first to publish
+        //  it wins and the rest throw their copies away. The box goes first so
+        //  that anyone who can see the glyph can see its box.
         int numsubs = 0;
-        GlyphFace * g = new GlyphFace();
-        if (g)  p = _glyph_loader->read_glyph(glyphid, *g, &numsubs);
-        if (!p)
+        void * const mem = _glyph_arena.allocate(sizeof(GlyphFace));
+        GlyphFace * const g = mem ? new (mem) GlyphFace() : 0;
+        if (!g || !_glyph_loader->read_glyph(glyphid, *g, &numsubs, &_glyph_arena))
         {
-            delete g;
+            if (g) g->~GlyphFace();
             return *_glyphs;
         }
         if (_boxes)
         {
-            _boxes[glyphid] = (GlyphBox *)gralloc<char>(sizeof(GlyphBox) + 8 * numsubs * sizeof(float));
-            if (!_glyph_loader->read_box(glyphid, _boxes[glyphid], *_glyphs[glyphid]))
-            {
-                free(_boxes[glyphid]);
-                _boxes[glyphid] = 0;
-            }
+            // A box that fails to read or loses the race is left in the arena.
+            GlyphBox * const b = (GlyphBox *)_glyph_arena.allocate(sizeof(GlyphBox) + 8 * numsubs * sizeof(float));
+            if (b && _glyph_loader->read_box(glyphid, b, *g))
+                atomic::compare_exchange(_boxes[glyphid], (GlyphBox *)0, b);
         }
+        if (_dense_column)
+            denseRow(glyphid, *g);
+        if (atomic::compare_exchange(_glyphs[glyphid], (const GlyphFace *)0, (const GlyphFace *)g))
+            return g;
+        g->~GlyphFace();
+        p = atomic::load(_glyphs[glyphid]);
     }
     return p;
 }
 
 
+// Copies the given attributes of every glyph out of its sparse array into a
+//  column per attribute, so reading one is a single indexed load. Glyphs
+//  loaded on demand fill their row as they load, before they are published.
+void GlyphCache::denseAttrs(const uint16 * attrs, size_t n)
+{
+    if (!_glyphs || _dense_column) return;
+
+    uint8 * const column = gralloc<uint8>(_num_attrs);
+    if (!column) return;
+    memset(column, NO_COLUMN, _num_attrs);
+    uint8 num_columns = 0;
+    for (const uint16 * a = attrs, * const ae = a + n; a != ae && num_columns != MAX_DENSE_ATTRS; ++a)
+    {
+        if (*a < _num_attrs && column[*a] == NO_COLUMN)
+        {
+            _dense_keys[num_columns] = *a;
+            column[*a] = num_columns++;
+        }
+    }
+
+    uint16 * const values = num_columns ? gralloc<uint16>(size_t(num_columns) * _num_glyphs) : 0;
+    if (!values)
+    {
+        free(column);
+        return;
+    }
+    _dense_attrs = values;
+    _num_dense = num_columns;
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+        if (_glyphs[gid])
+            denseRow(gid, *_glyphs[gid]);
+    _dense_column = column;
+}
+
+// Threads loading the same glyph at once all write the same values.
+void GlyphCache::denseRow(unsigned short glyphid, const GlyphFace & g) const throw()
+{
+    uint16 row[MAX_DENSE_ATTRS];
+    g.attrs().get_many(_dense_keys, row, _num_dense);
+    for (uint8 c = 0; c != _num_dense; ++c)
+        atomic::store(_dense_attrs[size_t(c) * _num_glyphs + glyphid], row[c]);
+}
+
+
+void GlyphCache::writeSnapshot(SnapshotWriter & w) const
+{
+    w.write(_num_glyphs);
+    w.write(_num_attrs);
+    w.write(_upem);
+
+    // Glyphs not yet loaded on demand are loaded here.
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+        glyph(gid)->writeSnapshot(w);
+
+    // Boxes are only kept if every glyph has one, as in a preloaded cache.
+    uint32 boxes_sz = 0;
+    for (uint16 gid = 0; _boxes && gid != _num_glyphs; ++gid)
+    {
+        if (!_boxes[gid]) { boxes_sz = 0; break; }
+        boxes_sz += sizeof(GlyphBox) + 2 * _boxes[gid]->num() * sizeof(Rect);
+    }
+    w.write(boxes_sz);
+
+    for (uint16 gid = 0; boxes_sz && gid != _num_glyphs; ++gid)
+    {
+        const GlyphBox & b = *_boxes[gid];
+        w.write(b.num());
+        w.write(b.bitmap());
+        w.write(b.slant());
+        w.write(b.subs(), 2 * b.num() * sizeof(Rect));
+    }
+}
+
+// Replaces the on demand loader with the fully loaded glyphs from a snapshot,
+//  laid out as they would be if the face had been preloaded.
+bool GlyphCache::readSnapshot(SnapshotReader & r)
+{
+    uint16 num_glyphs = 0, num_attrs = 0, upem = 0;
+    if (!r.read(num_glyphs) || !r.read(num_attrs) || !r.read(upem)
+            || !_glyph_loader || !_glyphs
+            || num_glyphs != _num_glyphs || num_attrs != _num_attrs || upem != _upem)
+        return r.fail();
+
+    GlyphFace * const glyphs = new GlyphFace [_num_glyphs];
+    if (!glyphs) return r.fail();
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+    {
+        if (!glyphs[gid].readSnapshot(r))
+        {
+            delete [] glyphs;
+            return false;
+        }
+    }
+
+    // Anything already loaded on demand, glyph 0 at least, is replaced.
+    releaseLoaded();
+
+    uint32 boxes_sz = 0;
+    char * boxes = 0;
+    if (!r.read(boxes_sz) || (boxes_sz && !_boxes)
+            || (boxes_sz && !(boxes = gralloc<char>(boxes_sz))))
+    {
+        delete [] glyphs;
+        return r.fail();
+    }
+
+    for (uint32 used = 0, gid = 0; boxes && gid != _num_glyphs; ++gid)
+    {
+        uint8   num = 0;
+        uint16  bitmap = 0;
+        Rect    slant;
+        if (!r.read(num) || !r.read(bitmap) || !r.read(slant)
+                || sizeof(GlyphBox) + 2 * num * sizeof(Rect) > boxes_sz - used)
+        {
+            r.fail();
+            break;
+        }
+        GlyphBox * const b = ::new (boxes + used) GlyphBox(num, bitmap, &slant);
+        if (num) r.read(&b->subVal(0, 0), 2 * num * sizeof(Rect));
+        used += sizeof(GlyphBox) + 2 * num * sizeof(Rect);
+        _boxes[gid] = b;
+        if (gid == _num_glyphs - 1U && used != boxes_sz) r.fail();
+    }
+
+    if (!r)
+    {
+        if (boxes) memset(_boxes, 0, _num_glyphs * sizeof(GlyphBox *));
+        free(boxes);
+        delete [] glyphs;
+        return false;
+    }
+
+    for (uint16 gid = 0; gid != _num_glyphs; ++gid)
+        _glyphs[gid] = glyphs + gid;
+    delete _glyph_loader;
+    _glyph_loader = 0;
+    return true;
+}
+
 
 GlyphCache::Loader::Loader(const Face & face, const bool dumb_font)
 : _head(face, Tag::head),
@@ -344,7 +609,7 @@ bool GlyphCache::Loader::has_boxes () const throw()
     return _has_boxes;
 }
 
-const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFace & glyph, int *numsubs) const throw()
+const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFace & glyph, int *numsubs, Arena * arena) const throw()
 {
     Rect        bbox;
     Position    advance;
@@ -416,7 +681,7 @@ const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFa
             if (gloce - glocs < 2*sizeof(byte)+sizeof(uint16)
                 || gloce - glocs > _num_attrs*(2*sizeof(byte)+sizeof(uint16)))
                     return 0;
-            new (&glyph) GlyphFace(bbox, advance, glat_iterator(m_pGlat + glocs), glat_iterator(m_pGlat + gloce));
+            new (&glyph) GlyphFace(bbox, advance, glat_iterator(m_pGlat + glocs), glat_iterator(m_pGlat + gloce), arena);
         }
         else
         {
@@ -424,7 +689,7 @@ const GlyphFace * GlyphCache::Loader::read_glyph(unsigned short glyphid, GlyphFa
                 || gloce - glocs > _num_attrs*3*sizeof(uint16)
                 || glocs > m_pGlat.size() - 2*sizeof(uint16))
                     return 0;
-            new (&glyph) GlyphFace(bbox, advance, glat2_iterator(m_pGlat + glocs), glat2_iterator(m_pGlat + gloce));
+            new (&glyph) GlyphFace(bbox, advance, glat2_iterator(m_pGlat + glocs), glat2_iterator(m_pGlat + gloce), arena);
         }
         if (!glyph.attrs() || glyph.attrs().capacity() > _num_attrs)
             return 0;
@@ -25,6 +25,7 @@ License, as published by the Free Software Foundation, either version 2
 of the License or (at your option) any later version.
 */
 #include "inc/GlyphFace.h"
+#include "inc/Snapshot.h"
 
 
 using namespace graphite2;
@@ -46,3 +47,15 @@ int32 GlyphFace::getMetric(uint8 metric) const
         default : return 0;
     }
 }
+
+void GlyphFace::writeSnapshot(SnapshotWriter & w) const throw()
+{
+    w.write(m_bbox);
+    w.write(m_advance);
+    m_attrs.writeSnapshot(w);
+}
+
+bool GlyphFace::readSnapshot(SnapshotReader & r) throw()
+{
+    return r.read(m_bbox) && r.read(m_advance) && m_attrs.readSnapshot(r);
+}
@@ -31,6 +31,7 @@ of the License or (at your option) any later version.
 #include "inc/CharInfo.h"
 #include "inc/Slot.h"
 #include "inc/Main.h"
+#include "inc/Rule.h"
 #include <cmath>
 
 using namespace graphite2;
@@ -205,7 +206,10 @@ float Segment::justify(Slot *pSlot, const Font *font, float width, GR_MAYBE_UNUS
 #endif
 
     if (m_silf->justificationPass() != m_silf->positionPass() && (width >= 0.f || (silf()->flags() & 1)))
-        m_silf->runGraphite(this, m_silf->justificationPass(), m_silf->positionPass());
+    {
+        VMScratch scratch(m_face->logger());
+        m_silf->runGraphite(this, scratch, m_silf->justificationPass(), m_silf->positionPass());
+    }
 
 #if !defined GRAPHITE2_NTRACING
     if (dbgout)
@@ -0,0 +1,104 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include <cstddef>
+#include "inc/Endian.h"
+#include "inc/MemoryFace.h"
+#include "inc/TtfTypes.h"
+
+using namespace graphite2;
+
+MemoryFace::MemoryFace(const void * data, size_t len)
+: _data(static_cast<const byte *>(data)),
+  _len(len),
+  _index(NULL),
+  _num_tables(0)
+{
+    typedef TtfUtil::Sfnt::OffsetSubTable   header;
+    const size_t dir_offset = offsetof(header, table_directory);
+
+    if (!_data || _len < dir_offset
+        || be::peek<uint32>(_data) != header::TrueTypeWin) return;
+    const uint16 num_tables = be::peek<uint16>(_data + offsetof(header, num_tables));
+    if (num_tables == 0
+        || num_tables > (_len - dir_offset) / sizeof(header::Entry)) return;
+
+    _index = gralloc<entry>(num_tables);
+    if (!_index) return;
+
+    // Copy out the tables that lie within the font, keeping them sorted by
+    //  tag. Directories are meant to be sorted already so this is cheap.
+    const byte * p = _data + dir_offset;
+    for (uint16 n = num_tables; n; --n)
+    {
+        entry e;
+        e.tag    = be::read<uint32>(p);
+        be::skip<uint32>(p);        // checksum
+        e.offset = be::read<uint32>(p);
+        e.length = be::read<uint32>(p);
+        if (e.offset > _len || e.length > _len - e.offset) continue;
+
+        entry * i = _index + _num_tables++;
+        for (; i != _index && i[-1].tag > e.tag; --i)
+            *i = i[-1];
+        *i = e;
+    }
+}
+
+MemoryFace::~MemoryFace()
+{
+    free(_index);
+}
+
+
+const MemoryFace::entry * MemoryFace::find(uint32 tag) const throw()
+{
+    const entry * lo = _index,
+                * hi = _index + _num_tables;
+    while (lo != hi)
+    {
+        const entry * const mid = lo + (hi - lo)/2;
+        if (mid->tag < tag)     lo = mid + 1;
+        else                    hi = mid;
+    }
+    return lo != _index + _num_tables && lo->tag == tag ? lo : 0;
+}
+
+
+const void *MemoryFace::get_table_fn(const void* appFaceHandle, unsigned int name, size_t *len)
+{
+    if (appFaceHandle == 0)     return 0;
+    const MemoryFace & mem_face = *static_cast<const MemoryFace *>(appFaceHandle);
+
+    const entry * const e = mem_face.find(name);
+    if (!e) return 0;
+
+    if (len) *len = e->length;
+    return mem_face._data + e->offset;
+}
+
+// Tables are views onto the application's memory so there is nothing to release.
+const gr_face_ops MemoryFace::ops = { sizeof MemoryFace::ops, &MemoryFace::get_table_fn, NULL };
@@ -32,10 +32,48 @@ of the License or (at your option) any later version.
 
 using namespace graphite2;
 
+namespace
+{
+    struct Locale
+    {
+        const char * m_name;
+        size_t m_length;
+    };
+
+    // Compares a big endian UTF-16 string with a locale string of bytes.
+    int cmpTag(const uint8 * a, size_t a_len, const uint8 * b, size_t b_len, bool b_wide)
+    {
+        for (size_t i = 0; i != a_len && i != b_len; ++i)
+        {
+            const uint16 ac = be::peek<uint16>(a + 2*i),
+                         bc = b_wide ? be::peek<uint16>(b + 2*i) : b[i];
+            if (ac != bc)   return ac < bc ? -1 : 1;
+        }
+        return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+    }
+
+    template <typename T>
+    int cmpLangTags(const void * ap, const void * bp)
+    {
+        const T & a = *static_cast<const T *>(ap),
+                & b = *static_cast<const T *>(bp);
+        const int r = cmpTag(a.m_name, a.m_length, b.m_name, b.m_length, true);
+        return r ? r : (a.m_index < b.m_index ? -1 : (a.m_index > b.m_index ? 1 : 0));
+    }
+
+    template <typename T>
+    int cmpLocaleLangTag(const void * kp, const void * ep)
+    {
+        const Locale & k = *static_cast<const Locale *>(kp);
+        const T & e = *static_cast<const T *>(ep);
+        return -cmpTag(e.m_name, e.m_length, reinterpret_cast<const uint8 *>(k.m_name), k.m_length, false);
+    }
+}
+
 NameTable::NameTable(const void* data, size_t length, uint16 platformId, uint16 encodingID)
  : m_platformId(0), m_encodingId(0), m_languageCount(0),
    m_platformOffset(0), m_platformLastRecord(0), m_nameDataLength(0),
-   m_table(0), m_nameData(NULL)
+   m_table(0), m_nameData(NULL), m_langTags(NULL), m_numLangTags(0)
 {
     void *pdata = gralloc<byte>(length);
     if (!pdata) return;
@@ -52,6 +90,7 @@ NameTable::NameTable(const void* data, size_t length, uint16 platformId, uint16
             m_nameData = reinterpret_cast<const uint8*>(pdata) + offset;
             setPlatformEncoding(platformId, encodingID);
             m_nameDataLength = length - offset;
+            indexLangTags();
             return;
         }
     }
@@ -213,43 +252,64 @@ void* NameTable::getName(uint16& languageId, uint16 nameId, gr_encform enc, uint
     return NULL;
 }
 
+void NameTable::indexLangTags()
+{
+    if (be::swap<uint16>(m_table->format) != 1) return;
+
+    const uint8 * pLangEntries = reinterpret_cast<const uint8*>(m_table) +
+        sizeof(TtfUtil::Sfnt::FontNames)
+        + sizeof(TtfUtil::Sfnt::NameRecord) * ( be::swap<uint16>(m_table->count) - 1);
+    if (pLangEntries + sizeof(uint16) > m_nameData) return;
+    const uint16 numLangEntries = be::read<uint16>(pLangEntries);
+    const TtfUtil::Sfnt::LangTagRecord * langTag =
+        reinterpret_cast<const TtfUtil::Sfnt::LangTagRecord*>(pLangEntries);
+    if (numLangEntries == 0
+        || pLangEntries + numLangEntries * sizeof(TtfUtil::Sfnt::LangTagRecord) > m_nameData)
+        return;
+
+    m_langTags = gralloc<LangTag>(numLangEntries);
+    if (!m_langTags) return;
+
+    // Only tags in the name data and wholly ASCII can match a locale.
+    for (uint16 i = 0; i < numLangEntries; i++)
+    {
+        const uint16 offset = be::swap<uint16>(langTag[i].offset),
+                     length = be::swap<uint16>(langTag[i].length);
+        if (offset + length > m_nameDataLength) continue;
+
+        LangTag & t = m_langTags[m_numLangTags];
+        t.m_name = m_nameData + offset;
+        t.m_length = length / 2;
+        t.m_index = i;
+        uint16 j = 0;
+        while (j != t.m_length && be::peek<uint16>(t.m_name + 2*j) <= 0x7F) ++j;
+        if (j == t.m_length && 2 * t.m_length == length)
+            ++m_numLangTags;
+    }
+
+    // Keep the first record of any repeated tag.
+    qsort(m_langTags, m_numLangTags, sizeof(LangTag), &cmpLangTags<LangTag>);
+    uint16 n = 0;
+    for (uint16 i = 0; i < m_numLangTags; i++)
+    {
+        if (n && !cmpTag(m_langTags[n-1].m_name, m_langTags[n-1].m_length,
+                         m_langTags[i].m_name, m_langTags[i].m_length, true))
+            continue;
+        m_langTags[n++] = m_langTags[i];
+    }
+    m_numLangTags = n;
+}
+
 uint16 NameTable::getLanguageId(const char * bcp47Locale)
 {
-    size_t localeLength = strlen(bcp47Locale);
-    uint16 localeId = m_locale2Lang.getMsId(bcp47Locale);
-    if (m_table && (be::swap<uint16>(m_table->format) == 1))
-    {
-        const uint8 * pLangEntries = reinterpret_cast<const uint8*>(m_table) +
-            sizeof(TtfUtil::Sfnt::FontNames)
-            + sizeof(TtfUtil::Sfnt::NameRecord) * ( be::swap<uint16>(m_table->count) - 1);
-        uint16 numLangEntries = be::read<uint16>(pLangEntries);
-        const TtfUtil::Sfnt::LangTagRecord * langTag =
-            reinterpret_cast<const TtfUtil::Sfnt::LangTagRecord*>(pLangEntries);
-        if (pLangEntries + numLangEntries * sizeof(TtfUtil::Sfnt::LangTagRecord) <= m_nameData)
-        {
-            for (uint16 i = 0; i < numLangEntries; i++)
-            {
-                uint16 offset = be::swap<uint16>(langTag[i].offset);
-                uint16 length = be::swap<uint16>(langTag[i].length);
-                if ((offset + length <= m_nameDataLength) && (length == 2 * localeLength))
-                {
-                    const uint8* pName = m_nameData + offset;
-                    bool match = true;
-                    for (size_t j = 0; j < localeLength; j++)
-                    {
-                        uint16 code = be::read<uint16>(pName);
-                        if ((code > 0x7F) || (code != bcp47Locale[j]))
-                        {
-                            match = false;
-                            break;
-                        }
-                    }
-                    if (match)
-                        return 0x8000 + i;
-                }
-            }
-        }
+    if (m_numLangTags)
+    {
+        const Locale key = { bcp47Locale, strlen(bcp47Locale) };
+        const LangTag * const t = static_cast<const LangTag *>(
+            bsearch(&key, m_langTags, m_numLangTags, sizeof(LangTag), &cmpLocaleLangTag<LangTag>));
+        if (t)
+            return 0x8000 + t->m_index;
     }
-    return localeId;
+    return m_locale2Lang.getMsId(bcp47Locale);
 }
 
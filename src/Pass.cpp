@@ -37,6 +37,9 @@ of the License or (at your option) any later version.
 #include "inc/Rule.h"
 #include "inc/Error.h"
 #include "inc/Collider.h"
+#include "inc/Snapshot.h"
+#include "inc/Atomic.h"
+#include "inc/Thread.h"
 
 using namespace graphite2;
 using vm::Machine;
@@ -50,6 +53,37 @@ enum KernCollison
     reserved   = 3
 };
 
+enum PassStatus
+{
+    PASS_PENDING  = 0,
+    PASS_READY    = 1,
+    PASS_FAILED   = 2,
+    PASS_DECODING = 3
+};
+
+// The parts of a pass readPass located and checked but has yet to decode.
+struct Pass::Source
+{
+    const byte   * pcCode,
+                 * ranges,
+                 * rule_map,
+                 * precontext,
+                 * start_states,
+                 * states,
+                 * o_rule_map,
+                 * rcCode,
+                 * aCode;
+    const uint16 * sort_keys,
+                 * o_constraint,
+                 * o_actions;
+    size_t         pass_constraint_len,
+                   numRanges,
+                   numEntries;
+    passtype       pt;
+
+    CLASS_NEW_DELETE;
+};
+
 Pass::Pass()
 : m_silf(0),
   m_cols(0),
@@ -73,7 +107,9 @@ Pass::Pass()
   m_minPreCtxt(0),
   m_maxPreCtxt(0),
   m_colThreshold(0),
-  m_isReverseDir(false)
+  m_isReverseDir(false),
+  m_source(0),
+  m_status(PASS_PENDING)
 {
 }
 
@@ -88,10 +124,11 @@ Pass::~Pass()
     if (m_rules) delete [] m_rules;
     if (m_codes) delete [] m_codes;
     free(m_progs);
+    delete m_source;
 }
 
 bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t subtable_base,
-        GR_MAYBE_UNUSED Face & face, passtype pt, GR_MAYBE_UNUSED uint32 version, Error &e)
+        GR_MAYBE_UNUSED Face & face, passtype pt, GR_MAYBE_UNUSED uint32 version, Error &e, bool lazy)
 {
     const byte * p              = pass_start,
                * const pass_end = p + pass_length;
@@ -185,27 +222,88 @@ bool Pass::readPass(const byte * const pass_start, size_t pass_length, size_t su
     // We should be at the end or within the pass
     if (e.test(p > pass_end, E_BADPASSLENGTH)) return face.error(e);
 
+    const Source src = { pcCode, ranges, rule_map, precontext, start_states, states, o_rule_map,
+                         rcCode, aCode, sort_keys, o_constraint, o_actions,
+                         pass_constraint_len, numRanges, numEntries, pt };
+    if (lazy)
+    {
+        // The face keeps the table alive, decode() finishes the job on first use.
+        m_source = new Source(src);
+        if (e.test(!m_source, E_OUTOFMEM)) return face.error(e);
+        return true;
+    }
+
+    unsigned int ectxt = face.error_context();
+    if (!readBody(src, face, e, ectxt))
+    {
+        face.error_context(ectxt);
+        return face.error(e);
+    }
+    m_status = PASS_READY;
+    return true;
+}
+
+
+bool Pass::readBody(const Source & src, const Face & face, Error &e, unsigned int & ectxt)
+{
     // Load the pass constraint if there is one.
-    if (pass_constraint_len)
+    if (src.pass_constraint_len)
     {
-        face.error_context(face.error_context() + 1);
-        m_cPConstraint = vm::Machine::Code(true, pcCode, pcCode + pass_constraint_len, 
-                                  precontext[0], be::peek<uint16>(sort_keys), *m_silf, face, PASS_TYPE_UNKNOWN);
+        ++ectxt;
+        m_cPConstraint = vm::Machine::Code(true, src.pcCode, src.pcCode + src.pass_constraint_len, 
+                                  src.precontext[0], be::peek<uint16>(src.sort_keys), *m_silf, face, PASS_TYPE_UNKNOWN);
         if (e.test(!m_cPConstraint, E_OUTOFMEM)
                 || e.test(m_cPConstraint.status() != Code::loaded, m_cPConstraint.status() + E_CODEFAILURE))
-            return face.error(e);
-        face.error_context(face.error_context() - 1);
+            return false;
+        --ectxt;
     }
     if (m_numRules)
     {
-        if (!readRanges(ranges, numRanges, e)) return face.error(e);
-        if (!readRules(rule_map, numEntries,  precontext, sort_keys,
-                   o_constraint, rcCode, o_actions, aCode, face, pt, e)) return false;
+        if (!readRanges(src.ranges, src.numRanges, e)
+            || !readRules(src.rule_map, src.numEntries,  src.precontext, src.sort_keys,
+                   src.o_constraint, src.rcCode, src.o_actions, src.aCode, face, src.pt, e, ectxt))
+            return false;
     }
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _states_cat(face.tele.states);
 #endif
-    return m_numRules ? readStates(start_states, states, o_rule_map, face, e) : true;
+    return m_numRules ? readStates(src.start_states, src.states, src.o_rule_map, face, e, ectxt) : true;
+}
+
+
+// Finish reading a pass readPass was asked to read lazily. This leaves the
+//  face's error state alone so that several passes may be read at once.
+//  Whichever thread claims the pass first decodes it, any other finding it
+//  being decoded waits for that to finish rather than decoding it again.
+bool Pass::readPending(const Face & face, Error &e, unsigned int & ectxt)
+{
+    long status = atomic::load(m_status);
+    if (status == PASS_PENDING && atomic::compare_exchange(m_status, PASS_PENDING, PASS_DECODING))
+    {
+        const bool ok = readBody(*m_source, face, e, ectxt);
+        delete m_source;
+        m_source = 0;
+        atomic::store(m_status, ok ? PASS_READY : PASS_FAILED);
+        return ok;
+    }
+
+    while ((status = atomic::load(m_status)) == PASS_DECODING)
+        parallel::yield();
+    return !e.test(status != PASS_READY, E_CODEFAILURE);
+}
+
+
+// Decode a lazily read pass, once, the first time it is needed. This may be
+//  on any thread shaping with the face, so a failure fails just the segment
+//  being made and is not recorded against the face.
+bool Pass::decode(const Face & face) const
+{
+    const long status = atomic::load(m_status);
+    if (status == PASS_READY || status == PASS_FAILED) return status == PASS_READY;
+
+    Error e;
+    unsigned int ectxt = face.error_context();
+    return const_cast<Pass *>(this)->readPending(face, e, ectxt);
 }
 
 
@@ -213,7 +311,7 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
                      const byte *precontext, const uint16 * sort_key,
                      const uint16 * o_constraint, const byte *rc_data,
                      const uint16 * o_action,     const byte * ac_data,
-                     Face & face, passtype pt, Error &e)
+                     const Face & face, passtype pt, Error &e, unsigned int & ectxt)
 {
     const byte * const ac_data_end = ac_data + be::peek<uint16>(o_action + m_numRules);
     const byte * const rc_data_end = rc_data + be::peek<uint16>(o_constraint + m_numRules);
@@ -239,12 +337,12 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
     m_progs = gralloc<byte>(prog_pool_sz);
     byte * prog_pool_free = m_progs,
          * prog_pool_end  = m_progs + prog_pool_sz;
-    if (e.test(!(m_rules && m_codes && m_progs), E_OUTOFMEM)) return face.error(e);
+    if (e.test(!(m_rules && m_codes && m_progs), E_OUTOFMEM)) return false;
 
     Rule * r = m_rules + m_numRules - 1;
     for (size_t n = m_numRules; r >= m_rules; --n, --r, ac_end = ac_begin, rc_end = rc_begin)
     {
-        face.error_context((face.error_context() & 0xFFFF00) + EC_ARULE + ((n - 1) << 24));
+        ectxt = (ectxt & 0xFFFF00) + EC_ARULE + ((n - 1) << 24);
         r->preContext = *--precontext;
         r->sort       = be::peek<uint16>(--sort_key);
 #ifndef NDEBUG
@@ -267,14 +365,14 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
                 || e.test(r->action->status() != Code::loaded, r->action->status() + E_CODEFAILURE)
                 || e.test(r->constraint->status() != Code::loaded, r->constraint->status() + E_CODEFAILURE)
                 || e.test(!r->constraint->immutable(), E_MUTABLECCODE))
-            return face.error(e);
+            return false;
     }
 
     byte * moved_progs = static_cast<byte *>(realloc(m_progs, prog_pool_free - m_progs));
     if (e.test(!moved_progs, E_OUTOFMEM))
     {
         if (prog_pool_free - m_progs == 0) m_progs = 0;
-        return face.error(e);
+        return false;
     }
 
     if (moved_progs != m_progs)
@@ -287,14 +385,14 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
     }
 
     // Load the rule entries map
-    face.error_context((face.error_context() & 0xFFFF00) + EC_APASS);
+    ectxt = (ectxt & 0xFFFF00) + EC_APASS;
     //TODO: Coverty: 1315804: FORWARD_NULL
     RuleEntry * re = m_ruleMap = gralloc<RuleEntry>(num_entries);
-    if (e.test(!re, E_OUTOFMEM)) return face.error(e);
+    if (e.test(!re, E_OUTOFMEM)) return false;
     for (size_t n = num_entries; n; --n, ++re)
     {
         const ptrdiff_t rn = be::read<uint16>(rule_map);
-        if (e.test(rn >= m_numRules, E_BADRULENUM))  return face.error(e);
+        if (e.test(rn >= m_numRules, E_BADRULENUM))  return false;
         re->rule = m_rules + rn;
     }
 
@@ -304,7 +402,7 @@ bool Pass::readRules(const byte * rule_map, const size_t num_entries,
 static int cmpRuleEntry(const void *a, const void *b) { return (*(RuleEntry *)a < *(RuleEntry *)b ? -1 :
                                                                 (*(RuleEntry *)b < *(RuleEntry *)a ? 1 : 0)); }
 
-bool Pass::readStates(const byte * starts, const byte *states, const byte * o_rule_map, GR_MAYBE_UNUSED Face & face, Error &e)
+bool Pass::readStates(const byte * starts, const byte *states, const byte * o_rule_map, GR_MAYBE_UNUSED const Face & face, Error &e, unsigned int & ectxt)
 {
 #ifdef GRAPHITE2_TELEMETRY
     telemetry::category _states_cat(face.tele.starts);
@@ -319,7 +417,7 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
 #endif
     m_transitions      = gralloc<uint16>(m_numTransition * m_numColumns);
 
-    if (e.test(!m_startStates || !m_states || !m_transitions, E_OUTOFMEM)) return face.error(e);
+    if (e.test(!m_startStates || !m_states || !m_transitions, E_OUTOFMEM)) return false;
     // load start states
     for (uint16 * s = m_startStates,
                 * const s_end = s + m_maxPreCtxt - m_minPreCtxt + 1; s != s_end; ++s)
@@ -327,8 +425,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
         *s = be::read<uint16>(starts);
         if (e.test(*s >= m_numStates, E_BADSTATE))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ASTARTS + ((s - m_startStates) << 24));
-            return face.error(e); // true;
+            ectxt = (ectxt & 0xFFFF00) + EC_ASTARTS + ((s - m_startStates) << 24);
+            return false;
         }
     }
 
@@ -339,8 +437,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
         *t = be::read<uint16>(states);
         if (e.test(*t >= m_numStates, E_BADSTATE))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ATRANS + (((t - m_transitions) / m_numColumns) << 8));
-            return face.error(e);
+            ectxt = (ectxt & 0xFFFF00) + EC_ATRANS + (((t - m_transitions) / m_numColumns) << 8);
+            return false;
         }
     }
 
@@ -354,8 +452,8 @@ bool Pass::readStates(const byte * starts, const byte *states, const byte * o_ru
 
         if (e.test(begin >= rule_map_end || end > rule_map_end || begin > end, E_BADRULEMAPPING))
         {
-            face.error_context((face.error_context() & 0xFFFF00) + EC_ARULEMAP + (n << 24));
-            return face.error(e);
+            ectxt = (ectxt & 0xFFFF00) + EC_ARULEMAP + (n << 24);
+            return false;
         }
         s->rules = begin;
         s->rules_end = (end - begin <= FiniteStateMachine::MAX_RULES)? end :
@@ -391,15 +489,173 @@ bool Pass::readRanges(const byte * ranges, size_t num_ranges, Error &e)
     return true;
 }
 
+namespace {
+    const uint32 NO_RULES = 0xFFFFFFFF;
+}
+
+bool Pass::writeSnapshot(SnapshotWriter & w, const Face & face) const
+{
+    if (!decode(face)) return false;
+
+    w.write(m_numCollRuns);
+    w.write(m_kernColls);
+    w.write(m_iMaxLoop);
+    w.write(m_numGlyphs);
+    w.write(m_numRules);
+    w.write(m_numStates);
+    w.write(m_numTransition);
+    w.write(m_numSuccess);
+    w.write(m_successStart);
+    w.write(m_numColumns);
+    w.write(m_minPreCtxt);
+    w.write(m_maxPreCtxt);
+    w.write(m_colThreshold);
+    w.write(m_isReverseDir);
+    if (!m_cPConstraint.writeSnapshot(w, 0, 0)) return false;
+    if (!m_numRules) return true;
+
+    w.write(m_cols, m_numGlyphs * sizeof(uint16));
+
+    // Rule n's action and constraint are codes 2n and 2n+1.
+    for (const Rule * r = m_rules, * const re = r + m_numRules; r != re; ++r)
+    {
+        if (r->action != m_codes + 2*(r - m_rules) || r->constraint != r->action + 1)
+            return false;
+        w.write(r->sort);
+        w.write(r->preContext);
+    }
+
+    // The code pool is copied as is, then each program converts its
+    //  instructions in the copy.
+    uint32 progs_sz = 0;
+    for (const Code * c = m_codes, * const ce = c + m_numRules*2; c != ce; ++c)
+        progs_sz += uint32(c->programSize());
+    w.write(progs_sz);
+    byte * const progs_image = w.reserve(progs_sz);
+    if (progs_image) memcpy(progs_image, m_progs, progs_sz);
+    for (const Code * c = m_codes, * const ce = c + m_numRules*2; c != ce; ++c)
+        if (!c->writeSnapshot(w, m_progs, progs_image)) return false;
+
+    // Only the rule map entries reachable from a state are kept.
+    uint32 num_entries = 0;
+    for (const State * s = m_states, * const se = s + m_numStates; s != se; ++s)
+        if (s->rules) num_entries = max(num_entries, uint32(s->rules_end - m_ruleMap));
+    w.write(num_entries);
+    for (const RuleEntry * re = m_ruleMap, * const ree = re + num_entries; re != ree; ++re)
+        w.write(uint16(re->rule - m_rules));
+
+    w.write(m_startStates, (m_maxPreCtxt - m_minPreCtxt + 1) * sizeof(uint16));
+    w.write(m_transitions, m_numTransition * m_numColumns * sizeof(uint16));
+    for (const State * s = m_states, * const se = s + m_numStates; s != se; ++s)
+    {
+        w.write(s->rules ? uint32(s->rules - m_ruleMap) : NO_RULES);
+        w.write(s->rules ? uint32(s->rules_end - m_ruleMap) : NO_RULES);
+    }
+    return true;
+}
+
+// The snapshot was made from a pass which passed all of readPass's checks,
+//  only the references into our own arrays are checked here.
+bool Pass::readSnapshot(SnapshotReader & r, Face & face, Error &e)
+{
+    m_status = PASS_READY;      // any failure here discards the whole face.
+    r.read(m_numCollRuns);
+    r.read(m_kernColls);
+    r.read(m_iMaxLoop);
+    r.read(m_numGlyphs);
+    r.read(m_numRules);
+    r.read(m_numStates);
+    r.read(m_numTransition);
+    r.read(m_numSuccess);
+    r.read(m_successStart);
+    r.read(m_numColumns);
+    r.read(m_minPreCtxt);
+    r.read(m_maxPreCtxt);
+    r.read(m_colThreshold);
+    r.read(m_isReverseDir);
+    if (e.test(!r || m_minPreCtxt > m_maxPreCtxt || m_numTransition > m_numStates, E_BADSNAPSHOT)
+            || e.test(!m_cPConstraint.readSnapshot(r, 0, 0), E_BADSNAPSHOT))
+        return face.error(e);
+    if (!m_numRules) return true;
+
+    m_cols = r.read_array<uint16>(m_numGlyphs);
+    if (e.test(!m_cols, E_BADSNAPSHOT)) return face.error(e);
+    for (const uint16 * c = m_cols, * const ce = c + m_numGlyphs; c != ce; ++c)
+        if (e.test(*c >= m_numColumns && *c != 0xFFFF, E_BADSNAPSHOT)) return face.error(e);
+
+    m_rules = new Rule [m_numRules];
+    m_codes = new Code [m_numRules*2];
+    if (e.test(!m_rules || !m_codes, E_OUTOFMEM)) return face.error(e);
+    for (Rule * rule = m_rules, * const re = rule + m_numRules; rule != re; ++rule)
+    {
+        r.read(rule->sort);
+        r.read(rule->preContext);
+        rule->action     = m_codes + 2*(rule - m_rules);
+        rule->constraint = rule->action + 1;
+#ifndef NDEBUG
+        rule->rule_idx   = uint16(rule - m_rules);
+#endif
+    }
+
+    uint32 progs_sz = 0;
+    r.read(progs_sz);
+    if (progs_sz)   m_progs = r.read_array<byte>(progs_sz);
+    if (e.test(!r, E_BADSNAPSHOT)) return face.error(e);
+    for (Code * c = m_codes, * const ce = c + m_numRules*2; c != ce; ++c)
+        if (e.test(!c->readSnapshot(r, m_progs, progs_sz), E_BADSNAPSHOT)) return face.error(e);
+
+    uint32 num_entries = 0;
+    r.read(num_entries);
+    if (e.test(!r || num_entries > r.remaining() / sizeof(uint16), E_BADSNAPSHOT)) return face.error(e);
+    m_ruleMap = gralloc<RuleEntry>(num_entries);
+    if (e.test(num_entries && !m_ruleMap, E_OUTOFMEM)) return face.error(e);
+    for (RuleEntry * re = m_ruleMap, * const ree = re + num_entries; re != ree; ++re)
+    {
+        uint16 rn = 0;
+        r.read(rn);
+        if (e.test(rn >= m_numRules, E_BADSNAPSHOT)) return face.error(e);
+        re->rule = m_rules + rn;
+    }
+
+    m_startStates = r.read_array<uint16>(m_maxPreCtxt - m_minPreCtxt + 1);
+    m_transitions = r.read_array<uint16>(m_numTransition * m_numColumns);
+    m_states      = gralloc<State>(m_numStates);
+    if (e.test(!r || !m_startStates || (m_numStates && !m_states), E_BADSNAPSHOT)) return face.error(e);
+    for (const uint16 * s = m_startStates, * const se = s + m_maxPreCtxt - m_minPreCtxt + 1; s != se; ++s)
+        if (e.test(*s >= m_numStates, E_BADSNAPSHOT)) return face.error(e);
+    for (const uint16 * t = m_transitions, * const te = t + m_numTransition * m_numColumns; t != te; ++t)
+        if (e.test(*t >= m_numStates, E_BADSNAPSHOT)) return face.error(e);
+
+    for (State * s = m_states, * const se = s + m_numStates; s != se; ++s)
+    {
+        uint32 begin = 0, end = 0;
+        r.read(begin);
+        r.read(end);
+        if (begin == NO_RULES && end == NO_RULES)
+        {
+            s->rules = s->rules_end = 0;
+            continue;
+        }
+        if (e.test(!r || begin > end || end > num_entries || end - begin > FiniteStateMachine::MAX_RULES, E_BADSNAPSHOT))
+            return face.error(e);
+        s->rules     = m_ruleMap + begin;
+        s->rules_end = m_ruleMap + end;
+    }
+
+    return !e.test(!r, E_BADSNAPSHOT) || face.error(e);
+}
+
 
 bool Pass::runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse) const
 {
-    Slot *s = m.slotMap().segment.first();
+    if (!decode(*m.slotMap().segment().getFace())) return false;
+
+    Slot *s = m.slotMap().segment().first();
     if (!s || !testPassConstraint(m)) return true;
     if (reverse)
     {
-        m.slotMap().segment.reverseSlots();
-        s = m.slotMap().segment.first();
+        m.slotMap().segment().reverseSlots();
+        s = m.slotMap().segment().first();
     }
     if (m_numRules)
     {
@@ -428,22 +684,22 @@ bool Pass::runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse)
     //TODO: Use enums for flags
     const bool collisions = m_numCollRuns || m_kernColls;
 
-    if (!collisions || !m.slotMap().segment.hasCollisionInfo())
+    if (!collisions || !m.slotMap().segment().hasCollisionInfo())
         return true;
 
     if (m_numCollRuns)
     {
-        if (!(m.slotMap().segment.flags() & Segment::SEG_INITCOLLISIONS))
+        if (!(m.slotMap().segment().flags() & Segment::SEG_INITCOLLISIONS))
         {
-            m.slotMap().segment.positionSlots(0, 0, 0, m.slotMap().dir(), true);
-//            m.slotMap().segment.flags(m.slotMap().segment.flags() | Segment::SEG_INITCOLLISIONS);
+            m.slotMap().segment().positionSlots(0, 0, 0, m.slotMap().dir(), true);
+//            m.slotMap().segment().flags(m.slotMap().segment().flags() | Segment::SEG_INITCOLLISIONS);
         }
-        if (!collisionShift(&m.slotMap().segment, m.slotMap().dir(), fsm.dbgout))
+        if (!collisionShift(&m.slotMap().segment(), m.slotMap().dir(), fsm.dbgout))
             return false;
     }
-    if ((m_kernColls) && !collisionKern(&m.slotMap().segment, m.slotMap().dir(), fsm.dbgout))
+    if ((m_kernColls) && !collisionKern(&m.slotMap().segment(), m.slotMap().dir(), fsm.dbgout))
         return false;
-    if (collisions && !collisionFinish(&m.slotMap().segment, fsm.dbgout))
+    if (collisions && !collisionFinish(&m.slotMap().segment(), fsm.dbgout))
         return false;
     return true;
 }
@@ -485,14 +741,14 @@ Slot * input_slot(const SlotMap &  slots, const int n)
     Slot * s = slots[slots.context() + n];
     if (!s->isCopied())     return s;
 
-    return s->prev() ? s->prev()->next() : (s->next() ? s->next()->prev() : slots.segment.last());
+    return s->prev() ? s->prev()->next() : (s->next() ? s->next()->prev() : slots.segment().last());
 }
 
 inline
 Slot * output_slot(const SlotMap &  slots, const int n)
 {
     Slot * s = slots[slots.context() + n - 1];
-    return s ? s->next() : slots.segment.first();
+    return s ? s->next() : slots.segment().first();
 }
 
 #endif //!defined GRAPHITE2_NTRACING
@@ -526,7 +782,7 @@ void Pass::findNDoRule(Slot * & slot, Machine &m, FiniteStateMachine & fsm) cons
                     dumpRuleEventOutput(fsm, *r->rule, slot);
                     if (r->rule->action->deletes()) fsm.slots.collectGarbage(slot);
                     adjustSlot(adv, slot, fsm.slots);
-                    *fsm.dbgout << "cursor" << objectid(dslot(&fsm.slots.segment, slot))
+                    *fsm.dbgout << "cursor" << objectid(dslot(&fsm.slots.segment(), slot))
                             << json::close; // Close RuelEvent object
 
                     return;
@@ -535,7 +791,7 @@ void Pass::findNDoRule(Slot * & slot, Machine &m, FiniteStateMachine & fsm) cons
                 {
                     *fsm.dbgout << json::close  // close "considered" array
                             << "output" << json::null
-                            << "cursor" << objectid(dslot(&fsm.slots.segment, slot->next()))
+                            << "cursor" << objectid(dslot(&fsm.slots.segment(), slot->next()))
                             << json::close;
                 }
             }
@@ -571,7 +827,7 @@ void Pass::dumpRuleEventConsidered(const FiniteStateMachine & fsm, const RuleEnt
                     << "id" << r->rule - m_rules
                     << "failed" << true
                     << "input" << json::flat << json::object
-                        << "start" << objectid(dslot(&fsm.slots.segment, input_slot(fsm.slots, -r->rule->preContext)))
+                        << "start" << objectid(dslot(&fsm.slots.segment(), input_slot(fsm.slots, -r->rule->preContext)))
                         << "length" << r->rule->sort
                         << json::close  // close "input"
                     << json::close; // close Rule object
@@ -585,24 +841,24 @@ void Pass::dumpRuleEventOutput(const FiniteStateMachine & fsm, const Rule & r, S
                         << "id"     << &r - m_rules
                         << "failed" << false
                         << "input" << json::flat << json::object
-                            << "start" << objectid(dslot(&fsm.slots.segment, input_slot(fsm.slots, 0)))
+                            << "start" << objectid(dslot(&fsm.slots.segment(), input_slot(fsm.slots, 0)))
                             << "length" << r.sort - r.preContext
                             << json::close // close "input"
                         << json::close  // close Rule object
                 << json::close // close considered array
                 << "output" << json::object
                     << "range" << json::flat << json::object
-                        << "start"  << objectid(dslot(&fsm.slots.segment, input_slot(fsm.slots, 0)))
-                        << "end"    << objectid(dslot(&fsm.slots.segment, last_slot))
+                        << "start"  << objectid(dslot(&fsm.slots.segment(), input_slot(fsm.slots, 0)))
+                        << "end"    << objectid(dslot(&fsm.slots.segment(), last_slot))
                     << json::close // close "input"
                     << "slots"  << json::array;
-    const Position rsb_prepos = last_slot ? last_slot->origin() : fsm.slots.segment.advance();
-    fsm.slots.segment.positionSlots(0, 0, 0, fsm.slots.segment.currdir());
+    const Position rsb_prepos = last_slot ? last_slot->origin() : fsm.slots.segment().advance();
+    fsm.slots.segment().positionSlots(0, 0, 0, fsm.slots.segment().currdir());
 
     for(Slot * slot = output_slot(fsm.slots, 0); slot != last_slot; slot = slot->next())
-        *fsm.dbgout     << dslot(&fsm.slots.segment, slot);
+        *fsm.dbgout     << dslot(&fsm.slots.segment(), slot);
     *fsm.dbgout         << json::close  // close "slots"
-                    << "postshift"  << (last_slot ? last_slot->origin() : fsm.slots.segment.advance()) - rsb_prepos
+                    << "postshift"  << (last_slot ? last_slot->origin() : fsm.slots.segment().advance()) - rsb_prepos
                 << json::close;         // close "output" object
 
 }
@@ -617,13 +873,13 @@ bool Pass::testPassConstraint(Machine & m) const
 
     assert(m_cPConstraint.constraint());
 
-    m.slotMap().reset(*m.slotMap().segment.first(), 0);
-    m.slotMap().pushSlot(m.slotMap().segment.first());
+    m.slotMap().reset(*m.slotMap().segment().first(), 0);
+    m.slotMap().pushSlot(m.slotMap().segment().first());
     vm::slotref * map = m.slotMap().begin();
     const uint32 ret = m_cPConstraint.run(m, map);
 
 #if !defined GRAPHITE2_NTRACING
-    json * const dbgout = m.slotMap().segment.getFace()->logger();
+    json * const dbgout = m.slotMap().segment().getFace()->logger();
     if (dbgout)
         *dbgout << "constraint" << (ret && m.status() == Machine::finished);
 #endif
@@ -664,7 +920,7 @@ void SlotMap::collectGarbage(Slot * &aSlot)
         {
             if (slot == aSlot)
                 aSlot = slot->prev() ? slot->prev() : slot->next();
-            segment.freeSlot(slot);
+            segment().freeSlot(slot);
         }
     }
 }
@@ -699,14 +955,14 @@ void Pass::adjustSlot(int delta, Slot * & slot_out, SlotMap & smap) const
     {
         if (smap.highpassed() || slot_out == smap.highwater())
         {
-            slot_out = smap.segment.last();
+            slot_out = smap.segment().last();
             ++delta;
             if (!smap.highwater())
                 smap.highpassed(false);
         }
         else
         {
-            slot_out = smap.segment.first();
+            slot_out = smap.segment().first();
             --delta;
         }
     }
@@ -42,7 +42,7 @@ SegCache::SegCache(const SegCacheStore * store, const Features & feats)
 : m_prefixLength(ePrefixLength),
 //  m_maxCachedSegLength(eMaxSpliceSize),
   m_segmentCount(0),
-  m_features(feats),
+  m_features(&feats),
   m_totalAccessCount(0l), m_totalMisses(0l),
   m_purgeFactor(1.0f / (ePurgeFactor * store->maxSegmentCount()))
 {
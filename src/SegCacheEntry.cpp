@@ -38,7 +38,7 @@ using namespace graphite2;
 
 SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment * seg, size_t charOffset, long long cacheTime)
     : m_glyphLength(0), m_unicode(gralloc<uint16>(length)), m_glyph(NULL),
-    m_attr(NULL), m_justs(NULL),
+    m_extras(NULL), m_justs(NULL),
     m_accessCount(0), m_lastAccess(cacheTime)
 {
     if (m_unicode)
@@ -46,7 +46,8 @@ SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment *
             m_unicode[i] = cmapGlyphs[i];
 
     const size_t    glyphCount = seg->slotCount(),
-                    sizeof_sjust = SlotJustify::size_of(seg->silf()->numJustLevels());
+                    sizeof_sjust = SlotJustify::size_of(seg->silf()->numJustLevels()),
+                    sizeof_extra = SlotExtra::stride(seg->numAttrs());
     if (!glyphCount) return;
     size_t num_justs = 0,
            justs_pos = 0;
@@ -54,15 +55,21 @@ SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment *
     {
         for (const Slot * s = seg->first(); s; s = s->next())
         {
-            if (s->m_justs == 0)    continue;
+            if (!s->isLocalJustify())   continue;
             ++num_justs;
         }
         m_justs = gralloc<byte>(sizeof_sjust * num_justs);
     }
     const Slot * slot = seg->first();
-    m_glyph = new Slot[glyphCount];
-    m_attr = gralloc<int16>(glyphCount * seg->numAttrs());
-    if (!m_glyph || (!m_attr && seg->numAttrs())) return;
+    // Only ever one block, so its links never need an owner to resolve them.
+    byte * const block = gralloc<byte>(Slot::blockSize(glyphCount));
+    m_extras = grzeroalloc<byte>(glyphCount * sizeof_extra);
+    if (!block || !m_extras)
+    {
+        free(block);
+        return;
+    }
+    m_glyph = Slot::makeBlock(block, NULL, 0, glyphCount, m_extras, sizeof_extra);
     m_glyphLength = glyphCount;
     Slot * slotCopy = m_glyph;
     m_glyph->prev(NULL);
@@ -70,16 +77,15 @@ SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment *
     uint16 pos = 0;
     while (slot)
     {
-        slotCopy->userAttrs(m_attr + pos * seg->numAttrs());
-        slotCopy->m_justs = m_justs ? reinterpret_cast<SlotJustify *>(m_justs + justs_pos++ * sizeof_sjust) : 0;
+        slotCopy->m_extra->justs = m_justs && slot->isLocalJustify() ? reinterpret_cast<SlotJustify *>(m_justs + justs_pos++ * sizeof_sjust) : 0;
         slotCopy->set(*slot, -static_cast<int32>(charOffset), seg->numAttrs(), seg->silf()->numJustLevels(), length);
         slotCopy->index(pos);
         if (slot->firstChild())
-            slotCopy->m_child = m_glyph + slot->firstChild()->index();
+            slotCopy->firstChild(m_glyph + slot->firstChild()->index());
         if (slot->attachedTo())
             slotCopy->attachTo(m_glyph + slot->attachedTo()->index());
         if (slot->nextSibling())
-            slotCopy->m_sibling = m_glyph + slot->nextSibling()->index();
+            slotCopy->nextSibling(m_glyph + slot->nextSibling()->index());
         slot = slot->next();
         ++slotCopy;
         ++pos;
@@ -95,13 +101,13 @@ SegCacheEntry::SegCacheEntry(const uint16* cmapGlyphs, size_t length, Segment *
 void SegCacheEntry::clear()
 {
     free(m_unicode);
-    free(m_attr);
+    free(m_extras);
     free(m_justs);
-    delete [] m_glyph;
+    if (m_glyph) free(Slot::blockMemory(m_glyph));
     m_unicode = NULL;
     m_glyph = NULL;
     m_glyphLength = 0;
-    m_attr = NULL;
+    m_extras = NULL;
 }
 
 #endif
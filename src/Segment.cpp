@@ -45,34 +45,67 @@ using namespace graphite2;
 Segment::Segment(unsigned int numchars, const Face* face, uint32 script, int textDir)
 : m_freeSlots(NULL),
   m_freeJustifies(NULL),
-  m_charinfo(new CharInfo[numchars]),
+  m_charinfo(NULL),
   m_collisions(NULL),
-  m_face(face),
-  m_silf(face->chooseSilf(script)),
+  m_face(NULL),
+  m_silf(NULL),
   m_first(NULL),
   m_last(NULL),
-  m_bufSize(numchars + 10),
-  m_numGlyphs(numchars),
-  m_numCharinfo(numchars),
-  m_passBits(m_silf->aPassBits() ? -1 : 0),
+  m_bufSize(0),
+  m_numGlyphs(0),
+  m_numCharinfo(0),
+  m_passBits(0),
   m_defaultOriginal(0),
-  m_dir(textDir),
-  m_flags(((m_silf->flags() & 0x20) != 0) << 1)
+  m_dir(0),
+  m_flags(0),
+  m_hasJustifies(false)
 {
-    freeSlot(newSlot());
-    m_bufSize = log_binary(numchars)+1;
+    reset(numchars, face, script, textDir);
 }
 
 Segment::~Segment()
 {
-    for (SlotRope::iterator i = m_slots.begin(); i != m_slots.end(); ++i)
-        free(*i);
-    for (AttributeRope::iterator i = m_userAttrs.begin(); i != m_userAttrs.end(); ++i)
-        free(*i);
-    for (JustifyRope::iterator i = m_justifies.begin(); i != m_justifies.end(); ++i)
-        free(*i);
-    delete[] m_charinfo;
-    free(m_collisions);
+    releaseFeatures();
+}
+
+bool Segment::reset(unsigned int numchars, const Face* face, uint32 script, int textDir)
+{
+    // Everything the segment allocated is in the arena, so dropping it all
+    //  leaves nothing dangling.
+    m_arena.reset();
+    releaseFeatures();
+    m_advance = Position();
+    m_slotBlocks.clear();
+    m_freeSlots = NULL;
+    m_freeJustifies = NULL;
+    m_collisions = NULL;
+    m_face = face;
+    m_silf = face->chooseSilf(script);
+    m_first = NULL;
+    m_last = NULL;
+    m_bufSize = numchars + 10;
+    m_numGlyphs = numchars;
+    m_numCharinfo = numchars;
+    m_passBits = m_silf->aPassBits() ? -1 : 0;
+    m_defaultOriginal = 0;
+    m_dir = textDir;
+    m_flags = ((m_silf->flags() & 0x20) != 0) << 1;
+    m_hasJustifies = false;
+
+    m_charinfo = static_cast<CharInfo *>(m_arena.allocate(numchars * sizeof(CharInfo)));
+    if (!m_charinfo) return false;
+    for (CharInfo * c = m_charinfo, * const ce = c + numchars; c != ce; ++c)
+        ::new (c) CharInfo();
+
+    Slot * const s = newSlot();
+    if (!s)
+    {
+        m_charinfo = NULL;
+        return false;
+    }
+    freeSlot(s);
+    m_bufSize = log_binary(numchars)+1;
+    return true;
 }
 
 #ifndef GRAPHITE2_NSEGCACHE
@@ -148,8 +181,9 @@ void Segment::appendSlot(int id, int cid, int gid, int iFeats, size_t coffset)
     m_charinfo[id].init(cid);
     m_charinfo[id].feats(iFeats);
     m_charinfo[id].base(coffset);
-    const GlyphFace * theGlyph = m_face->glyphs().glyphSafe(gid);
-    m_charinfo[id].breakWeight(theGlyph ? theGlyph->attrs()[m_silf->aBreak()] : 0);
+    const GlyphCache & glyphs = m_face->glyphs();
+    const GlyphFace * theGlyph = glyphs.glyphSafe(gid);
+    m_charinfo[id].breakWeight(theGlyph ? glyphs.glyphAttr(gid, m_silf->aBreak()) : 0);
     
     aSlot->child(NULL);
     aSlot->setGlyph(this, gid, theGlyph);
@@ -161,8 +195,8 @@ void Segment::appendSlot(int id, int cid, int gid, int iFeats, size_t coffset)
     m_last = aSlot;
     if (!m_first) m_first = aSlot;
     if (theGlyph && m_silf->aPassBits())
-        m_passBits &= theGlyph->attrs()[m_silf->aPassBits()] 
-                    | (m_silf->numPasses() > 16 ? (theGlyph->attrs()[m_silf->aPassBits() + 1] << 16) : 0);
+        m_passBits &= glyphs.glyphAttr(gid, m_silf->aPassBits())
+                    | (m_silf->numPasses() > 16 ? (glyphs.glyphAttr(gid, m_silf->aPassBits() + 1) << 16) : 0);
 }
 
 Slot *Segment::newSlot()
@@ -176,24 +210,20 @@ Slot *Segment::newSlot()
 #if !defined GRAPHITE2_NTRACING
         if (m_face->logger()) ++numUser;
 #endif
-        Slot *newSlots = grzeroalloc<Slot>(m_bufSize);
-        int16 *newAttrs = grzeroalloc<int16>(m_bufSize * numUser);
-        if (!newSlots || !newAttrs)
-        {
-            free(newSlots);
-            free(newAttrs);
+        if (m_slotBlocks.size() == Slot::MAX_BLOCKS)
             return NULL;
-        }
-        for (size_t i = 0; i < m_bufSize; i++)
-        {
-            ::new (newSlots + i) Slot(newAttrs + i * numUser);
+        // Once the text outgrows a block take whole ones, keeping the table short.
+        const size_t n = m_numCharinfo + 10 > Slot::MAX_BLOCK_SLOTS ? size_t(Slot::MAX_BLOCK_SLOTS) : m_bufSize;
+        const size_t extraSize = SlotExtra::stride(numUser);
+        void *block = m_arena.allocate(Slot::blockSize(n));
+        byte *newExtras = static_cast<byte *>(m_arena.allocate(n * extraSize));
+        if (!block || !newExtras) return NULL;
+        memset(newExtras, 0, n * extraSize);
+        Slot * const newSlots = Slot::makeBlock(block, &m_slotBlocks, uint32(m_slotBlocks.size()), n, newExtras, extraSize);
+        m_slotBlocks.push_back(newSlots);
+        for (size_t i = 1; i < n - 1; i++)
             newSlots[i].next(newSlots + i + 1);
-        }
-        newSlots[m_bufSize - 1].next(NULL);
-        newSlots[0].next(NULL);
-        m_slots.push_back(newSlots);
-        m_userAttrs.push_back(newAttrs);
-        m_freeSlots = (m_bufSize > 1)? newSlots + 1 : NULL;
+        m_freeSlots = (n > 1)? newSlots + 1 : NULL;
         return newSlots;
     }
     Slot *res = m_freeSlots;
@@ -219,8 +249,9 @@ void Segment::freeSlot(Slot *aSlot)
             aSlot->firstChild(NULL);
     }
     // reset the slot incase it is reused
-    ::new (aSlot) Slot(aSlot->userAttrs());
-    memset(aSlot->userAttrs(), 0, m_silf->numUser() * sizeof(int16));
+    SlotExtra * const extra = aSlot->extra();
+    ::new (aSlot) Slot(extra, aSlot->m_self);
+    memset(static_cast<void *>(extra), 0, SlotExtra::size_of(m_silf->numUser()));
     // Update generation counter for debug
 #if !defined GRAPHITE2_NTRACING
     if (m_face->logger())
@@ -239,8 +270,9 @@ SlotJustify *Segment::newJustify()
     if (!m_freeJustifies)
     {
         const size_t justSize = SlotJustify::size_of(m_silf->numJustLevels());
-        byte *justs = grzeroalloc<byte>(justSize * m_bufSize);
+        byte *justs = static_cast<byte *>(m_arena.allocate(justSize * m_bufSize));
         if (!justs) return NULL;
+        memset(justs, 0, justSize * m_bufSize);
         for (int i = m_bufSize - 2; i >= 0; --i)
         {
             SlotJustify *p = reinterpret_cast<SlotJustify *>(justs + justSize * i);
@@ -248,7 +280,7 @@ SlotJustify *Segment::newJustify()
             p->next = next;
         }
         m_freeJustifies = (SlotJustify *)justs;
-        m_justifies.push_back(m_freeJustifies);
+        m_hasJustifies = true;
     }
     SlotJustify *res = m_freeJustifies;
     m_freeJustifies = m_freeJustifies->next;
@@ -317,8 +349,8 @@ void Segment::splice(size_t offset, size_t length, Slot * const startSlot,
     {
         slot->set(*srcSlot, offset, m_silf->numUser(), m_silf->numJustLevels(), numChars);
         if (srcSlot->attachedTo())  slot->attachTo(indexmap[srcSlot->attachedTo()->index()]);
-        if (srcSlot->nextSibling()) slot->m_sibling = indexmap[srcSlot->nextSibling()->index()];
-        if (srcSlot->firstChild())  slot->m_child = indexmap[srcSlot->firstChild()->index()];
+        if (srcSlot->nextSibling()) slot->nextSibling(indexmap[srcSlot->nextSibling()->index()]);
+        if (srcSlot->firstChild())  slot->firstChild(indexmap[srcSlot->firstChild()->index()]);
     }
 }
 #endif // GRAPHITE2_NSEGCACHE
@@ -493,13 +525,43 @@ inline void process_utf_data(Segment & seg, const Face & face, const int fid, ut
     const Cmap    & cmap = face.cmap();
     int slotid = 0;
 
+    // Decode a chunk of text at a time and map it all in one call.
+    const size_t CHUNK = 64;
+    uint32  usv[CHUNK];
+    uint16  gid[CHUNK];
+    size_t  offset[CHUNK];
+
     const typename utf_iter::codeunit_type * const base = c;
-    for (; n_chars; --n_chars, ++c, ++slotid)
+    while (n_chars)
     {
-        const uint32 usv = *c;
-        uint16 gid = cmap[usv];
-        if (!gid)   gid = face.findPseudo(usv);
-        seg.appendSlot(slotid, usv, gid, fid, c - base);
+        const size_t n = min(n_chars, CHUNK);
+        for (size_t i = 0; i != n;)
+        {
+            // Runs of code units that are characters on their own need no decoding.
+            const typename utf_iter::codeunit_type * const p = c;
+            const size_t run = c.simple_run(n - i);
+            for (size_t k = 0; k != run; ++k, ++i)
+            {
+                usv[i] = p[k];
+                offset[i] = p + k - base;
+            }
+            if (run)
+            {
+                c = utf_iter(p + run);
+                continue;
+            }
+            usv[i] = *c;
+            offset[i] = c - base;
+            ++c;
+            ++i;
+        }
+        cmap.map(usv, gid, n);
+        for (size_t i = 0; i != n; ++i, ++slotid)
+        {
+            if (!gid[i])    gid[i] = face.findPseudo(usv[i]);
+            seg.appendSlot(slotid, usv[i], gid[i], fid, offset[i]);
+        }
+        n_chars -= n;
     }
 }
 
@@ -509,17 +571,54 @@ bool Segment::read_text(const Face *face, const Features* pFeats/*must not be NU
     assert(face);
     assert(pFeats);
     if (!m_charinfo) return false;
+    const int fid = addFeatures(*pFeats);
+    if (fid < 0)    return false;
 
     // utf iterator is self recovering so we don't care about the error state of the iterator.
     switch (enc)
     {
-    case gr_utf8:   process_utf_data(*this, *face, addFeatures(*pFeats), utf8::const_iterator(pStart), nChars); break;
-    case gr_utf16:  process_utf_data(*this, *face, addFeatures(*pFeats), utf16::const_iterator(pStart), nChars); break;
-    case gr_utf32:  process_utf_data(*this, *face, addFeatures(*pFeats), utf32::const_iterator(pStart), nChars); break;
+    case gr_utf8:   process_utf_data(*this, *face, fid, utf8::const_iterator(pStart), nChars); break;
+    case gr_utf16:  process_utf_data(*this, *face, fid, utf16::const_iterator(pStart), nChars); break;
+    case gr_utf32:  process_utf_data(*this, *face, fid, utf32::const_iterator(pStart), nChars); break;
     }
     return true;
 }
 
+// A face holding as many feature settings as it will intern leaves the
+//  segment its own copy of any new ones.
+int Segment::addFeatures(const Features & feats)
+{
+    // Settings interned already, as a batch's are, need no lookup.
+    const Features * f = feats.interned() == &m_face->featureSets() ? &feats : m_face->featureSets().intern(feats);
+    if (!f) f = new Features(feats);
+    if (!f) return -1;
+    m_feats.push_back(f);
+    return m_feats.size() - 1;
+}
+
+void Segment::setFeature(int index, uint8 findex, uint32 val)
+{
+    const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex);
+    if (!pFR)   return;
+    if (val > pFR->maxVal()) val = pFR->maxVal();
+
+    // The interned settings are shared, so change a copy and intern that.
+    Features feats(*m_feats[index]);
+    if (!pFR->applyValToFeature(val, feats))    return;
+    const Features * f = m_face->featureSets().intern(feats);
+    if (!f) f = new Features(feats);
+    if (!f) return;
+    if (!m_feats[index]->interned())    delete m_feats[index];
+    m_feats[index] = f;
+}
+
+void Segment::releaseFeatures()
+{
+    for (FeatureList::iterator f = m_feats.begin(), e = m_feats.end(); f != e; ++f)
+        if (!(*f)->interned())  delete *f;
+    m_feats.clear();
+}
+
 void Segment::doMirror(uint16 aMirror)
 {
     Slot * s;
@@ -533,8 +632,10 @@ void Segment::doMirror(uint16 aMirror)
 
 bool Segment::initCollisions()
 {
-    m_collisions = grzeroalloc<SlotCollision>(slotCount());
-    if (!m_collisions) return false;
+    void * const collisions = m_arena.allocate(slotCount() * sizeof(SlotCollision));
+    if (!collisions) return false;
+    memset(collisions, 0, slotCount() * sizeof(SlotCollision));
+    m_collisions = static_cast<SlotCollision *>(collisions);
 
     for (Slot *p = m_first; p; p = p->next())
         if (p->index() < slotCount())
@@ -32,6 +32,8 @@ of the License or (at your option) any later version.
 #include "inc/Segment.h"
 #include "inc/Rule.h"
 #include "inc/Error.h"
+#include "inc/Snapshot.h"
+#include "inc/Thread.h"
 
 
 using namespace graphite2;
@@ -89,7 +91,7 @@ void Silf::releaseBuffers() throw()
 }
 
 
-bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face, uint32 version)
+bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face, uint32 version, bool lazyPasses)
 {
     const byte * p = silf_start,
                * const silf_end = p + lSilf;
@@ -214,7 +216,7 @@ bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face,
 
         m_passes[i].init(this);
         if (!m_passes[i].readPass(silf_start + pass_start, pass_end - pass_start, pass_start, face, pt,
-            version, e))
+            version, e, lazyPasses))
         {
             releaseBuffers();
             return false;
@@ -229,6 +231,162 @@ bool Silf::readGraphite(const byte * const silf_start, size_t lSilf, Face& face,
     m_silfinfo.space_contextuals = gr_faceinfo::gr_space_contextuals((m_flags >> 2) & 0x7);
     return true;
 }
+namespace
+{
+    struct pending_pass
+    {
+        Pass          * pass;
+        const Face    * face;
+        Error           e;
+        unsigned int    ectxt;
+        bool            ok;
+    };
+
+    void read_pending_pass(void * data, size_t i)
+    {
+        pending_pass & p = static_cast<pending_pass *>(data)[i];
+        p.ok = p.pass->readPending(*p.face, p.e, p.ectxt);
+    }
+}
+
+// Decode every pass read lazily by readGraphite, in parallel. The first
+//  failing pass, by index, is the one reported.
+bool Silf::readPendingPasses(Face & face)
+{
+    pending_pass pending[128];      // readGraphite limits m_numPasses to this
+    for (uint8 i = 0; i < m_numPasses; ++i)
+    {
+        pending[i].pass = m_passes + i;
+        pending[i].face = &face;
+        pending[i].ectxt = face.error_context();
+        pending[i].ok = false;
+    }
+
+    parallel::run(m_numPasses, &read_pending_pass, pending);
+
+    for (uint8 i = 0; i < m_numPasses; ++i)
+    {
+        if (!pending[i].ok)
+        {
+            face.error_context(pending[i].ectxt);
+            releaseBuffers();
+            return face.error(pending[i].e);
+        }
+    }
+    return true;
+}
+
+bool Silf::writeSnapshot(SnapshotWriter & w, const Face & face) const
+{
+    w.write(m_numPasses);
+    w.write(m_numJusts);
+    w.write(m_sPass);
+    w.write(m_pPass);
+    w.write(m_jPass);
+    w.write(m_bPass);
+    w.write(m_flags);
+    w.write(m_dir);
+    w.write(m_aPseudo);
+    w.write(m_aBreak);
+    w.write(m_aUser);
+    w.write(m_aBidi);
+    w.write(m_aMirror);
+    w.write(m_aPassBits);
+    w.write(m_iMaxComp);
+    w.write(m_aCollision);
+    w.write(m_aLig);
+    w.write(m_numPseudo);
+    w.write(m_nClass);
+    w.write(m_nLinear);
+    w.write(m_gEndLine);
+    w.write(m_silfinfo);
+
+    w.write(m_justs, m_numJusts * sizeof(Justinfo));
+    for (const Pseudo * p = m_pseudos, * const pe = p + m_numPseudo; p != pe; ++p)
+    {
+        w.write(p->uid);
+        w.write(p->gid);
+    }
+
+    // The last class offset is the size of the class data.
+    const uint32 num_offsets = m_classOffsets ? m_nClass + 1 : 0;
+    w.write(num_offsets);
+    w.write(m_classOffsets, num_offsets * sizeof(uint32));
+    w.write(m_classData, (num_offsets ? m_classOffsets[m_nClass] : 0) * sizeof(uint16));
+
+    for (const Pass * p = m_passes, * const pe = p + m_numPasses; p != pe; ++p)
+        if (!p->writeSnapshot(w, face)) return false;
+    return true;
+}
+
+bool Silf::readSnapshot(SnapshotReader & r, Face & face)
+{
+    Error e;
+    r.read(m_numPasses);
+    r.read(m_numJusts);
+    r.read(m_sPass);
+    r.read(m_pPass);
+    r.read(m_jPass);
+    r.read(m_bPass);
+    r.read(m_flags);
+    r.read(m_dir);
+    r.read(m_aPseudo);
+    r.read(m_aBreak);
+    r.read(m_aUser);
+    r.read(m_aBidi);
+    r.read(m_aMirror);
+    r.read(m_aPassBits);
+    r.read(m_iMaxComp);
+    r.read(m_aCollision);
+    r.read(m_aLig);
+    r.read(m_numPseudo);
+    r.read(m_nClass);
+    r.read(m_nLinear);
+    r.read(m_gEndLine);
+    r.read(m_silfinfo);
+    if (e.test(!r || m_pPass > m_numPasses || m_jPass > m_numPasses || m_nLinear > m_nClass, E_BADSNAPSHOT))
+    {
+        releaseBuffers(); return face.error(e);
+    }
+
+    m_justs = r.read_array<Justinfo>(m_numJusts);
+    m_pseudos = new Pseudo[m_numPseudo];
+    if (e.test(!m_pseudos, E_OUTOFMEM)) { releaseBuffers(); return face.error(e); }
+    for (Pseudo * p = m_pseudos, * const pe = p + m_numPseudo; p != pe; ++p)
+    {
+        r.read(p->uid);
+        r.read(p->gid);
+    }
+
+    uint32 num_offsets = 0;
+    r.read(num_offsets);
+    if (e.test(!r || (num_offsets && num_offsets != m_nClass + 1U), E_BADSNAPSHOT))
+    {
+        releaseBuffers(); return face.error(e);
+    }
+    m_classOffsets = r.read_array<uint32>(num_offsets);
+    const uint32 max_off = m_classOffsets ? m_classOffsets[m_nClass] : 0;
+    for (const uint32 * o = m_classOffsets, * const oe = o + num_offsets; o != oe; ++o)
+        if (e.test(*o > max_off, E_BADSNAPSHOT)) { releaseBuffers(); return face.error(e); }
+    m_classData = r.read_array<uint16>(max_off);
+
+    m_passes = new Pass[m_numPasses];
+    if (e.test(!r, E_BADSNAPSHOT) || e.test(!m_passes, E_OUTOFMEM))
+    {
+        releaseBuffers(); return face.error(e);
+    }
+    for (size_t i = 0; i < m_numPasses; ++i)
+    {
+        m_passes[i].init(this);
+        if (!m_passes[i].readSnapshot(r, face, e))
+        {
+            releaseBuffers();
+            return false;
+        }
+    }
+    return true;
+}
+
 
 template<typename T> inline uint32 Silf::readClassOffsets(const byte *&p, size_t data_len, Error &e)
 {
@@ -301,6 +459,31 @@ size_t Silf::readClassMap(const byte *p, size_t data_len, uint32 version, Error
     return max_off;
 }
 
+// The glyph attributes read for every slot rather than by rules, worth a
+//  dense column each in the glyph cache.
+size_t Silf::denseAttrs(uint16 * attrs) const
+{
+    uint16 * a = attrs;
+    *a++ = m_aBreak;
+    *a++ = m_aBidi;
+    *a++ = m_aPseudo;
+    if (m_aMirror)
+    {
+        *a++ = m_aMirror;
+        *a++ = m_aMirror + 1;
+    }
+    if (m_aPassBits)
+    {
+        *a++ = m_aPassBits;
+        if (m_numPasses > 16)
+            *a++ = m_aPassBits + 1;
+    }
+    // The collision attributes, flags first, in the order SlotCollision reads them.
+    for (uint16 i = 0; m_aCollision && i != 16; ++i)
+        *a++ = m_aCollision + i;
+    return a - attrs;
+}
+
 uint16 Silf::findPseudo(uint32 uid) const
 {
     for (int i = 0; i < m_numPseudo; i++)
@@ -353,13 +536,13 @@ uint16 Silf::getClassGlyph(uint16 cid, unsigned int index) const
 }
 
 
-bool Silf::runGraphite(Segment *seg, uint8 firstPass, uint8 lastPass, int dobidi) const
+bool Silf::runGraphite(Segment *seg, VMScratch & scratch, uint8 firstPass, uint8 lastPass, int dobidi) const
 {
     assert(seg != 0);
     unsigned int       maxSize = seg->slotCount() * MAX_SEG_GROWTH_FACTOR;
-    SlotMap            map(*seg, m_dir, maxSize);
-    FiniteStateMachine fsm(map, seg->getFace()->logger());
-    vm::Machine        m(map);
+    scratch.reset(*seg, m_dir, maxSize);
+    FiniteStateMachine & fsm = scratch.fsm;
+    vm::Machine        & m = scratch.m;
     uint8              lbidi = m_bPass;
 #if !defined GRAPHITE2_NTRACING
     json * const dbgout = seg->getFace()->logger();
@@ -34,14 +34,14 @@ of the License or (at your option) any later version.
 
 using namespace graphite2;
 
-Slot::Slot(int16 *user_attrs) :
-    m_next(NULL), m_prev(NULL),
-    m_glyphid(0), m_realglyphid(0), m_original(0), m_before(0), m_after(0),
-    m_index(0), m_parent(NULL), m_child(NULL), m_sibling(NULL),
-    m_position(0, 0), m_shift(0, 0), m_advance(0, 0),
-    m_attach(0, 0), m_with(0, 0), m_just(0.),
-    m_flags(0), m_attLevel(0), m_bidiCls(-1), m_bidiLevel(0), 
-    m_userAttr(user_attrs), m_justs(NULL)
+Slot::Slot(SlotExtra *extra, uint32 self) :
+    m_next(NONE), m_prev(NONE), m_self(self),
+    m_glyphid(0), m_realglyphid(0), m_original(0),
+    m_flags(0), m_attLevel(0), m_bidiCls(-1), m_bidiLevel(0),
+    m_advance(0, 0), m_index(0),
+    m_parent(NONE), m_child(NONE), m_sibling(NONE),
+    m_position(0, 0), m_before(0), m_after(0),
+    m_extra(extra)
 {
 }
 
@@ -60,22 +60,39 @@ void Slot::set(const Slot & orig, int charOffset, size_t sizeAttr, size_t justLe
         m_after = numChars - 1;
     else
         m_after = orig.m_after + charOffset;
-    m_parent = NULL;
-    m_child = NULL;
-    m_sibling = NULL;
+    m_parent = NONE;
+    m_child = NONE;
+    m_sibling = NONE;
     m_position = orig.m_position;
-    m_shift = orig.m_shift;
     m_advance = orig.m_advance;
-    m_attach = orig.m_attach;
-    m_with = orig.m_with;
+    m_extra->shift = orig.m_extra->shift;
+    m_extra->attach = orig.m_extra->attach;
+    m_extra->with = orig.m_extra->with;
     m_flags = orig.m_flags;
     m_attLevel = orig.m_attLevel;
     m_bidiCls = orig.m_bidiCls;
     m_bidiLevel = orig.m_bidiLevel;
-    if (m_userAttr && orig.m_userAttr)
-        memcpy(m_userAttr, orig.m_userAttr, sizeAttr * sizeof(*m_userAttr));
-    if (m_justs && orig.m_justs)
-        memcpy(m_justs, orig.m_justs, SlotJustify::size_of(justLevels));
+    memcpy(m_extra->userAttrs, orig.m_extra->userAttrs, sizeAttr * sizeof(int16));
+    if (m_extra->justs && orig.m_extra->justs)
+        memcpy(m_extra->justs, orig.m_extra->justs, SlotJustify::size_of(justLevels));
+}
+
+Slot * Slot::makeBlock(void * mem, const SlotBlocks * owner, uint32 block, size_t n, byte * extras, size_t extraStride)
+{
+    assert(block < MAX_BLOCKS && n <= MAX_BLOCK_SLOTS);
+    *static_cast<const SlotBlocks **>(mem) = owner;
+    Slot * const slots = reinterpret_cast<Slot *>(static_cast<byte *>(mem) + sizeof(const SlotBlocks *));
+    for (size_t i = 0; i != n; ++i)
+        ::new (slots + i) Slot(reinterpret_cast<SlotExtra *>(extras + i * extraStride), block << BLOCK_BITS | uint32(i));
+    return slots;
+}
+
+Slot * Slot::otherBlock(uint32 i) const
+{
+    const Slot * const first = this - (m_self & (MAX_BLOCK_SLOTS - 1));
+    const SlotBlocks * const owner = *static_cast<const SlotBlocks * const *>(blockMemory(const_cast<Slot *>(first)));
+    assert(owner && (i >> BLOCK_BITS) < owner->size());
+    return (*owner)[i >> BLOCK_BITS] + (i & (MAX_BLOCK_SLOTS - 1));
 }
 
 void Slot::update(int /*numGrSlots*/, int numCharInfo, Position &relpos)
@@ -90,8 +107,9 @@ Position Slot::finalise(const Segment *seg, const Font *font, Position & base, R
     SlotCollision *coll = NULL;
     if (depth > 100 || (attrLevel && m_attLevel > attrLevel)) return Position(0, 0);
     float scale = font ? font->scale() : 1.0f;
-    Position shift(m_shift.x * (rtl * -2 + 1) + m_just, m_shift.y);
-    float tAdvance = m_advance.x + m_just;
+    const SlotExtra & extra = *m_extra;
+    Position shift(extra.shift.x * (rtl * -2 + 1) + extra.just, extra.shift.y);
+    float tAdvance = m_advance.x + extra.just;
     if (isFinal && (coll = seg->collisionInfo(this)))
     {
         const Position &collshift = coll->offset();
@@ -104,14 +122,17 @@ Position Slot::finalise(const Segment *seg, const Font *font, Position & base, R
         scale = font->scale();
         shift *= scale;
         if (font->isHinted() && glyphFace)
-            tAdvance = (m_advance.x - glyphFace->theAdvance().x + m_just) * scale + font->advance(glyph());
+            tAdvance = (m_advance.x - glyphFace->theAdvance().x + extra.just) * scale + font->advance(glyph());
         else
             tAdvance *= scale;
     }    
     Position res;
 
+    Slot * const pParent = attachedTo(),
+         * const pChild = firstChild(),
+         * const pSibling = nextSibling();
     m_position = base + shift;
-    if (!m_parent)
+    if (!pParent)
     {
         res = base + Position(tAdvance, m_advance.y * scale);
         clusterMin = m_position.x;
@@ -119,7 +140,7 @@ Position Slot::finalise(const Segment *seg, const Font *font, Position & base, R
     else
     {
         float tAdv;
-        m_position += (m_attach - m_with) * scale;
+        m_position += (extra.attach - extra.with) * scale;
         tAdv = m_advance.x >= 0.5f ? m_position.x + tAdvance - shift.x : 0.f;
         res = Position(tAdv, 0);
         if ((m_advance.x >= 0.5f || m_position.x < 0) && m_position.x < clusterMin) clusterMin = m_position.x;
@@ -131,24 +152,24 @@ Position Slot::finalise(const Segment *seg, const Font *font, Position & base, R
         bbox = bbox.widen(ourBbox);
     }
 
-    if (m_child && m_child != this && m_child->attachedTo() == this)
+    if (pChild && pChild != this && pChild->attachedTo() == this)
     {
-        Position tRes = m_child->finalise(seg, font, m_position, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
-        if ((!m_parent || m_advance.x >= 0.5f) && tRes.x > res.x) res = tRes;
+        Position tRes = pChild->finalise(seg, font, m_position, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
+        if ((!pParent || m_advance.x >= 0.5f) && tRes.x > res.x) res = tRes;
     }
 
-    if (m_parent && m_sibling && m_sibling != this && m_sibling->attachedTo() == m_parent)
+    if (pParent && pSibling && pSibling != this && pSibling->attachedTo() == pParent)
     {
-        Position tRes = m_sibling->finalise(seg, font, base, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
+        Position tRes = pSibling->finalise(seg, font, base, bbox, attrLevel, clusterMin, rtl, isFinal, depth + 1);
         if (tRes.x > res.x) res = tRes;
     }
     
-    if (!m_parent && clusterMin < base.x)
+    if (!pParent && clusterMin < base.x)
     {
         Position adj = Position(m_position.x - clusterMin, 0.);
         res += adj;
         m_position += adj;
-        if (m_child) m_child->floodShift(adj);
+        if (pChild) pChild->floodShift(adj);
     }
     return res;
 }
@@ -210,13 +231,13 @@ int Slot::getAttr(const Segment *seg, attrCode ind, uint8 subindex) const
     {
     case gr_slatAdvX :      return int(m_advance.x);
     case gr_slatAdvY :      return int(m_advance.y);
-    case gr_slatAttTo :     return m_parent ? 1 : 0;
-    case gr_slatAttX :      return int(m_attach.x);
-    case gr_slatAttY :      return int(m_attach.y);
+    case gr_slatAttTo :     return isBase() ? 0 : 1;
+    case gr_slatAttX :      return int(m_extra->attach.x);
+    case gr_slatAttY :      return int(m_extra->attach.y);
     case gr_slatAttXOff :
     case gr_slatAttYOff :   return 0;
-    case gr_slatAttWithX :  return int(m_with.x);
-    case gr_slatAttWithY :  return int(m_with.y);
+    case gr_slatAttWithX :  return int(m_extra->with.x);
+    case gr_slatAttWithY :  return int(m_extra->with.y);
     case gr_slatAttWithXOff:
     case gr_slatAttWithYOff:return 0;
     case gr_slatAttLevel :  return m_attLevel;
@@ -226,12 +247,12 @@ int Slot::getAttr(const Segment *seg, attrCode ind, uint8 subindex) const
     case gr_slatInsert :    return isInsertBefore();
     case gr_slatPosX :      return int(m_position.x); // but need to calculate it
     case gr_slatPosY :      return int(m_position.y);
-    case gr_slatShiftX :    return int(m_shift.x);
-    case gr_slatShiftY :    return int(m_shift.y);
+    case gr_slatShiftX :    return int(m_extra->shift.x);
+    case gr_slatShiftY :    return int(m_extra->shift.y);
     case gr_slatMeasureSol: return -1; // err what's this?
     case gr_slatMeasureEol: return -1;
-    case gr_slatJWidth:     return int(m_just);
-    case gr_slatUserDefn :  return m_userAttr[subindex];
+    case gr_slatJWidth:     return int(m_extra->just);
+    case gr_slatUserDefn :  return m_extra->userAttrs[subindex];
     case gr_slatSegSplit :  return seg->charinfo(m_original)->flags() & 3;
     case gr_slatBidiLevel:  return m_bidiLevel;
     case gr_slatColFlags :		{ SlotCollision *c = seg->collisionInfo(this); return c ? c->flags() : 0; }
@@ -295,8 +316,8 @@ void Slot::setAttr(Segment *seg, attrCode ind, uint8 subindex, int16 value, cons
         if (idx < map.size() && map[idx])
         {
             Slot *other = map[idx];
-            if (other == this || other == m_parent || other->isCopied()) break;
-            if (m_parent) { m_parent->removeChild(this); attachTo(NULL); }
+            if (other == this || other == attachedTo() || other->isCopied()) break;
+            if (attachedTo()) { attachedTo()->removeChild(this); attachTo(NULL); }
             Slot *pOther = other;
             int count = 0;
             bool foundOther = false;
@@ -306,27 +327,27 @@ void Slot::setAttr(Segment *seg, attrCode ind, uint8 subindex, int16 value, cons
                 if (pOther == this) foundOther = true;
                 pOther = pOther->attachedTo();
             }
-            for (pOther = m_child; pOther; pOther = pOther->m_child)
+            for (pOther = firstChild(); pOther; pOther = pOther->firstChild())
                 ++count;
-            for (pOther = m_sibling; pOther; pOther = pOther->m_sibling)
+            for (pOther = nextSibling(); pOther; pOther = pOther->nextSibling())
                 ++count;
             if (count < 100 && !foundOther && other->child(this))
             {
                 attachTo(other);
                 if ((map.dir() != 0) ^ (idx > subindex))
-                    m_with = Position(advance(), 0);
+                    m_extra->with = Position(advance(), 0);
                 else        // normal match to previous root
-                    m_attach = Position(other->advance(), 0);
+                    m_extra->attach = Position(other->advance(), 0);
             }
         }
         break;
     }
-    case gr_slatAttX :          m_attach.x = value; break;
-    case gr_slatAttY :          m_attach.y = value; break;
+    case gr_slatAttX :          m_extra->attach.x = value; break;
+    case gr_slatAttY :          m_extra->attach.y = value; break;
     case gr_slatAttXOff :
     case gr_slatAttYOff :       break;
-    case gr_slatAttWithX :      m_with.x = value; break;
-    case gr_slatAttWithY :      m_with.y = value; break;
+    case gr_slatAttWithX :      m_extra->with.x = value; break;
+    case gr_slatAttWithY :      m_extra->with.y = value; break;
     case gr_slatAttWithXOff :
     case gr_slatAttWithYOff :   break;
     case gr_slatAttLevel :
@@ -342,13 +363,13 @@ void Slot::setAttr(Segment *seg, attrCode ind, uint8 subindex, int16 value, cons
         break;
     case gr_slatPosX :      break; // can't set these here
     case gr_slatPosY :      break;
-    case gr_slatShiftX :    m_shift.x = value; break;
-    case gr_slatShiftY :    m_shift.y = value; break;
+    case gr_slatShiftX :    m_extra->shift.x = value; break;
+    case gr_slatShiftY :    m_extra->shift.y = value; break;
     case gr_slatMeasureSol :    break;
     case gr_slatMeasureEol :    break;
     case gr_slatJWidth :    just(value); break;
     case gr_slatSegSplit :  seg->charinfo(m_original)->addflags(value & 3); break;
-    case gr_slatUserDefn :  m_userAttr[subindex] = value; break;
+    case gr_slatUserDefn :  m_extra->userAttrs[subindex] = value; break;
     case gr_slatColFlags :  {
         SlotCollision *c = seg->collisionInfo(this);
         if (c)
@@ -381,8 +402,8 @@ int Slot::getJustify(const Segment *seg, uint8 level, uint8 subindex) const
 {
     if (level && level >= seg->silf()->numJustLevels()) return 0;
 
-    if (m_justs)
-        return m_justs->values[level * SlotJustify::NUMJUSTPARAMS + subindex];
+    if (m_extra->justs)
+        return m_extra->justs->values[level * SlotJustify::NUMJUSTPARAMS + subindex];
 
     if (level >= seg->silf()->numJustLevels()) return 0;
     Justinfo *jAttrs = seg->silf()->justAttrs() + level;
@@ -400,53 +421,56 @@ int Slot::getJustify(const Segment *seg, uint8 level, uint8 subindex) const
 void Slot::setJustify(Segment *seg, uint8 level, uint8 subindex, int16 value)
 {
     if (level && level >= seg->silf()->numJustLevels()) return;
-    if (!m_justs)
+    if (!m_extra->justs)
     {
         SlotJustify *j = seg->newJustify();
         if (!j) return;
         j->LoadSlot(this, seg);
-        m_justs = j;
+        m_extra->justs = j;
     }
-    m_justs->values[level * SlotJustify::NUMJUSTPARAMS + subindex] = value;
+    m_extra->justs->values[level * SlotJustify::NUMJUSTPARAMS + subindex] = value;
 }
 
 bool Slot::child(Slot *ap)
 {
     if (this == ap) return false;
-    else if (ap == m_child) return true;
-    else if (!m_child)
-        m_child = ap;
+    Slot * const pChild = firstChild();
+    if (ap == pChild) return true;
+    else if (!pChild)
+        firstChild(ap);
     else
-        return m_child->sibling(ap);
+        return pChild->sibling(ap);
     return true;
 }
 
 bool Slot::sibling(Slot *ap)
 {
     if (this == ap) return false;
-    else if (ap == m_sibling) return true;
-    else if (!m_sibling || !ap)
-        m_sibling = ap;
+    Slot * const pSibling = nextSibling();
+    if (ap == pSibling) return true;
+    else if (!pSibling || !ap)
+        nextSibling(ap);
     else
-        return m_sibling->sibling(ap);
+        return pSibling->sibling(ap);
     return true;
 }
 
 bool Slot::removeChild(Slot *ap)
 {
-    if (this == ap || !m_child || !ap) return false;
-    else if (ap == m_child)
+    Slot * const pChild = firstChild();
+    if (this == ap || !pChild || !ap) return false;
+    else if (ap == pChild)
     {
-        Slot *nSibling = m_child->nextSibling();
-        m_child->nextSibling(NULL);
-        m_child = nSibling;
+        Slot *nSibling = pChild->nextSibling();
+        pChild->nextSibling(NULL);
+        firstChild(nSibling);
         return true;
     }
-    for (Slot *p = m_child; p; p = p->m_sibling)
+    for (Slot *p = pChild; p; p = p->nextSibling())
     {
-        if (p->m_sibling && p->m_sibling == ap)
+        if (p->nextSibling() == ap)
         {
-            p->m_sibling = p->m_sibling->m_sibling;
+            p->nextSibling(ap->nextSibling());
             ap->nextSibling(NULL);
             return true;
         }
@@ -468,21 +492,22 @@ void Slot::setGlyph(Segment *seg, uint16 glyphid, const GlyphFace * theGlyph)
             return;
         }
     }
-    m_realglyphid = theGlyph->attrs()[seg->silf()->aPseudo()];
-    if (m_realglyphid > seg->getFace()->glyphs().numGlyphs())
+    const GlyphCache & glyphs = seg->getFace()->glyphs();
+    m_realglyphid = glyphs.glyphAttr(glyphid, seg->silf()->aPseudo());
+    if (m_realglyphid > glyphs.numGlyphs())
         m_realglyphid = 0;
     const GlyphFace *aGlyph = theGlyph;
     if (m_realglyphid)
     {
-        aGlyph = seg->getFace()->glyphs().glyphSafe(m_realglyphid);
+        aGlyph = glyphs.glyphSafe(m_realglyphid);
         if (!aGlyph) aGlyph = theGlyph;
     }
     m_advance = Position(aGlyph->theAdvance().x, 0.);
     if (seg->silf()->aPassBits())
     {
-        seg->mergePassBits(theGlyph->attrs()[seg->silf()->aPassBits()]);
+        seg->mergePassBits(glyphs.glyphAttr(glyphid, seg->silf()->aPassBits()));
         if (seg->silf()->numPasses() > 16)
-            seg->mergePassBits(theGlyph->attrs()[seg->silf()->aPassBits()+1] << 16);
+            seg->mergePassBits(glyphs.glyphAttr(glyphid, seg->silf()->aPassBits()+1) << 16);
     }
 }
 
@@ -491,8 +516,8 @@ void Slot::floodShift(Position adj, int depth)
     if (depth > 100)
         return;
     m_position += adj;
-    if (m_child) m_child->floodShift(adj, depth + 1);
-    if (m_sibling) m_sibling->floodShift(adj, depth + 1);
+    if (Slot * const pChild = firstChild()) pChild->floodShift(adj, depth + 1);
+    if (Slot * const pSibling = nextSibling()) pSibling->floodShift(adj, depth + 1);
 }
 
 void SlotJustify::LoadSlot(const Slot *s, const Segment *seg)
@@ -527,7 +552,7 @@ Slot * Slot::nextInCluster(const Slot *s) const
 
 bool Slot::isChildOf(const Slot *base) const
 {
-    for (Slot *p = m_parent; p; p = p->m_parent)
+    for (Slot *p = attachedTo(); p; p = p->attachedTo())
         if (p == base)
             return true;
     return false;
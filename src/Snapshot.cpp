@@ -0,0 +1,67 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include "inc/Snapshot.h"
+
+using namespace graphite2;
+
+namespace
+{
+    inline uint32 rotl(const uint32 x, const int n) { return (x << n) | (x >> (32 - n)); }
+
+    inline uint32 mix(uint32 h, const uint32 w)
+    {
+        return rotl(h ^ (w * 0xCC9E2D51), 15) * 0x1B873593;
+    }
+}
+
+// Not cryptographic, it only needs to catch a stale or damaged snapshot, but
+// fast as it runs over the font tables each time a snapshot is loaded.  Four
+// independent lanes keep the multiplies from serialising.
+uint32 snapshot::hash(const void * data, size_t n, uint32 seed) throw()
+{
+    const byte * p = static_cast<const byte *>(data);
+    uint32 h0 = seed ^ 0x9E3779B9, h1 = seed + 0x85EBCA6B,
+           h2 = seed ^ 0xC2B2AE35, h3 = seed + 0x27D4EB2F;
+    const size_t len = n;
+
+    for (; n >= 16; n -= 16, p += 16)
+    {
+        uint32 w[4];
+        memcpy(w, p, sizeof w);
+        h0 = mix(h0, w[0]); h1 = mix(h1, w[1]);
+        h2 = mix(h2, w[2]); h3 = mix(h3, w[3]);
+    }
+
+    uint32 h = h0 ^ rotl(h1, 7) ^ rotl(h2, 13) ^ rotl(h3, 19);
+    for (; n; --n, ++p)
+        h = (h ^ *p) * 0x01000193;
+
+    h ^= uint32(len);
+    h ^= h >> 16; h *= 0x85EBCA6B;
+    h ^= h >> 13; h *= 0xC2B2AE35;
+    return h ^ (h >> 16);
+}
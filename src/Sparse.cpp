@@ -27,26 +27,37 @@ of the License or (at your option) any later version.
 #include <cassert>
 #include "inc/Sparse.h"
 #include "inc/bits.h"
+#include "inc/Snapshot.h"
 
 using namespace graphite2;
 
-const sparse::chunk sparse::empty_chunk = {0,0};
+const sparse::mask_t sparse::empty_chunk = 0;
 
 sparse::~sparse() throw()
 {
-    if (m_array.map == &empty_chunk) return;
-    free(m_array.values);
+    if (m_masks == &empty_chunk || m_in_arena) return;
+    free(m_masks);
 }
 
 
-sparse::mapped_type sparse::operator [] (const key_type k) const throw()
+// As operator [] for each key, with the block's layout worked out just once.
+void sparse::get_many(const key_type * keys, mapped_type * values, size_t n) const throw()
 {
-    mapped_type         g = key_type(k/SIZEOF_CHUNK - m_nchunks) >> (sizeof k*8 - 1);
-    const chunk &       c = m_array.map[g*k/SIZEOF_CHUNK];
-    const mask_t        m = c.mask >> (SIZEOF_CHUNK - 1 - (k%SIZEOF_CHUNK));
-    g *= m & 1;
+    const mask_t * const masks = m_masks;
+    const key_type * const o = offsets();
+    const key_type n_chunks = m_nchunks;
 
-    return g*m_array.values[g*(c.offset + bit_set_count(m >> 1))];
+    for (; n; --n, ++keys, ++values)
+    {
+        const key_type c = *keys / SIZEOF_CHUNK;
+        *values = 0;
+        if (c >= n_chunks)  continue;
+
+        const mask_t m = masks[c],
+                     bit = mask_t(1) << (*keys % SIZEOF_CHUNK);
+        if (m & bit)
+            *values = o[o[c] + bit_set_count(m & (bit - 1))];
+    }
 }
 
 
@@ -55,8 +66,58 @@ size_t sparse::capacity() const throw()
     size_t n = m_nchunks,
            s = 0;
 
-    for (const chunk *ci=m_array.map; n; --n, ++ci)
-        s += bit_set_count(ci->mask);
+    for (const mask_t *mi=m_masks; n; --n, ++mi)
+        s += bit_set_count(*mi);
 
     return s;
 }
+
+
+// The block is written out as is; the offsets are already relative to it.
+void sparse::writeSnapshot(SnapshotWriter & w) const throw()
+{
+    w.write(m_nchunks);
+    if (m_nchunks == 0) return;
+
+    const uint32 n_values = uint32(capacity());
+    w.write(n_values);
+    w.write(m_masks, block_size(m_nchunks, n_values));
+}
+
+
+bool sparse::readSnapshot(SnapshotReader & r) throw()
+{
+    assert(m_nchunks == 0);
+    key_type n_chunks = 0;
+    uint32   n_values = 0;
+    if (!r.read(n_chunks)) return false;
+    if (n_chunks == 0)     return true;
+    if (!r.read(n_values)) return false;
+    if (n_chunks + n_values > 0xFFFF) return r.fail();
+
+    mask_t * const masks = r.read_array<mask_t>(block_size(n_chunks, n_values) / sizeof(mask_t));
+    if (!masks) return false;
+
+    // Every chunk's values must lie within the block.
+    const key_type * const o = reinterpret_cast<const key_type *>(masks + n_chunks);
+    size_t total = 0;
+    for (key_type n = 0; n != n_chunks; ++n)
+    {
+        const unsigned int n_set = bit_set_count(masks[n]);
+        total += n_set;
+        if (n_set && (o[n] < n_chunks || o[n] + n_set > n_chunks + n_values))
+        {
+            free(masks);
+            return r.fail();
+        }
+    }
+    if (total != n_values)
+    {
+        free(masks);
+        return r.fail();
+    }
+
+    m_masks = masks;
+    m_nchunks = n_chunks;
+    return true;
+}
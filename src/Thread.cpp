@@ -0,0 +1,284 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#include "inc/Main.h"
+#include "inc/Atomic.h"
+#include "inc/Thread.h"
+
+// Telemetry tracks its current category in shared state.
+#if defined GRAPHITE2_TELEMETRY && !defined GRAPHITE2_NTHREADS
+  #define GRAPHITE2_NTHREADS
+#endif
+
+#if !defined GRAPHITE2_NTHREADS
+  #if defined _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+  #else
+    #include <pthread.h>
+    #include <sched.h>
+    #include <unistd.h>
+  #endif
+#endif
+
+using namespace graphite2;
+
+namespace
+{
+    // More than this gains little for the size of job we have.
+    const size_t MAX_THREADS = 8;
+
+    struct job
+    {
+        parallel::task  t;
+        void          * data;
+        long            n;
+        volatile long   next;
+    };
+
+    void work(job & j) throw()
+    {
+        for (long i; (i = atomic::fetch_add(j.next, 1)) < j.n;)
+            j.t(j.data, size_t(i));
+    }
+
+#if !defined GRAPHITE2_NTHREADS
+    struct background
+    {
+        parallel::task  t;
+        void          * data;
+  #if defined _WIN32
+        HANDLE          thread,
+                        finished;
+  #else
+        pthread_t       thread;
+        pthread_mutex_t lock;
+        pthread_cond_t  finished;
+        bool            done;
+  #endif
+        CLASS_NEW_DELETE;
+    };
+
+  #if defined _WIN32
+    DWORD WINAPI run_background(LPVOID b)
+    {
+        background & bg = *static_cast<background *>(b);
+        bg.t(bg.data, 0);
+        SetEvent(bg.finished);
+        return 0;
+    }
+  #else
+    void * run_background(void * b)
+    {
+        background & bg = *static_cast<background *>(b);
+        bg.t(bg.data, 0);
+        pthread_mutex_lock(&bg.lock);
+        bg.done = true;
+        pthread_cond_broadcast(&bg.finished);
+        pthread_mutex_unlock(&bg.lock);
+        return 0;
+    }
+  #endif
+
+  #if defined _WIN32
+    DWORD WINAPI worker(LPVOID j)
+    {
+        work(*static_cast<job *>(j));
+        return 0;
+    }
+  #else
+    void * worker(void * j)
+    {
+        work(*static_cast<job *>(j));
+        return 0;
+    }
+  #endif
+#endif
+}
+
+size_t parallel::concurrency() throw()
+{
+#if defined GRAPHITE2_NTHREADS
+    return 1;
+#else
+  #if defined _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    const long n = long(si.dwNumberOfProcessors);
+  #else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  #endif
+    return n < 1 ? 1 : min(size_t(n), MAX_THREADS);
+#endif
+}
+
+void parallel::yield() throw()
+{
+#if !defined GRAPHITE2_NTHREADS
+  #if defined _WIN32
+    SwitchToThread();
+  #else
+    sched_yield();
+  #endif
+#endif
+}
+
+void parallel::run(size_t n, task t, void * data) throw()
+{
+    job j = { t, data, long(n), 0 };
+
+#if !defined GRAPHITE2_NTHREADS
+    const size_t helpers = min(concurrency(), n) - (n != 0);
+  #if defined _WIN32
+    HANDLE threads[MAX_THREADS];
+  #else
+    pthread_t threads[MAX_THREADS];
+  #endif
+    size_t started = 0;
+    // If a thread can't be had the ones we do have, or failing that the
+    //  caller, simply pick up its share.
+    for (; started != helpers; ++started)
+    {
+  #if defined _WIN32
+        threads[started] = CreateThread(0, 0, worker, &j, 0, 0);
+        if (!threads[started]) break;
+  #else
+        if (pthread_create(threads + started, 0, worker, &j) != 0) break;
+  #endif
+    }
+#endif
+
+    work(j);
+
+#if !defined GRAPHITE2_NTHREADS
+    while (started)
+    {
+  #if defined _WIN32
+        WaitForSingleObject(threads[--started], INFINITE);
+        CloseHandle(threads[started]);
+  #else
+        pthread_join(threads[--started], 0);
+  #endif
+    }
+#endif
+}
+
+
+void parallel::Background::join() throw()
+{
+#if !defined GRAPHITE2_NTHREADS
+    if (!_thread) return;
+    background * const bg = static_cast<background *>(_thread);
+    _thread = 0;
+  #if defined _WIN32
+    WaitForSingleObject(bg->thread, INFINITE);
+    CloseHandle(bg->thread);
+    CloseHandle(bg->finished);
+  #else
+    pthread_join(bg->thread, 0);
+    pthread_cond_destroy(&bg->finished);
+    pthread_mutex_destroy(&bg->lock);
+  #endif
+    delete bg;
+#endif
+}
+
+bool parallel::Background::start(task t GR_MAYBE_UNUSED, void * data GR_MAYBE_UNUSED) throw()
+{
+#if defined GRAPHITE2_NTHREADS
+    return false;
+#else
+    if (_thread) return false;
+    background * const bg = new background;
+    if (!bg) return false;
+    bg->t = t;
+    bg->data = data;
+    // Set before the thread starts, as the task may call finish().
+    _thread = bg;
+  #if defined _WIN32
+    bg->finished = CreateEvent(0, TRUE, FALSE, 0);
+    bg->thread = bg->finished ? CreateThread(0, 0, run_background, bg, 0, 0) : 0;
+    if (!bg->thread)
+    {
+        if (bg->finished) CloseHandle(bg->finished);
+        _thread = 0;
+        delete bg;
+        return false;
+    }
+  #else
+    bg->done = false;
+    bool started = false;
+    if (pthread_mutex_init(&bg->lock, 0) == 0)
+    {
+        if (pthread_cond_init(&bg->finished, 0) == 0)
+        {
+            started = pthread_create(&bg->thread, 0, run_background, bg) == 0;
+            if (!started) pthread_cond_destroy(&bg->finished);
+        }
+        if (!started) pthread_mutex_destroy(&bg->lock);
+    }
+    if (!started)
+    {
+        _thread = 0;
+        delete bg;
+        return false;
+    }
+  #endif
+    return true;
+#endif
+}
+
+void parallel::Background::finish() const throw()
+{
+#if !defined GRAPHITE2_NTHREADS
+    if (!_thread) return;
+    background & bg = *static_cast<background *>(_thread);
+  #if defined _WIN32
+    SetEvent(bg.finished);
+  #else
+    pthread_mutex_lock(&bg.lock);
+    bg.done = true;
+    pthread_cond_broadcast(&bg.finished);
+    pthread_mutex_unlock(&bg.lock);
+  #endif
+#endif
+}
+
+void parallel::Background::wait() const throw()
+{
+#if !defined GRAPHITE2_NTHREADS
+    if (!_thread) return;
+    background & bg = *static_cast<background *>(_thread);
+  #if defined _WIN32
+    WaitForSingleObject(bg.finished, INFINITE);
+  #else
+    pthread_mutex_lock(&bg.lock);
+    while (!bg.done)
+        pthread_cond_wait(&bg.finished, &bg.lock);
+    pthread_mutex_unlock(&bg.lock);
+  #endif
+#endif
+}
@@ -82,7 +82,7 @@ typedef bool        (* ip_t)(registers);
 // pollute the toplevel namespace.
 namespace {
 #define smap    reg.smap
-#define seg     smap.segment
+#define seg     smap.segment()
 #define is      reg.is
 #define ip      reg.ip
 #define map     reg.map
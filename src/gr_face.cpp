@@ -27,10 +27,12 @@ of the License or (at your option) any later version.
 #include "graphite2/Font.h"
 #include "inc/Face.h"
 #include "inc/FileFace.h"
+#include "inc/MemoryFace.h"
 #include "inc/GlyphCache.h"
 #include "inc/CachedFace.h"
 #include "inc/CmapCache.h"
 #include "inc/Silf.h"
+#include "inc/Snapshot.h"
 #include "inc/json.h"
 
 using namespace graphite2;
@@ -41,11 +43,20 @@ extern json *global_log;
 
 namespace
 {
-    bool load_face(Face & face, unsigned int options)
+    bool read_face(Face & face, unsigned int options, const void * snapshot, size_t snapshot_len)
     {
 #ifdef GRAPHITE2_TELEMETRY
         telemetry::category _misc_cat(face.tele.misc);
 #endif
+        // A snapshot that doesn't match the font is ignored, the face is then
+        //  loaded from the font tables as usual.
+        if (snapshot)
+        {
+            SnapshotReader snap(static_cast<const byte *>(snapshot), snapshot_len);
+            if (face.matchSnapshot(snap))
+                return face.readSnapshot(snap, options);
+        }
+
         Face::Table silf(face, Tag::Silf, 0x00050000);
         if (silf)   options &= ~gr_face_dumbRendering;
         else if (!(options &  gr_face_dumbRendering))
@@ -56,7 +67,7 @@ namespace
 
         if (silf)
         {
-            if (!face.readFeatures() || !face.readGraphite(silf))
+            if (!face.readFeatures() || !face.readGraphite(silf, options))
             {
 #if !defined GRAPHITE2_NTRACING
                 if (global_log)
@@ -76,6 +87,35 @@ namespace
         else
             return options & gr_face_dumbRendering;
     }
+
+    bool load_face(Face & face, unsigned int options, const void * snapshot=0, size_t snapshot_len=0)
+    {
+        const bool ok = read_face(face, options, snapshot, snapshot_len);
+        // Tables are shared while loading, then only those still in use are kept.
+        face.trimTables();
+        return ok;
+    }
+
+    struct async_load
+    {
+        Face              * face;
+        unsigned int        options;
+        gr_face_ready_fn    ready;
+        void              * data;
+
+        CLASS_NEW_DELETE;
+    };
+
+    void load_async(void * job, size_t)
+    {
+        async_load * const j = static_cast<async_load *>(job);
+        const bool ok = load_face(*j->face, j->options);
+        // Release waiters before the callback so it may use the face itself.
+        j->face->loaded(ok);
+        if (j->ready)
+            (*j->ready)(static_cast<gr_face *>(j->face), ok, j->data);
+        delete j;
+    }
 }
 
 extern "C" {
@@ -93,6 +133,75 @@ gr_face* gr_make_face_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_f
     return 0;
 }
 
+gr_face* gr_make_face_from_snapshot_with_ops(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *ops, const void *snapshot, size_t snapshot_len, unsigned int faceOptions)
+{
+    if (ops == 0)   return 0;
+
+    Face *res = new Face(appFaceHandle, *ops);
+    if (res && load_face(*res, faceOptions, snapshot, snapshot_len))
+        return static_cast<gr_face *>(res);
+
+    delete res;
+    return 0;
+}
+
+gr_face* gr_make_face_from_memory(const void *font, size_t font_len, unsigned int faceOptions)
+{
+    MemoryFace * pMemoryFace = new MemoryFace(font, font_len);
+    if (pMemoryFace && *pMemoryFace)
+    {
+        gr_face * pRes = gr_make_face_with_ops(pMemoryFace, &MemoryFace::ops, faceOptions);
+        if (pRes)
+        {
+            pRes->takeMemoryFace(pMemoryFace);        //takes ownership
+            return pRes;
+        }
+    }
+
+    delete pMemoryFace;
+    return NULL;
+}
+
+gr_face* gr_make_face_async(const void* appFaceHandle/*non-NULL*/, const gr_face_ops *ops, unsigned int faceOptions, gr_face_ready_fn ready, void *data)
+{
+    if (ops == 0)   return 0;
+
+    Face *res = new Face(appFaceHandle, *ops);
+    async_load *job = new async_load;
+    if (!res || !job)
+    {
+        delete job;
+        delete res;
+        return 0;
+    }
+    job->face = res;
+    job->options = faceOptions;
+    job->ready = ready;
+    job->data = data;
+
+    // Without a thread to spare load it here, the caller still gets a handle
+    //  and callback as it would otherwise.
+    if (!res->loadInBackground(&load_async, job))
+        load_async(job, 0);
+    return static_cast<gr_face *>(res);
+}
+
+int gr_face_wait(const gr_face *pFace)
+{
+    return pFace && pFace->waitLoaded();
+}
+
+int gr_face_is_ready(const gr_face *pFace)
+{
+    return pFace && !pFace->loading();
+}
+
+size_t gr_face_snapshot(const gr_face *pFace, void *buffer, size_t buffer_len)
+{
+    if (pFace == 0 || !pFace->waitLoaded()) return 0;
+    return pFace->snapshot(static_cast<byte *>(buffer), buffer_len);
+}
+
 gr_face* gr_make_face(const void* appFaceHandle/*non-NULL*/, gr_get_table_fn tablefn, unsigned int faceOptions)
 {
     const gr_face_ops ops = {sizeof(gr_face_ops), tablefn, NULL};
@@ -154,14 +263,33 @@ uint32 zeropad(const uint32 x)
 gr_feature_val* gr_face_featureval_for_lang(const gr_face* pFace, gr_uint32 langname/*0 means clone default*/) //clones the features. if none for language, clones the default
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     langname = zeropad(langname);
     return static_cast<gr_feature_val *>(pFace->theSill().cloneFeatures(langname));
 }
 
 
+const gr_feature_val* gr_face_lang_featureval(const gr_face* pFace, gr_uint32 langname/*0 means default*/)
+{
+    assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
+    langname = zeropad(langname);
+    return static_cast<const gr_feature_val *>(&pFace->theSill().features(langname));
+}
+
+
+const gr_feature_val* gr_face_intern_featureval(const gr_face* pFace, const gr_feature_val* pFeats)
+{
+    assert(pFace && pFeats);
+    if (!pFace->waitLoaded()) return 0;
+    return static_cast<const gr_feature_val *>(pFace->featureSets().intern(*pFeats));
+}
+
+
 const gr_feature_ref* gr_face_find_fref(const gr_face* pFace, gr_uint32 featId)  //When finished with the FeatureRef, call destroy_FeatureRef
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     featId = zeropad(featId);
     const FeatureRef* pRef = pFace->featureById(featId);
     return static_cast<const gr_feature_ref*>(pRef);
@@ -170,12 +298,14 @@ const gr_feature_ref* gr_face_find_fref(const gr_face* pFace, gr_uint32 featId)
 unsigned short gr_face_n_fref(const gr_face* pFace)
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     return pFace->numFeatures();
 }
 
 const gr_feature_ref* gr_face_fref(const gr_face* pFace, gr_uint16 i) //When finished with the FeatureRef, call destroy_FeatureRef
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     const FeatureRef* pRef = pFace->feature(i);
     return static_cast<const gr_feature_ref*>(pRef);
 }
@@ -183,12 +313,14 @@ const gr_feature_ref* gr_face_fref(const gr_face* pFace, gr_uint16 i) //When fin
 unsigned short gr_face_n_languages(const gr_face* pFace)
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     return pFace->theSill().numLanguages();
 }
 
 gr_uint32 gr_face_lang_by_index(const gr_face* pFace, gr_uint16 i)
 {
     assert(pFace);
+    if (!pFace->waitLoaded()) return 0;
     return pFace->theSill().getLangName(i);
 }
 
@@ -199,9 +331,32 @@ void gr_face_destroy(gr_face *face)
 }
 
 
+void gr_face_trim_tables(const gr_face *face)
+{
+    if (!face) return;
+    // The background load still needs what it has fetched, even if it fails.
+    face->waitLoaded();
+    face->trimTables();
+}
+
+
+void gr_face_cmap_budget(gr_face *face, size_t bytes)
+{
+    if (face && face->waitLoaded())
+        face->cmap().budget(bytes);
+}
+
+
+size_t gr_face_cmap_footprint(const gr_face *face)
+{
+    if (!face || !face->waitLoaded()) return 0;
+    return face->cmap().footprint();
+}
+
+
 gr_uint16 gr_face_name_lang_for_locale(gr_face *face, const char * locale)
 {
-    if (face)
+    if (face && face->waitLoaded())
     {
         return face->languageForLocale(locale);
     }
@@ -210,12 +365,13 @@ gr_uint16 gr_face_name_lang_for_locale(gr_face *face, const char * locale)
 
 unsigned short gr_face_n_glyphs(const gr_face* pFace)
 {
+    if (!pFace->waitLoaded()) return 0;
     return pFace->glyphs().numGlyphs();
 }
 
 const gr_faceinfo *gr_face_info(const gr_face *pFace, gr_uint32 script)
 {
-    if (!pFace) return 0;
+    if (!pFace || !pFace->waitLoaded()) return 0;
     const Silf *silf = pFace->chooseSilf(script);
     if (silf) return silf->silfInfo();
     return 0;
@@ -223,6 +379,7 @@ const gr_faceinfo *gr_face_info(const gr_face *pFace, gr_uint32 script)
 
 int gr_face_is_char_supported(const gr_face* pFace, gr_uint32 usv, gr_uint32 script)
 {
+    if (!pFace->waitLoaded()) return 0;
     const Cmap & cmap = pFace->cmap();
     gr_uint16 gid = cmap[usv];
     if (!gid)
@@ -233,10 +390,21 @@ int gr_face_is_char_supported(const gr_face* pFace, gr_uint32 usv, gr_uint32 scr
     return (gid != 0);
 }
 
+const gr_coverage* gr_face_coverage(const gr_face* pFace)
+{
+    if (!pFace || !pFace->waitLoaded()) return 0;
+    return static_cast<const gr_coverage *>(pFace->coverage());
+}
+
+int gr_coverage_has_char(const gr_coverage* pCoverage, gr_uint32 usv)
+{
+    return pCoverage && (*pCoverage)[usv];
+}
+
 #ifndef GRAPHITE2_NFILEFACE
 gr_face* gr_make_file_face(const char *filename, unsigned int faceOptions)
 {
-    FileFace* pFileFace = new FileFace(filename);
+    FileFace* pFileFace = new FileFace(filename, faceOptions & gr_face_mapFile);
     if (*pFileFace)
     {
       gr_face* pRes = gr_make_face_with_ops(pFileFace, &FileFace::ops, faceOptions);
@@ -253,11 +421,40 @@ gr_face* gr_make_file_face(const char *filename, unsigned int faceOptions)
     return NULL;
 }
 
+gr_face* gr_make_file_face_from_snapshot(const char *filename, const char *snapshot_filename, unsigned int faceOptions)
+{
+    // Use whatever of the snapshot we can map, a missing snapshot just means
+    //  loading the font as usual.
+    FILE * snap_file = snapshot_filename ? fopen(snapshot_filename, "rb") : NULL;
+    size_t snap_len = 0;
+    const byte * snap = NULL;
+    if (snap_file && fseek(snap_file, 0, SEEK_END) == 0)
+    {
+        const long end = ftell(snap_file);
+        snap_len = end > 0 ? size_t(end) : 0;
+        snap = FileFace::map_file(snap_file, snap_len);
+    }
+    if (snap_file) fclose(snap_file);
+
+    gr_face* pRes = NULL;
+    FileFace* pFileFace = new FileFace(filename, faceOptions & gr_face_mapFile);
+    if (*pFileFace)
+    {
+      pRes = gr_make_face_from_snapshot_with_ops(pFileFace, &FileFace::ops, snap, snap_len, faceOptions);
+      if (pRes)
+        pRes->takeFileFace(pFileFace);        //takes ownership
+    }
+    if (!pRes) delete pFileFace;
+
+    if (snap) FileFace::unmap_file(snap, snap_len);
+    return pRes;
+}
+
 #ifndef GRAPHITE2_NSEGCACHE
 gr_face* gr_make_file_face_with_seg_cache(const char* filename, unsigned int segCacheMaxSize, unsigned int faceOptions)   //returns NULL on failure. //TBD better error handling
                   //when finished with, call destroy_face
 {
-    FileFace* pFileFace = new FileFace(filename);
+    FileFace* pFileFace = new FileFace(filename, faceOptions & gr_face_mapFile);
     if (*pFileFace)
     {
       gr_face * pRes = gr_make_face_with_seg_cache_and_ops(pFileFace, &FileFace::ops, segCacheMaxSize, faceOptions);
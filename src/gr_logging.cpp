@@ -51,6 +51,7 @@ bool gr_start_logging(GR_MAYBE_UNUSED gr_face * face, const char *log_path)
     if (!log_path)  return false;
 
 #if !defined GRAPHITE2_NTRACING
+    if (face && !face->waitLoaded()) return false;
     gr_stop_logging(face);
 #if defined _WIN32
     int n = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, log_path, -1, 0, 0);
@@ -110,6 +111,7 @@ bool graphite_start_logging(FILE * /* log */, GrLogMask /* mask */)
 void gr_stop_logging(GR_MAYBE_UNUSED gr_face * face)
 {
 #if !defined GRAPHITE2_NTRACING
+    if (face) face->waitLoaded();
     if (face && face->logger())
     {
         FILE * log = face->logger()->stream();
@@ -25,27 +25,33 @@ License, as published by the Free Software Foundation, either version 2
 of the License or (at your option) any later version.
 */
 #include "graphite2/Segment.h"
+#include "inc/CmapCache.h"
 #include "inc/UtfCodec.h"
 #include "inc/Segment.h"
+#include "inc/Rule.h"
 
 using namespace graphite2;
 
 namespace 
 {
 
-  gr_segment* makeAndInitialize(const Font *font, const Face *face, uint32 script, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars, int dir)
+  // Shapes into pReuse if given, else into a new segment.
+  gr_segment* makeAndInitialize(const Font *font, const Face *face, uint32 script, const Features* pFeats/*must not be NULL*/, gr_encform enc, const void* pStart, size_t nChars, int dir, VMScratch & scratch, Segment * pReuse = 0)
   {
       if (script == 0x20202020) script = 0;
       else if ((script & 0x00FFFFFF) == 0x00202020) script = script & 0xFF000000;
       else if ((script & 0x0000FFFF) == 0x00002020) script = script & 0xFFFF0000;
       else if ((script & 0x000000FF) == 0x00000020) script = script & 0xFFFFFF00;
       // if (!font) return NULL;
-      Segment* pRes=new Segment(nChars, face, script, dir);
+      Segment* pRes = pReuse;
+      if (pRes)   pRes->reset(nChars, face, script, dir);
+      else        pRes = new Segment(nChars, face, script, dir);
+      if (!pRes)  return NULL;
 
-      
-      if (!pRes->read_text(face, pFeats, enc, pStart, nChars) || !pRes->runGraphite())
+      if (!*pRes || !pRes->read_text(face, pFeats, enc, pStart, nChars) || !pRes->runGraphite(scratch))
       {
-        delete pRes;
+        if (pReuse) pReuse->reset(0, face, script, dir);
+        else        delete pRes;
         return NULL;
       }
       pRes->finalise(font, true);
@@ -57,28 +63,52 @@ namespace
 }
 
 
-template <typename utf_iter>
-inline size_t count_unicode_chars(utf_iter first, const utf_iter last, const void **error)
+template <typename utf_type>
+inline size_t decode_unicode_chars(const void * first, const void * last, uint32 * usv, size_t max, const void **error)
 {
+    typedef typename utf_type::codeunit_t codeunit_t;
+    const codeunit_t * s = static_cast<const codeunit_t *>(first);
+    bool invalid = false;
+    const size_t n_chars = utf_type::decode(s, static_cast<const codeunit_t *>(last), usv, max, invalid);
+
+    if (error)  *error = invalid ? s : 0;
+    return n_chars;
+}
+
+template <typename utf_type>
+const void * first_unsupported(const Coverage & cov, const void * first, const void * last, size_t * count)
+{
+    typedef typename utf_type::codeunit_t codeunit_t;
+    const codeunit_t * s = static_cast<const codeunit_t *>(first),
+                     * const e = static_cast<const codeunit_t *>(last);
+    const size_t CHUNK = 64;
+    uint32 usv[CHUNK];
     size_t n_chars = 0;
-    uint32 usv = 0;
+    bool invalid = false;
 
-    if (last)
+    for (;;)
     {
-        for (;first != last; ++first, ++n_chars)
-            if ((usv = *first) == 0 || first.error()) break;
-    }
-    else
-    {
-        while ((usv = *first) != 0 && !first.error())
+        const codeunit_t * const chunk = s;
+        const size_t n = utf_type::decode(s, e, usv, CHUNK, invalid);
+        size_t i = 0;
+        while (i != n && cov[usv[i]]) ++i;
+        n_chars += i;
+        if (i != n)
+        {
+            // Step back to the unsupported character.
+            s = chunk;
+            utf_type::decode(s, e, 0, i, invalid);
+            break;
+        }
+        if (n != CHUNK)
         {
-            ++first;
-            ++n_chars;
+            if (!invalid) s = 0;
+            break;
         }
     }
 
-    if (error)  *error = first.error() ? first : 0;
-    return n_chars;
+    if (count)  *count = n_chars;
+    return s;
 }
 
 extern "C" {
@@ -89,23 +119,88 @@ size_t gr_count_unicode_characters(gr_encform enc, const void* buffer_begin, con
 
     switch (enc)
     {
-    case gr_utf8:   return count_unicode_chars<utf8::const_iterator>(buffer_begin, buffer_end, pError); break;
-    case gr_utf16:  return count_unicode_chars<utf16::const_iterator>(buffer_begin, buffer_end, pError); break;
-    case gr_utf32:  return count_unicode_chars<utf32::const_iterator>(buffer_begin, buffer_end, pError); break;
+    case gr_utf8:   return decode_unicode_chars<utf8>(buffer_begin, buffer_end, 0, size_t(-1), pError); break;
+    case gr_utf16:  return decode_unicode_chars<utf16>(buffer_begin, buffer_end, 0, size_t(-1), pError); break;
+    case gr_utf32:  return decode_unicode_chars<utf32>(buffer_begin, buffer_end, 0, size_t(-1), pError); break;
     default:        return 0;
     }
 }
 
 
+size_t gr_decode_unicode_characters(gr_encform enc, const void* buffer_begin, const void* buffer_end/*don't go on or past end, If NULL then ignored*/, gr_uint32 * usv, size_t usv_len, const void** pError)
+{
+    assert(buffer_begin);
+    assert(usv || !usv_len);
+
+    switch (enc)
+    {
+    case gr_utf8:   return decode_unicode_chars<utf8>(buffer_begin, buffer_end, usv, usv_len, pError); break;
+    case gr_utf16:  return decode_unicode_chars<utf16>(buffer_begin, buffer_end, usv, usv_len, pError); break;
+    case gr_utf32:  return decode_unicode_chars<utf32>(buffer_begin, buffer_end, usv, usv_len, pError); break;
+    default:        return 0;
+    }
+}
+
+
+const void* gr_coverage_first_unsupported(const gr_coverage* pCoverage, gr_encform enc, const void* buffer_begin, const void* buffer_end/*don't go on or past end, If NULL then ignored*/, size_t* pCount)
+{
+    assert(pCoverage);
+    assert(buffer_begin);
+
+    switch (enc)
+    {
+    case gr_utf8:   return first_unsupported<utf8>(*pCoverage, buffer_begin, buffer_end, pCount); break;
+    case gr_utf16:  return first_unsupported<utf16>(*pCoverage, buffer_begin, buffer_end, pCount); break;
+    case gr_utf32:  return first_unsupported<utf32>(*pCoverage, buffer_begin, buffer_end, pCount); break;
+    default:        if (pCount) *pCount = 0; return buffer_begin;
+    }
+}
+
+
 gr_segment* gr_make_seg(const gr_font *font, const gr_face *face, gr_uint32 script, const gr_feature_val* pFeats, gr_encform enc, const void* pStart, size_t nChars, int dir)
 {
-    const gr_feature_val * tmp_feats = 0;
+    if (!face->waitLoaded()) return 0;
     if (pFeats == 0)
-        pFeats = tmp_feats = static_cast<const gr_feature_val*>(face->theSill().cloneFeatures(0));
-    gr_segment * seg = makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir);
-    delete tmp_feats;
+        pFeats = static_cast<const gr_feature_val*>(&face->theSill().features(0));
+    VMScratch scratch(face->logger());
+    return makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir, scratch);
+}
+
 
-    return seg;
+gr_segment* gr_make_seg_into(gr_segment* pSeg, const gr_font *font, const gr_face *face, gr_uint32 script, const gr_feature_val* pFeats, gr_encform enc, const void* pStart, size_t nChars, int dir)
+{
+    if (!face->waitLoaded()) return 0;
+    if (pFeats == 0)
+        pFeats = static_cast<const gr_feature_val*>(&face->theSill().features(0));
+    VMScratch scratch(face->logger());
+    return makeAndInitialize(font, face, script, pFeats, enc, pStart, nChars, dir, scratch, pSeg);
+}
+
+
+size_t gr_make_segs(const gr_font *font, const gr_face *face, gr_uint32 script, const gr_feature_val* pFeats, gr_encform enc, const void* const* texts, const size_t* lens, size_t n, int dir, gr_segment** out)
+{
+    assert(out);
+    const bool loaded = face->waitLoaded();
+    // Resolve the settings once, so no string has to look them up or copy them.
+    const Features * feats = 0;
+    if (loaded)
+    {
+        if (pFeats == 0)
+            pFeats = static_cast<const gr_feature_val*>(&face->theSill().features(0));
+        feats = face->featureSets().intern(*pFeats);
+        if (!feats) feats = pFeats;
+    }
+    VMScratch scratch(face->logger());
+
+    size_t done = 0;
+    for (size_t i = 0; i != n; ++i)
+    {
+        gr_segment * const pSeg = loaded ? makeAndInitialize(font, face, script, feats, enc, texts[i], lens[i], dir, scratch, out[i]) : 0;
+        if (!pSeg)  delete out[i];
+        else        ++done;
+        out[i] = pSeg;
+    }
+    return done;
 }
 
 
@@ -160,6 +255,84 @@ const gr_slot* gr_seg_last_slot(gr_segment* pSeg/*not NULL*/)
     return static_cast<const gr_slot*>(pSeg->last());
 }
 
+size_t gr_seg_glyph_run(const gr_segment* pSeg/*not NULL*/, const gr_font *font, unsigned int flags, gr_glyph_run* pRun/*not NULL*/, size_t cap)
+{
+    assert(pSeg);
+    assert(pRun);
+    const GlyphCache & glyphs = pSeg->getFace()->glyphs();
+    const float scale = font ? font->scale() : 1.0f;
+    const bool hinted = font && font->isHinted();
+    size_t i = 0;
+    for (const Slot * s = const_cast<gr_segment *>(pSeg)->first(); s && i != cap; s = s->next(), ++i)
+    {
+        if (flags & gr_runGlyphs)
+            pRun->gids[i] = s->glyph();
+        if (flags & gr_runPositions)
+        {
+            pRun->x[i] = s->origin().x;
+            pRun->y[i] = s->origin().y;
+        }
+        if (flags & gr_runAdvances)
+            pRun->advances[i] = hinted ? (s->advance() - glyphs.glyph(s->gid())->theAdvance().x) * scale + font->advance(s->gid())
+                                       : s->advance() * scale;
+        if (flags & gr_runChars)
+        {
+            pRun->before[i] = s->before();
+            pRun->after[i] = s->after();
+        }
+        if (flags & gr_runAttachments)
+            pRun->attached[i] = s->attachedTo() ? int(s->attachedTo()->index()) : -1;
+    }
+    return pSeg->slotCount();
+}
+
+size_t gr_seg_char_map(const gr_segment* pSeg/*not NULL*/, int* before, int* after, size_t* base, int* breakweight, unsigned int* clusters)
+{
+    assert(pSeg);
+    const unsigned int n = pSeg->charInfoCount();
+    for (unsigned int i = 0; i != n; ++i)
+    {
+        const CharInfo & c = *pSeg->charinfo(i);
+        if (before)         before[i] = c.before();
+        if (after)          after[i] = c.after();
+        if (base)           base[i] = c.base();
+        if (breakweight)    breakweight[i] = c.breakWeight();
+    }
+    if (!clusters || !n) return 0;
+
+    // Walk the glyphs in character order, starting a new cluster at a glyph
+    //  that may be split from what came before and merging back any clusters
+    //  a glyph reaches into.
+    Segment & seg = *const_cast<gr_segment *>(pSeg);
+    const bool backwards = seg.first() && seg.first()->before() > seg.last()->before();
+    unsigned int * cl = clusters, first_char = 0;
+    cl[0] = cl[1] = 0;
+    for (const Slot * s = backwards ? seg.last() : seg.first(); s; s = backwards ? s->prev() : s->next())
+    {
+        const unsigned int b = s->before(), a = s->after();
+        while (cl != clusters && b < first_char)
+        {
+            cl -= 2;
+            first_char -= cl[0];
+            cl[0] += cl[2];
+            cl[1] += cl[3];
+        }
+        if (s->isInsertBefore() && cl[0] && b >= first_char + cl[0])
+        {
+            first_char += cl[0];
+            cl += 2;
+            cl[0] = cl[1] = 0;
+        }
+        ++cl[1];
+        if (first_char + cl[0] < a + 1)
+            cl[0] = a + 1 - first_char;
+    }
+    // Characters with no glyph of their own after the last cluster join it.
+    if (first_char + cl[0] < n)
+        cl[0] = n - first_char;
+    return (cl - clusters) / 2 + 1;
+}
+
 float gr_seg_justify(gr_segment* pSeg/*not NULL*/, const gr_slot* pSlot/*not NULL*/, const gr_font *pFont, double width, enum gr_justFlags flags, const gr_slot *pFirst, const gr_slot *pLast)
 {
     assert(pSeg);
@@ -0,0 +1,62 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#pragma once
+
+#include "inc/Main.h"
+
+namespace graphite2 {
+
+// A bump allocator that may be allocated from by several threads at once.
+// Memory is only returned when the arena is destroyed, objects placed in it
+// must have their destructors called by the owner if they need them.
+class Arena
+{
+    struct block;
+
+    block * volatile    _current,
+          * volatile    _large;
+
+    Arena(const Arena &);
+    Arena & operator = (const Arena &);
+
+    void release() throw();
+
+public:
+    Arena() throw() : _current(0), _large(0) {}
+    ~Arena() throw();
+
+    void * allocate(size_t n) throw();
+
+    // Forgets everything allocated, keeping one block big enough for it all
+    //  so the same again needs no more memory. Must not be called while
+    //  anything else allocates from the arena.
+    void reset() throw();
+
+    CLASS_NEW_DELETE;
+};
+
+} // namespace graphite2
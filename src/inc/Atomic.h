@@ -0,0 +1,281 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#pragma once
+
+// Minimal atomic operations for the few places that need to be safe when a
+// face is shared between threads. Only what graphite needs is provided.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#pragma intrinsic(_InterlockedCompareExchange, _InterlockedExchangeAdd, _InterlockedCompareExchangePointer, _ReadWriteBarrier)
+#if defined(_M_ARM) || defined(_M_ARM64)
+#pragma intrinsic(__dmb, __iso_volatile_load16, __iso_volatile_store16, __iso_volatile_load32, __iso_volatile_store32)
+#endif
+#if defined(_M_ARM64)
+#pragma intrinsic(__iso_volatile_load64)
+#endif
+#endif
+
+#include "inc/Main.h"
+
+namespace graphite2 {
+
+namespace atomic {
+
+#if defined(_MSC_VER)
+#if defined(_M_ARM) || defined(_M_ARM64)
+// Volatile accesses are not ordered here, so loads are followed and stores
+// preceded by a full barrier across the inner shareable domain (ISH).
+inline void    fence() throw()                             { __dmb(0xB); }
+inline __int16 load16(const volatile void * v) throw()      { return __iso_volatile_load16(static_cast<const volatile __int16 *>(v)); }
+inline void    store16(volatile void * v, __int16 x) throw() { __iso_volatile_store16(static_cast<volatile __int16 *>(v), x); }
+inline __int32 load32(const volatile void * v) throw()      { return __iso_volatile_load32(static_cast<const volatile __int32 *>(v)); }
+inline void    store32(volatile void * v, __int32 x) throw() { __iso_volatile_store32(static_cast<volatile __int32 *>(v), x); }
+#else
+// x86 and x64 keep loads and stores in order, so only the compiler needs
+// stopping from moving them.
+inline void    fence() throw()                             { _ReadWriteBarrier(); }
+inline __int16 load16(const volatile void * v) throw()      { return *static_cast<const volatile __int16 *>(v); }
+inline void    store16(volatile void * v, __int16 x) throw() { *static_cast<volatile __int16 *>(v) = x; }
+inline __int32 load32(const volatile void * v) throw()      { return *static_cast<const volatile __int32 *>(v); }
+inline void    store32(volatile void * v, __int32 x) throw() { *static_cast<volatile __int32 *>(v) = x; }
+#endif
+
+inline long load(const volatile long & v) throw()
+{
+    const long r = load32(&v);
+    fence();
+    return r;
+}
+
+inline void store(volatile long & v, long x) throw()
+{
+    fence();
+    store32(&v, x);
+}
+
+inline bool compare_exchange(volatile long & v, long expected, long desired) throw()
+{
+    return _InterlockedCompareExchange(&v, desired, expected) == expected;
+}
+
+inline long fetch_add(volatile long & v, long x) throw()
+{
+    return _InterlockedExchangeAdd(&v, x);
+}
+
+inline uint16 load(const volatile uint16 & v) throw()
+{
+    const uint16 r = uint16(load16(&v));
+    fence();
+    return r;
+}
+
+inline void store(volatile uint16 & v, uint16 x) throw()
+{
+    fence();
+    store16(&v, __int16(x));
+}
+
+inline uint32 load(const volatile uint32 & v) throw()
+{
+    const uint32 r = uint32(load32(&v));
+    fence();
+    return r;
+}
+
+inline void store(volatile uint32 & v, uint32 x) throw()
+{
+    fence();
+    store32(&v, __int32(x));
+}
+
+template<typename T>
+inline T * load(T * const volatile & p) throw()
+{
+#if defined(_M_ARM64)
+    T * const r = reinterpret_cast<T *>(__iso_volatile_load64(reinterpret_cast<const volatile __int64 *>(&p)));
+#else
+    T * const r = p;
+#endif
+    fence();
+    return r;
+}
+
+template<typename T>
+inline bool compare_exchange(T * volatile & p, T * expected, T * desired) throw()
+{
+    return _InterlockedCompareExchangePointer((void * volatile *)&p, (void *)desired, (void *)expected) == (void *)expected;
+}
+#elif defined(__ATOMIC_ACQUIRE)
+inline long load(const volatile long & v) throw()
+{
+    return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+}
+
+inline void store(volatile long & v, long x) throw()
+{
+    __atomic_store_n(&v, x, __ATOMIC_RELEASE);
+}
+
+inline bool compare_exchange(volatile long & v, long expected, long desired) throw()
+{
+    return __atomic_compare_exchange_n(&v, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+inline long fetch_add(volatile long & v, long x) throw()
+{
+    return __atomic_fetch_add(&v, x, __ATOMIC_ACQ_REL);
+}
+
+inline uint16 load(const volatile uint16 & v) throw()
+{
+    return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+}
+
+inline void store(volatile uint16 & v, uint16 x) throw()
+{
+    __atomic_store_n(&v, x, __ATOMIC_RELEASE);
+}
+
+inline uint32 load(const volatile uint32 & v) throw()
+{
+    return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+}
+
+inline void store(volatile uint32 & v, uint32 x) throw()
+{
+    __atomic_store_n(&v, x, __ATOMIC_RELEASE);
+}
+
+template<typename T>
+inline T * load(T * const volatile & p) throw()
+{
+    return __atomic_load_n(&p, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+inline bool compare_exchange(T * volatile & p, T * expected, T * desired) throw()
+{
+    return __atomic_compare_exchange_n(&p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#else
+inline long load(const volatile long & v) throw()
+{
+    const long r = v;
+    __sync_synchronize();
+    return r;
+}
+
+inline void store(volatile long & v, long x) throw()
+{
+    __sync_synchronize();
+    v = x;
+}
+
+inline bool compare_exchange(volatile long & v, long expected, long desired) throw()
+{
+    return __sync_bool_compare_and_swap(&v, expected, desired);
+}
+
+inline long fetch_add(volatile long & v, long x) throw()
+{
+    return __sync_fetch_and_add(&v, x);
+}
+
+inline uint16 load(const volatile uint16 & v) throw()
+{
+    const uint16 r = v;
+    __sync_synchronize();
+    return r;
+}
+
+inline void store(volatile uint16 & v, uint16 x) throw()
+{
+    __sync_synchronize();
+    v = x;
+}
+
+inline uint32 load(const volatile uint32 & v) throw()
+{
+    const uint32 r = v;
+    __sync_synchronize();
+    return r;
+}
+
+inline void store(volatile uint32 & v, uint32 x) throw()
+{
+    __sync_synchronize();
+    v = x;
+}
+
+template<typename T>
+inline T * load(T * const volatile & p) throw()
+{
+    T * const r = p;
+    __sync_synchronize();
+    return r;
+}
+
+template<typename T>
+inline bool compare_exchange(T * volatile & p, T * expected, T * desired) throw()
+{
+    return __sync_bool_compare_and_swap(&p, expected, desired);
+}
+#endif
+
+} // namespace atomic
+
+
+// A lock for short, rarely contended critical sections such as one time
+// initialisation of face data.
+class SpinLock
+{
+    volatile long _held;
+
+    SpinLock(const SpinLock &);
+    SpinLock & operator = (const SpinLock &);
+
+public:
+    SpinLock() throw() : _held(0) {}
+
+    void lock() throw()     { while (!atomic::compare_exchange(_held, 0, 1)) while (atomic::load(_held)) {} }
+    void unlock() throw()   { atomic::store(_held, 0); }
+
+    class holder
+    {
+        SpinLock & _lock;
+
+        holder(const holder &);
+        holder & operator = (const holder &);
+    public:
+        holder(SpinLock & l) throw() : _lock(l) { _lock.lock(); }
+        ~holder() throw()                       { _lock.unlock(); }
+    };
+};
+
+} // namespace graphite2
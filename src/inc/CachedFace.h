@@ -44,7 +44,7 @@ public:
     CachedFace(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops);
     bool setupCache(unsigned int cacheSize);
     virtual ~CachedFace();
-    virtual bool runGraphite(Segment *seg, const Silf *silf) const;
+    virtual bool runGraphite(Segment *seg, const Silf *silf, VMScratch & scratch) const;
     SegCacheStore * cacheStore() { return m_cacheStore; }
 private:
     SegCacheStore * m_cacheStore;
@@ -32,6 +32,7 @@ of the License or (at your option) any later version.
 namespace graphite2 {
 
 class Face;
+class Silf;
 
 class Cmap
 {
@@ -41,8 +42,15 @@ public:
 
     virtual uint16 operator [] (const uint32) const throw() { return 0; }
 
+    // Maps n code points at once, writing 0 for any that are not in the cmap.
+    virtual void map(const uint32 * usv, uint16 * gids, size_t n) const throw();
+
     virtual operator bool () const throw() { return false; }
 
+    // Memory a cache may grow to, and currently uses.
+    virtual void   budget(size_t) throw() {}
+    virtual size_t footprint() const throw() { return 0; }
+
     CLASS_NEW_DELETE;
 };
 
@@ -53,16 +61,39 @@ class DirectCmap : public Cmap
 
 public:
     DirectCmap(const Face &);
+    virtual ~DirectCmap() throw();
     virtual uint16 operator [] (const uint32 usv) const throw();
+    virtual void map(const uint32 * usv, uint16 * gids, size_t n) const throw();
     virtual operator bool () const throw();
 
     CLASS_NEW_DELETE;
 private:
+    struct Segment;
+
+    bool                index() throw();
+    size_t              place(const uint16 * ends, size_t i, size_t k) throw();
+    uint16              lookup(uint32 usv) const throw();
+    uint16              bmpLookup(uint32 usv) const throw();
+    uint16              smpLookup(uint32 usv) const throw();
+
     const Face::Table   _cmap;
     const void        * _smp,
                       * _bmp;
+    // A native endian index of the subtable 4 segments, searched in place of
+    //  it, with the first 256 characters looked up in advance.
+    uint16            * _ends;      // segment end codes in Eytzinger order, from 1
+    Segment           * _segs;      // in the same order as _ends
+    uint16            * _latin;
+    size_t              _num_segs;
+    uint32              _num_groups;    // of the subtable 12, if they are in order
 };
 
+// Caches the cmap a page of 256 characters at a time, each page filled the
+//  first time a character in it is looked up. A page keeps only the run from
+//  its first to its last mapped character, or nothing but a delta if that run
+//  maps to consecutive glyphs. Pages, or plane page tables, past the budget
+//  are not kept and their characters are looked up in the cmap table instead,
+//  until the budget is next set.
 class CachedCmap : public Cmap
 {
     CachedCmap(const CachedCmap &);
@@ -72,11 +103,62 @@ public:
     CachedCmap(const Face &);
     virtual ~CachedCmap() throw();
     virtual uint16 operator [] (const uint32 usv) const throw();
+    virtual void map(const uint32 * usv, uint16 * gids, size_t n) const throw();
     virtual operator bool () const throw();
+    virtual void   budget(size_t bytes) throw();
+    virtual size_t footprint() const throw();
+    CLASS_NEW_DELETE;
+private:
+    struct Page;
+    typedef const Page * volatile   page_ref;
+
+    static const Page   empty_page,     // shared by every page with nothing mapped
+                        uncached_page;  // stands in for pages past the budget
+
+    const Page        * page(uint32 block) const throw();
+    const Page        * fill(uint32 block) const throw();
+    uint16              lookup(uint32 usv) const throw();
+
+    const Face::Table   _cmap;
+    const void        * _smp,
+                      * _bmp;
+    const uint32        _limit;
+    mutable page_ref  * volatile _planes[0x11];     // 256 pages each, on demand
+    mutable volatile long   _footprint;
+    volatile long           _budget;
+};
+
+// The characters a face supports, through its cmap or as a pseudo glyph of
+//  any of its silf subtables, built once and never changed. A bitmap for each
+//  block of 256 characters, with the blocks that are all in or all out shared.
+class Coverage
+{
+    Coverage(const Coverage &);
+    Coverage & operator = (const Coverage &);
+
+public:
+    Coverage(const Face & face, const Silf * silfs, uint16 num_silfs);
+    ~Coverage() throw();
+    bool operator [] (const uint32 usv) const throw();
+    operator bool () const throw() { return _blocks != 0; }
+
     CLASS_NEW_DELETE;
 private:
-    bool m_isBmpOnly;
-    uint16 ** m_blocks;
+    static const uint32 full_block[8];
+
+    const uint32 * const  * _planes[0x11];  // 256 blocks each, or none if empty
+    const uint32         ** _blocks;        // null for a block that is empty
+    uint32                * _bits;
 };
 
+inline
+bool Coverage::operator [] (const uint32 usv) const throw()
+{
+    const uint32 * const * const blocks = usv <= 0x10FFFF ? _planes[usv >> 16] : 0;
+    const uint32 * const block = blocks ? blocks[(usv >> 8) & 0xFF] : 0;
+    return block && (block[(usv >> 5) & 7] >> (usv & 0x1F) & 1);
+}
+
 } // namespace graphite2
+
+struct gr_coverage : public graphite2::Coverage {};
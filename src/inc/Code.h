@@ -40,6 +40,8 @@ namespace graphite2 {
 
 class Silf;
 class Face;
+class SnapshotWriter;
+class SnapshotReader;
 
 enum passtype {
     PASS_TYPE_UNKNOWN = 0,
@@ -104,7 +106,10 @@ public:
     bool          immutable() const throw()         { return !(_delete || _modify); }
     bool          deletes() const throw()           { return _delete; }
     size_t        maxRef() const throw()            { return _max_ref; }
+    size_t        programSize() const throw();
     void          externalProgramMoved(ptrdiff_t) throw();
+    bool          writeSnapshot(SnapshotWriter &, const byte * pool, byte * pool_image) const throw();
+    bool          readSnapshot(SnapshotReader &, byte * pool, size_t pool_size) throw();
 
     int32 run(Machine &m, slotref * & map) const;
     
@@ -49,52 +49,54 @@ typedef uint64_t u64;
 
 ptrdiff_t const     MINMATCH  = 4;
 
+// Block copies may write this far past their end and read as far past their
+//  source, so are only used where the buffers allow.
+size_t const        WILDCOPY  = 32;
+
 template<int S>
 inline 
 void unaligned_copy(void * d, void const * s) {
   ::memcpy(d, s, S);
 }
 
-inline
-size_t align(size_t p) {
-    return (p + sizeof(unsigned long)-1) & ~(sizeof(unsigned long)-1);
-}
-
 inline 
 u8 * safe_copy(u8 * d, u8 const * s, size_t n) {
     while (n--) *d++ = *s++;
     return d;
 }
 
+// Copies n bytes in blocks of B, overrunning by up to B-1 bytes. The source
+//  may overlap the destination only if it is at least B bytes behind it.
+template<int B>
 inline
-u8 * overrun_copy(u8 * d, u8 const * s, size_t n) {
-    size_t const WS = sizeof(unsigned long);
-    u8 const * e = s + n;
-    do 
+u8 * wild_copy(u8 * d, u8 const * s, size_t n) {
+    u8 * const e = d + n;
+    do
     {
-        unaligned_copy<WS>(d, s);
-        d += WS;
-        s += WS;
+        unaligned_copy<B>(d, s);
+        d += B;
+        s += B;
     }
-    while (s < e);
-    d-=(s-e);
+    while (d < e);
     
-    return d;
+    return e;
 }
 
-
+// Repeats the dist bytes before d until n bytes have been written. The
+//  pattern is copied byte by byte up to a whole number of repeats at least
+//  16 bytes long, after which 16 byte blocks can copy it from that far back.
 inline
-u8 * fast_copy(u8 * d, u8 const * s, size_t n) {
-    size_t const WS = sizeof(unsigned long);
-    size_t wn = n/WS;
-    while (wn--) 
-    {
-        unaligned_copy<WS>(d, s);
-        d += WS;
-        s += WS;
-    }
-    n &= WS-1;
-    return safe_copy(d, s, n);
+u8 * pattern_copy(u8 * d, size_t dist, size_t n) {
+    static u8 const step_for[16] = { 0, 16, 16, 18, 16, 20, 18, 21,
+                                     16, 18, 20, 22, 24, 26, 28, 30 };
+    assert(dist > 0 && dist < 16);
+    size_t const step = step_for[dist];
+    if (n <= step)
+        return safe_copy(d, d - dist, n);
+    
+    u8 * const e = d + n;
+    d = safe_copy(d, d - dist, step);
+    return wild_copy<16>(d, d - step, e - d);
 }
 
 
@@ -53,7 +53,8 @@ enum errcontext {
     EC_ARULE = 6,           // in Silf %d, pass %d, rule %d
     EC_ASTARTS = 7,         // in Silf %d, pass %d, start state %d
     EC_ATRANS = 8,          // in Silf %d, pass %d, fsm state %d
-    EC_ARULEMAP = 9         // in Silf %d, pass %d, state %d
+    EC_ARULEMAP = 9,        // in Silf %d, pass %d, state %d
+    EC_READSNAPSHOT = 10    // in a face snapshot
 };
 
 enum errors {
@@ -129,6 +130,8 @@ enum errors {
 // Compression errors
     E_BADSCHEME = 69,
     E_SHRINKERFAILED = 70,
+// Snapshot errors
+    E_BADSNAPSHOT = 71,     // A face snapshot is damaged or does not match the library
 };
 
 }
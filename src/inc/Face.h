@@ -35,15 +35,21 @@ of the License or (at your option) any later version.
 #include "inc/TtfUtil.h"
 #include "inc/Silf.h"
 #include "inc/Error.h"
+#include "inc/Atomic.h"
+#include "inc/Thread.h"
 
 namespace graphite2 {
 
+class AdvanceCache;
 class Cmap;
+class Coverage;
 class FileFace;
 class GlyphCache;
 class NameTable;
 class json;
 class Font;
+class MemoryFace;
+class SnapshotReader;
 
 
 using TtfUtil::Tag;
@@ -58,22 +64,38 @@ class Face
 
 public:
     class Table;
+    struct TableEntry;
     static float default_glyph_advance(const void* face_ptr, gr_uint16 glyphid);
 
     Face(const void* appFaceHandle/*non-NULL*/, const gr_face_ops & ops);
     virtual ~Face();
 
-    virtual bool        runGraphite(Segment *seg, const Silf *silf) const;
+    virtual bool        runGraphite(Segment *seg, const Silf *silf, VMScratch & scratch) const;
 
 public:
     bool                readGlyphs(uint32 faceOptions);
-    bool                readGraphite(const Table & silf);
+    bool                readGraphite(const Table & silf, uint32 faceOptions = 0);
     bool                readFeatures();
     void                takeFileFace(FileFace* pFileFace/*takes ownership*/);
+    void                takeMemoryFace(MemoryFace* pMemoryFace/*takes ownership*/);
+
+    // Loading in the background. Until a face has loaded everything but
+    //  waitLoaded() must be assumed to be missing. waitLoaded() waits for the
+    //  whole face, but not for any callback run once loading is done.
+    bool                loadInBackground(parallel::task load, void * data);
+    void                loaded(bool ok);
+    bool                waitLoaded() const;
+    bool                loading() const;
+
+    // Snapshots
+    size_t              snapshot(byte * buf, size_t len) const;
+    bool                matchSnapshot(SnapshotReader & snap) const;
+    bool                readSnapshot(SnapshotReader & snap, uint32 faceOptions);
 
     const SillMap     & theSill() const;
     const GlyphCache  & glyphs() const;
     Cmap              & cmap() const;
+    const Coverage    * coverage() const;
     NameTable         * nameTable() const;
     void                setLogger(FILE *log_file);
     json              * logger() const throw();
@@ -85,6 +107,7 @@ public:
     uint16              numFeatures() const;
     const FeatureRef  * featureById(uint32 id) const;
     const FeatureRef  * feature(uint16 index) const;
+    FeatureSets       & featureSets() const { return m_featureSets; }
 
     // Glyph related
     int32  getGlyphMetric(uint16 gid, uint8 metric) const;
@@ -96,18 +119,43 @@ public:
     unsigned int        error_context() const { return m_error; }
     void                error_context(unsigned int errcntxt) { m_errcntxt = errcntxt; }
 
+    // Release cached tables no Table refers to any more.
+    void                trimTables() const;
+
+    // The unhinted advance cache shared by all fonts of this face at ppm,
+    //  held until released by each font that asked for it.
+    const AdvanceCache* advanceCache(float ppm) const;
+    void                releaseAdvanceCache(const AdvanceCache * c) const;
+
     CLASS_NEW_DELETE;
 private:
+    enum { LOAD_DONE, LOAD_PENDING, LOAD_FAILED };
+
+    uint32              fingerprint() const;
+    void                denseGlyphAttrs();
+    TableEntry      * openTable(const Tag n, uint32 version) const;
+    TableEntry      * findTable(const Tag n, uint32 version) const;
+
+    mutable FeatureSets     m_featureSets;      // interned feature values
     SillMap                 m_Sill;
     gr_face_ops             m_ops;
     const void            * m_appFaceHandle;    // non-NULL
     FileFace              * m_pFileFace;        //owned
+    MemoryFace            * m_pMemoryFace;      //owned
     mutable GlyphCache    * m_pGlyphFaceCache;  // owned - never NULL
     mutable Cmap          * m_cmap;             // cmap cache if available
+    mutable Coverage      * volatile m_coverage; // owned - built on first use
     mutable NameTable     * m_pNames;
     mutable json          * m_logger;
     unsigned int            m_error;
     unsigned int            m_errcntxt;
+    mutable TableEntry  * m_tables;           // owned - cached font tables
+    mutable SpinLock        m_tableLock;
+    Table                 * m_pSilfTable;       // owned - only held for lazily read passes
+    mutable AdvanceCache  * m_advanceCaches;    // owned - one per ppm in use
+    mutable SpinLock        m_advanceLock;
+    parallel::Background    m_loader;           // only for faces loaded in the background
+    volatile long           m_loadState;
 protected:
     Silf                  * m_silfs;    // silf subtables.
     uint16                  m_numSilf;  // num silf subtables in the silf table
@@ -166,17 +214,30 @@ json * Face::logger() const throw()
 
 
 
-class Face::Table
+// A font table as fetched from the application, checked and, if need be,
+// decompressed. Each is made once per face and kept until the face is trimmed
+// or destroyed.
+struct Face::TableEntry
 {
-    const Face *            _f;
-    mutable const byte *    _p;
-    uint32                  _sz;
-    bool                    _compressed;
-
-    Error decompress();
+    const byte    * p;
+    uint32          sz;
+    const Tag       tag;
+    const uint32    version;    // decompress from this table version on
+    volatile long   refs;
+    bool            compressed;
+    TableEntry    * next;
+
+    TableEntry(const Tag n, uint32 v) throw();
+    void  load(const Face & face) throw();
+    void  release(const Face & face) throw();
+    Error decompress(const Face & face) throw();
 
-    void releaseBuffers();
+    CLASS_NEW_DELETE;
+};
 
+// A reference counted view of a face's cached font table.
+class Face::Table
+{
 public:
     Table() throw();
     Table(const Face & face, const Tag n, uint32 version=0xffffffff) throw();
@@ -187,37 +248,41 @@ public:
 
     Table & operator = (const Table & rhs) throw();
     size_t  size() const throw();
+
+    CLASS_NEW_DELETE;
+private:
+    TableEntry * _e;
 };
 
 inline
 Face::Table::Table() throw()
-: _f(0), _p(0), _sz(0), _compressed(false)
+: _e(0)
 {
 }
 
 inline
 Face::Table::Table(const Table & rhs) throw()
-: _f(rhs._f), _p(rhs._p), _sz(rhs._sz), _compressed(rhs._compressed)
+: _e(rhs._e)
 {
-    rhs._p = 0;
+    if (_e) atomic::fetch_add(_e->refs, 1);
 }
 
 inline
 Face::Table::~Table() throw()
 {
-    releaseBuffers();
+    if (_e) atomic::fetch_add(_e->refs, -1);
 }
 
 inline
 Face::Table::operator const byte * () const throw()
 {
-    return _p;
+    return _e ? _e->p : 0;
 }
 
 inline
 size_t  Face::Table::size() const throw()
 {
-    return _sz;
+    return _e ? _e->sz : 0;
 }
 
 } // namespace graphite2
@@ -26,6 +26,7 @@ of the License or (at your option) any later version.
 */
 #pragma once
 #include "inc/Main.h"
+#include "inc/Atomic.h"
 #include "inc/FeatureVal.h"
 
 namespace graphite2 {
@@ -152,6 +153,45 @@ private:        //defensive on m_feats, m_pNamedFeats, and m_defaultFeatures
 };
 
 
+// Interns the feature values used with a face. Equal values intern to the
+//  same immutable FeatureVal, so they can be shared and compared by
+//  identity, and each gets a hash. Interned values live as long as the
+//  FeatureSets. Finding values already interned takes no lock, only adding
+//  new ones does.
+class FeatureSets
+{
+    FeatureSets(const FeatureSets &);
+    FeatureSets & operator = (const FeatureSets &);
+
+public:
+    // Past this many sets only those the face itself reads are added, so
+    //  shaping with ever changing values can't grow a face without bound.
+    static const size_t MAX_SETS = 1024;
+
+    FeatureSets() : m_table(0), m_count(0) {}
+    ~FeatureSets();
+
+    // Returns the interned copy of feats, or NULL if out of memory or if
+    //  MAX_SETS are interned already and feats isn't one of them, unless
+    //  always is set.
+    const FeatureVal * intern(const FeatureVal & feats, bool always = false);
+    size_t count() const { return m_count; }
+
+    static uint32 hash(const FeatureVal & feats);
+
+    CLASS_NEW_DELETE
+private:
+    struct Table;
+
+    static const FeatureVal * find(const Table * t, const FeatureVal & feats, uint32 h);
+    bool grow();
+
+    Table * volatile    m_table;    // open addressed by hash, replaced as it grows
+    size_t              m_count;
+    SpinLock            m_lock;     // held to add a set
+};
+
+
 class SillMap
 {
 private:
@@ -162,17 +202,24 @@ private:
 
     public:
         LangFeaturePair() :  m_lang(0), m_pFeatures(0) {}
-        ~LangFeaturePair() { delete m_pFeatures; }
-        
+
         uint32 m_lang;
-        Features* m_pFeatures;      //owns
+        const Features* m_pFeatures;    //interned
         CLASS_NEW_DELETE
     };
+
+    // Languages in tag order, one per tag, for binary searching.
+    struct LangIndex
+    {
+        uint32 m_lang;
+        uint16 m_index;             // into m_langFeats
+    };
 public:
-    SillMap() : m_langFeats(NULL), m_numLanguages(0) {}
-    ~SillMap() { delete[] m_langFeats; }
+    SillMap() : m_default(NULL), m_langFeats(NULL), m_langIndex(NULL), m_numLanguages(0), m_numIndexed(0) {}
+    ~SillMap() { delete[] m_langFeats; free(m_langIndex); }
     bool readFace(const Face & face);
     bool readSill(const Face & face);
+    const Features & features(uint32 langname/*0 means default*/) const;    //interned once read
     FeatureVal* cloneFeatures(uint32 langname/*0 means default*/) const;      //call destroy_Features when done.
     uint16 numLanguages() const { return m_numLanguages; };
     uint32 getLangName(uint16 index) const { return (index < m_numLanguages)? m_langFeats[index].m_lang : 0; };
@@ -180,8 +227,11 @@ public:
     const FeatureMap & theFeatureMap() const { return m_FeatureMap; };
 private:
     FeatureMap m_FeatureMap;        //of face
+    const Features  * m_default;    //interned
     LangFeaturePair * m_langFeats;
-    uint16 m_numLanguages;
+    LangIndex       * m_langIndex;
+    uint16 m_numLanguages,
+           m_numIndexed;
 
 private:        //defensive on m_langFeats
     SillMap(const SillMap&);
@@ -34,16 +34,22 @@ namespace graphite2 {
 
 class FeatureRef;
 class FeatureMap;
+class FeatureSets;
 
 class FeatureVal : public Vector<uint32>
 {
 public:
-    FeatureVal() : m_pMap(0) { }
-    FeatureVal(int num, const FeatureMap & pMap) : Vector<uint32>(num), m_pMap(&pMap) {}
-    FeatureVal(const FeatureVal & rhs) : Vector<uint32>(rhs), m_pMap(rhs.m_pMap) {}
+    FeatureVal() : m_pMap(0), m_pSets(0), m_hash(0) { }
+    FeatureVal(int num, const FeatureMap & pMap) : Vector<uint32>(num), m_pMap(&pMap), m_pSets(0), m_hash(0) {}
+    FeatureVal(const FeatureVal & rhs) : Vector<uint32>(rhs), m_pMap(rhs.m_pMap), m_pSets(0), m_hash(0) {}
 
     FeatureVal & operator = (const FeatureVal & rhs) { Vector<uint32>::operator = (rhs); m_pMap = rhs.m_pMap; return *this; }
 
+    // Interned values are immutable and shared: equal values interned by the
+    //  same FeatureSets are the same object, with a hash.
+    const FeatureSets * interned() const { return m_pSets; }
+    uint32 hash() const { return m_hash; }
+
     bool operator ==(const FeatureVal & b) const
     {
         size_t n = size();
@@ -57,7 +63,10 @@ public:
     CLASS_NEW_DELETE
 private:
     friend class FeatureRef;        //so that FeatureRefs can manipulate m_vec directly
+    friend class FeatureSets;
     const FeatureMap* m_pMap;
+    const FeatureSets * m_pSets;    // that interned these values, if any
+    uint32 m_hash;
 };
 
 typedef FeatureVal Features;
@@ -51,16 +51,20 @@ class FileFace
 
 public:
     static const gr_face_ops ops;
+    static const byte * map_file(FILE * file, size_t len);
+    static void         unmap_file(const byte * map, size_t len);
 
-    FileFace(const char *filename);
+    FileFace(const char *filename, bool map_file=false);
     ~FileFace();
 
     operator bool () const throw();
+    bool mapped() const throw() { return _map != 0; }
     CLASS_NEW_DELETE;
 
 private:        //defensive
     FILE          * _file;
     size_t          _file_len;
+    const byte    * _map;           // read-only view of the whole file, if mapped
 
     TtfUtil::Sfnt::OffsetSubTable         * _header_tbl;
     TtfUtil::Sfnt::OffsetSubTable::Entry  * _table_dir;
@@ -72,7 +76,7 @@ private:        //defensive
 inline
 FileFace::operator bool() const throw()
 {
-    return _file && _header_tbl && _table_dir;
+    return (_file || _map) && _header_tbl && _table_dir;
 }
 
 } // namespace graphite2
@@ -28,12 +28,69 @@ of the License or (at your option) any later version.
 #include <cassert>
 #include "graphite2/Font.h"
 #include "inc/Main.h"
+#include "inc/Atomic.h"
 #include "inc/Face.h"
 
 namespace graphite2 {
 
 #define INVALID_ADVANCE -1e38f      // can't be a static const because non-integral
 
+// Per glyph advances for one ppm, filled on demand. Pages are allocated the
+// first time a glyph in them is asked for and published atomically, so any
+// number of threads may fill the same cache without locking.
+class AdvanceCache
+{
+public:
+    AdvanceCache(uint16 num_glyphs, float ppm);
+    ~AdvanceCache();
+
+    bool    get(uint16 gid, float & advance) const throw();
+    void    set(uint16 gid, float advance) const throw();
+    float   ppm() const throw()             { return _ppm; }
+    operator bool () const throw()          { return _pages != 0; }
+
+    AdvanceCache  * next;   // chains the caches a face shares between fonts
+    long            refs;   // fonts sharing this cache, counted under the face's lock
+
+    CLASS_NEW_DELETE;
+private:
+    enum { PAGE_BITS = 7, PAGE_SIZE = 1 << PAGE_BITS };
+    static const uint32 EMPTY = 0xFFFFFFFF;   // a NaN no advance function returns
+
+    uint32 * page(uint16 gid) const throw();
+
+    uint32 * volatile * _pages;
+    const uint16        _num_glyphs;
+    const float         _ppm;
+
+    AdvanceCache(const AdvanceCache&);
+    AdvanceCache& operator=(const AdvanceCache&);
+};
+
+inline
+bool AdvanceCache::get(uint16 gid, float & advance) const throw()
+{
+    if (gid >= _num_glyphs) return false;
+    const uint32 * const p = atomic::load(_pages[gid >> PAGE_BITS]);
+    if (!p) return false;
+    const uint32 bits = atomic::load(p[gid & (PAGE_SIZE - 1)]);
+    if (bits == EMPTY) return false;
+    memcpy(&advance, &bits, sizeof advance);
+    return true;
+}
+
+inline
+void AdvanceCache::set(uint16 gid, float advance) const throw()
+{
+    if (gid >= _num_glyphs) return;
+    uint32 * const p = page(gid);
+    if (!p) return;
+    uint32 bits;
+    memcpy(&bits, &advance, sizeof bits);
+    atomic::store(p[gid & (PAGE_SIZE - 1)], bits);
+}
+
+
 class Font
 {
 public:
@@ -44,12 +101,13 @@ public:
     float scale() const;
     bool isHinted() const;
     const Face & face() const;
+    operator bool () const throw()  { return m_advances && *m_advances; }
 
     CLASS_NEW_DELETE;
 private:
     gr_font_ops         m_ops;
     const void  * const m_appFontHandle;
-    float             * m_advances;  // One advance per glyph in pixels. Nan if not defined
+    const AdvanceCache* m_advances;   // One advance per glyph in pixels, shared between unhinted fonts of a face
     const Face        & m_face;
     float               m_scale;      // scales from design units to ppm
     bool                m_hinted;
@@ -61,9 +119,13 @@ private:
 inline
 float Font::advance(unsigned short glyphid) const
 {
-    if (m_advances[glyphid] == INVALID_ADVANCE)
-        m_advances[glyphid] = (*m_ops.glyph_advance_x)(m_appFontHandle, glyphid);
-    return m_advances[glyphid];
+    float adv;
+    if (!m_advances->get(glyphid, adv))
+    {
+        adv = (*m_ops.glyph_advance_x)(m_appFontHandle, glyphid);
+        m_advances->set(glyphid, adv);
+    }
+    return adv;
 }
 
 inline
@@ -29,6 +29,8 @@ of the License or (at your option) any later version.
 
 #include "graphite2/Font.h"
 #include "inc/Main.h"
+#include "inc/Arena.h"
+#include "inc/Atomic.h"
 #include "inc/Position.h"
 #include "inc/GlyphFace.h"
 
@@ -37,6 +39,8 @@ namespace graphite2 {
 class Face;
 class FeatureVal;
 class Segment;
+class SnapshotWriter;
+class SnapshotReader;
 
 
 struct SlantBox
@@ -77,6 +81,7 @@ public:
     Rect &subVal(int subindex, int boundary) { return _subs[subindex * 2 + boundary]; }
     const Rect &slant() const { return _slant; }
     uint8 num() const { return _num; }
+    unsigned short bitmap() const { return _bitmap; }
     const Rect *subs() const { return _subs; }
 
 private:
@@ -89,6 +94,7 @@ private:
 class GlyphCache
 {
     class Loader;
+    class Preloader;
 
     GlyphCache(const GlyphCache&);
     GlyphCache& operator=(const GlyphCache&);
@@ -103,6 +109,8 @@ public:
 
     const GlyphFace *glyph(unsigned short glyphid) const;      //result may be changed by subsequent call with a different glyphid
     const GlyphFace *glyphSafe(unsigned short glyphid) const;
+    uint16           glyphAttr(unsigned short glyphid, uint16 attr) const;
+    void             denseAttrs(const uint16 * attrs, size_t n);
     float            getBoundingMetric(unsigned short glyphid, uint8 metric) const;
     uint8            numSubBounds(unsigned short glyphid) const;
     float            getSubBoundingMetric(unsigned short glyphid, uint8 subindex, uint8 metric) const;
@@ -114,13 +122,28 @@ public:
     bool             check(unsigned short glyphid) const;
     bool             hasBoxes() const { return _boxes != 0; }
 
+    void             writeSnapshot(SnapshotWriter &) const;
+    bool             readSnapshot(SnapshotReader &);
+
     CLASS_NEW_DELETE;
     
 private:
+    static const uint8    NO_COLUMN = 0xFF,
+                          MAX_DENSE_ATTRS = 64;
+
+    bool                  preloadParallel(GlyphFace * glyphs);
+    void                  releaseLoaded();
+    void                  denseRow(unsigned short glyphid, const GlyphFace & g) const throw();
+
     const Rect            _empty_slant_box;
+    mutable Arena         _glyph_arena;
     const Loader        * _glyph_loader;
     const GlyphFace *   * _glyphs;
     GlyphBox        *   * _boxes;
+    uint16              * _dense_attrs;     // a column of _num_glyphs values per dense attribute
+    uint8               * _dense_column;    // column of each attribute, or NO_COLUMN
+    uint16                _dense_keys[MAX_DENSE_ATTRS];  // attribute in each column
+    uint8                 _num_dense;
     unsigned short        _num_glyphs,
                           _num_attrs,
                           _upem;
@@ -156,6 +179,18 @@ const GlyphFace *GlyphCache::glyphSafe(unsigned short glyphid) const
     return glyphid < _num_glyphs ? glyph(glyphid) : NULL;
 }
 
+inline
+uint16 GlyphCache::glyphAttr(unsigned short glyphid, uint16 attr) const
+{
+    if (glyphid >= _num_glyphs) return 0;
+    // A glyph loaded on demand has its dense row filled before it is published.
+    if (_dense_column && attr < _num_attrs && _dense_column[attr] != NO_COLUMN
+        && (!_glyph_loader || atomic::load(_glyphs[glyphid])))
+        return atomic::load(_dense_attrs[size_t(_dense_column[attr]) * _num_glyphs + glyphid]);
+    const GlyphFace * const p = glyph(glyphid);
+    return p ? p->attrs()[attr] : 0;
+}
+
 inline
 float GlyphCache::getBoundingMetric(unsigned short glyphid, uint8 metric) const
 {
@@ -32,6 +32,9 @@ of the License or (at your option) any later version.
 
 namespace graphite2 {
 
+class SnapshotWriter;
+class SnapshotReader;
+
 enum metrics {
     kgmetLsb = 0, kgmetRsb,
     kgmetBbTop, kgmetBbBottom, kgmetBbLeft, kgmetBbRight,
@@ -46,13 +49,16 @@ class GlyphFace
 public:
     GlyphFace();
     template<typename I>
-    GlyphFace(const Rect & bbox, const Position & adv, I first, const I last);
+    GlyphFace(const Rect & bbox, const Position & adv, I first, const I last, Arena * arena = 0);
 
     const Position    & theAdvance() const;
     const Rect        & theBBox() const { return m_bbox; }
     const sparse      & attrs() const { return m_attrs; }
     int32               getMetric(uint8 metric) const;
 
+    void                writeSnapshot(SnapshotWriter &) const throw();
+    bool                readSnapshot(SnapshotReader &) throw();
+
     CLASS_NEW_DELETE;
 private:
     Rect     m_bbox;        // bounding box metrics in design units
@@ -68,10 +74,10 @@ GlyphFace::GlyphFace()
 {}
 
 template<typename I>
-GlyphFace::GlyphFace(const Rect & bbox, const Position & adv, I first, const I last)
+GlyphFace::GlyphFace(const Rect & bbox, const Position & adv, I first, const I last, Arena * arena)
 : m_bbox(bbox),
   m_advance(adv),
-  m_attrs(first, last)
+  m_attrs(first, last, arena)
 {
 }
 
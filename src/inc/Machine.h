@@ -145,6 +145,7 @@ public:
     };
 
     Machine(SlotMap &) throw();
+    void reset() throw();
     static const opcode_t *   getOpcodeTable() throw();
 
     CLASS_NEW_DELETE;
@@ -174,6 +175,11 @@ inline Machine::Machine(SlotMap & map) throw()
     for (size_t n = STACK_GUARD + 1; n; --n)  _stack[n-1] = 0;
 }
 
+inline void Machine::reset() throw()
+{
+    _status = finished;
+}
+
 inline SlotMap& Machine::slotMap() const throw()
 {
     return _map;
@@ -39,7 +39,7 @@ class NameTable
 
 public:
     NameTable(const void * data, size_t length, uint16 platfromId=3, uint16 encodingID = 1);
-    ~NameTable() { free(const_cast<TtfUtil::Sfnt::FontNames *>(m_table)); }
+    ~NameTable() { free(const_cast<TtfUtil::Sfnt::FontNames *>(m_table)); free(m_langTags); }
     enum eNameFallback {
         eNoFallback = 0,
         eEnUSFallbackOnly = 1,
@@ -51,6 +51,16 @@ public:
 
     CLASS_NEW_DELETE
 private:
+    // A format 1 language tag record, sorted by its tag for getLanguageId.
+    struct LangTag
+    {
+        const uint8 * m_name;   // big endian UTF-16 tag in the name data
+        uint16 m_length,        // of the tag, in code units
+               m_index;         // of the record
+    };
+
+    void indexLangTags();
+
     uint16 m_platformId;
     uint16 m_encodingId;
     uint16 m_languageCount;
@@ -59,6 +69,8 @@ private:
     uint16 m_nameDataLength;
     const TtfUtil::Sfnt::FontNames * m_table;
     const uint8 * m_nameData;
+    LangTag * m_langTags;
+    uint16 m_numLangTags;
     Locale2Lang m_locale2Lang;
 };
 
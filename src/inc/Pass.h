@@ -42,6 +42,8 @@ class Error;
 class ShiftCollider;
 class KernCollider;
 class json;
+class SnapshotWriter;
+class SnapshotReader;
 
 enum passtype;
 
@@ -52,14 +54,21 @@ public:
     ~Pass();
     
     bool readPass(const byte * pPass, size_t pass_length, size_t subtable_base, Face & face,
-        enum passtype pt, uint32 version, Error &e);
+        enum passtype pt, uint32 version, Error &e, bool lazy = false);
+    bool readPending(const Face & face, Error &e, unsigned int & ectxt);
     bool runGraphite(vm::Machine & m, FiniteStateMachine & fsm, bool reverse) const;
+    bool writeSnapshot(SnapshotWriter & w, const Face & face) const;
+    bool readSnapshot(SnapshotReader & r, Face & face, Error &e);
     void init(Silf *silf) { m_silf = silf; }
     byte collisionLoops() const { return m_numCollRuns; }
     bool reverseDir() const { return m_isReverseDir; }
 
     CLASS_NEW_DELETE
 private:
+    struct Source;
+
+    bool    readBody(const Source & src, const Face & face, Error &e, unsigned int & ectxt);
+    bool    decode(const Face & face) const;
     void    findNDoRule(Slot* & iSlot, vm::Machine &, FiniteStateMachine& fsm) const;
     int     doAction(const vm::Machine::Code* codeptr, Slot * & slot_out, vm::Machine &) const;
     bool    testPassConstraint(vm::Machine & m) const;
@@ -68,8 +77,8 @@ private:
                      const byte *precontext, const uint16 * sort_key,
                      const uint16 * o_constraint, const byte *constraint_data, 
                      const uint16 * o_action, const byte * action_data,
-                     Face &, enum passtype pt, Error &e);
-    bool    readStates(const byte * starts, const byte * states, const byte * o_rule_map, Face &, Error &e);
+                     const Face &, enum passtype pt, Error &e, unsigned int & ectxt);
+    bool    readStates(const byte * starts, const byte * states, const byte * o_rule_map, const Face &, Error &e, unsigned int & ectxt);
     bool    readRanges(const byte * ranges, size_t num_ranges, Error &e);
     uint16  glyphToCol(const uint16 gid) const;
     bool    runFSM(FiniteStateMachine & fsm, Slot * slot) const;
@@ -109,6 +118,8 @@ private:
     byte m_colThreshold;
     bool m_isReverseDir;
     vm::Machine::Code m_cPConstraint;
+    Source          * m_source;     // where to decode a lazily read pass from
+    mutable long      m_status;
     
 private:        //defensive
     Pass(const Pass&);
@@ -102,6 +102,7 @@ class SlotMap
 {
 public:
   enum {MAX_SLOTS=64};
+  SlotMap();
   SlotMap(Segment & seg, uint8 direction, int maxSize);
   
   Slot       * * begin();
@@ -109,6 +110,7 @@ public:
   size_t         size() const;
   unsigned short context() const;
   void           reset(Slot &, unsigned short);
+  void           reset(Segment &, uint8 direction, int maxSize);
   
   Slot * const & operator[](int n) const;
   Slot       * & operator [] (int);
@@ -122,9 +124,10 @@ public:
 
   uint8          dir() const { return m_dir; }
   int            decMax() { return --m_maxSize; }
+  Segment      & segment() const { return *m_segment; }
 
-  Segment &    segment;
 private:
+  Segment      * m_segment;
   Slot         * m_slot_map[MAX_SLOTS+1];
   unsigned short m_size;
   unsigned short m_precontext;
@@ -168,6 +171,35 @@ public:
 };
 
 
+// The slot map, rule buffer and machine stack the passes work in. Kept
+//  outside Silf::runGraphite so a batch of strings can share one.
+class VMScratch
+{
+public:
+  VMScratch(json * logger);
+  void reset(Segment & seg, uint8 direction, int maxSize);
+
+  SlotMap             map;
+  FiniteStateMachine  fsm;
+  vm::Machine         m;
+};
+
+inline
+VMScratch::VMScratch(json * logger)
+: fsm(map, logger),
+  m(map)
+{
+}
+
+inline
+void VMScratch::reset(Segment & seg, uint8 direction, int maxSize)
+{
+  map.reset(seg, direction, maxSize);
+  fsm.rules.clear();
+  m.reset();
+}
+
+
 inline
 FiniteStateMachine::FiniteStateMachine(SlotMap& map, json * logger)
 : slots(map),
@@ -243,14 +275,35 @@ void FiniteStateMachine::Rules::accumulate_rules(const State &state)
   m_end = out;
 }
 
+inline
+SlotMap::SlotMap()
+: m_segment(0), m_size(0), m_precontext(0), m_highwater(0),
+    m_maxSize(0), m_dir(0), m_highpassed(false)
+{
+    m_slot_map[0] = 0;
+}
+
 inline
 SlotMap::SlotMap(Segment & seg, uint8 direction, int maxSize)
-: segment(seg), m_size(0), m_precontext(0), m_highwater(0),
+: m_segment(&seg), m_size(0), m_precontext(0), m_highwater(0),
     m_maxSize(maxSize), m_dir(direction), m_highpassed(false)
 {
     m_slot_map[0] = 0;
 }
 
+inline
+void SlotMap::reset(Segment & seg, uint8 direction, int maxSize)
+{
+  m_segment = &seg;
+  m_size = 0;
+  m_precontext = 0;
+  m_highwater = 0;
+  m_maxSize = maxSize;
+  m_dir = direction;
+  m_highpassed = false;
+  m_slot_map[0] = 0;
+}
+
 inline
 Slot * * SlotMap::begin()
 {
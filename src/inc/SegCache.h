@@ -253,7 +253,7 @@ public:
 
     long long totalAccessCount() const { return m_totalAccessCount; }
     size_t segmentCount() const { return m_segmentCount; }
-    const Features & features() const { return m_features; }
+    const Features & features() const { return *m_features; }
     void clear(SegCacheStore * store);
 
     CLASS_NEW_DELETE
@@ -266,7 +266,7 @@ private:
 //    uint16 m_maxCachedSegLength;
     size_t m_segmentCount;
     SegCachePrefixArray m_prefixes;
-    Features m_features;
+    const Features * m_features;    // interned
     mutable unsigned long long m_totalAccessCount;
     mutable unsigned long long m_totalMisses;
     float m_purgeFactor;
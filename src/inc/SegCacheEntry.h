@@ -73,7 +73,7 @@ class SegCacheEntry
     friend class SegCachePrefixEntry;
 public:
     SegCacheEntry() :
-        m_glyphLength(0), m_unicode(NULL), m_glyph(NULL), m_attr(NULL), m_justs(0),
+        m_glyphLength(0), m_unicode(NULL), m_glyph(NULL), m_extras(NULL), m_justs(0),
         m_accessCount(0), m_lastAccess(0)
     {}
     SegCacheEntry(const uint16 * cmapGlyphs, size_t length, Segment * seg, size_t charOffset, long long cacheTime);
@@ -110,7 +110,7 @@ private:
     uint16 * m_unicode;
     /** slots after shapping and positioning */
     Slot   * m_glyph;
-    int16  * m_attr;
+    byte   * m_extras;
     byte   * m_justs;
     mutable unsigned long long m_accessCount;
     mutable unsigned long long m_lastAccess;
@@ -52,6 +52,7 @@ public:
     {
         for (size_t i = 0; i < m_cacheCount; i++)
         {
+            if (!m_caches[i])   continue;
             m_caches[i]->clear(cacheStore);
             delete m_caches[i];
         }
@@ -59,31 +60,32 @@ public:
         m_caches = NULL;
         m_cacheCount = 0;
     }
-    SegCache * getOrCreate(SegCacheStore * cacheStore, const Features & features)
+    // features must be interned; i is the store's id for them.
+    SegCache * getOrCreate(SegCacheStore * cacheStore, const Features & features, size_t i)
     {
-        for (size_t i = 0; i < m_cacheCount; i++)
-        {
-            if (m_caches[i]->features() == features)
-                return m_caches[i];
-        }
-        SegCache ** newData = gralloc<SegCache*>(m_cacheCount+1);
-        if (newData)
+        assert(features.interned());
+        if (!features.interned())   return NULL;
+
+        if (i < m_cacheCount && m_caches[i])
+            return m_caches[i];
+        if (i >= m_cacheCount)
         {
+            SegCache ** newData = grzeroalloc<SegCache*>(i + 1);
+            if (!newData)   return NULL;
             if (m_cacheCount > 0)
             {
                 memcpy(newData, m_caches, sizeof(SegCache*) * m_cacheCount);
                 free(m_caches);
             }
             m_caches = newData;
-            m_caches[m_cacheCount] = new SegCache(cacheStore, features);
-            m_cacheCount++;
-            return m_caches[m_cacheCount - 1];
+            m_cacheCount = i + 1;
         }
-        return NULL;
+        m_caches[i] = new SegCache(cacheStore, features);
+        return m_caches[i];
     }
     CLASS_NEW_DELETE
 private:
-    SegCache ** m_caches;
+    SegCache ** m_caches;   // indexed by the store's feature id
     size_t m_cacheCount;
 };
 
@@ -105,7 +107,7 @@ public:
     }
     SegCache * getOrCreate(unsigned int i, const Features & features)
     {
-        return m_caches[i].getOrCreate(this, features);
+        return m_caches[i].getOrCreate(this, features, featureId(features));
     }
     bool isSpaceGlyph(uint16 gid) const { return (gid == m_spaceGid) || (gid == m_zwspGid); }
     uint16 maxCmapGid() const { return m_maxCmapGid; }
@@ -113,6 +115,17 @@ public:
 
     CLASS_NEW_DELETE
 private:
+    // A small id for each interned feature settings the store has seen, in
+    //  the order it saw them, to index the silf caches by.
+    size_t featureId(const Features & features)
+    {
+        for (size_t i = 0; i != m_features.size(); ++i)
+            if (m_features[i] == &features) return i;
+        m_features.push_back(&features);
+        return m_features.size() - 1;
+    }
+
+    Vector<const Features *> m_features;
     SilfSegCache * m_caches;
     uint8 m_numSilf;
     uint32 m_maxSegments;
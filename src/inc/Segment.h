@@ -30,6 +30,7 @@ of the License or (at your option) any later version.
 
 #include <cassert>
 
+#include "inc/Arena.h"
 #include "inc/CharInfo.h"
 #include "inc/Face.h"
 #include "inc/FeatureVal.h"
@@ -44,10 +45,7 @@ of the License or (at your option) any later version.
 
 namespace graphite2 {
 
-typedef Vector<Features>        FeatureList;
-typedef Vector<Slot *>          SlotRope;
-typedef Vector<int16 *>         AttributeRope;
-typedef Vector<SlotJustify *>   JustifyRope;
+typedef Vector<const Features *> FeatureList;
 
 #ifndef GRAPHITE2_NSEGCACHE
 class SegmentScopeState;
@@ -94,7 +92,7 @@ public:
     unsigned int slotCount() const { return m_numGlyphs; }      //one slot per glyph
     void extendLength(int num) { m_numGlyphs += num; }
     Position advance() const { return m_advance; }
-    bool runGraphite() { if (m_silf) return m_face->runGraphite(this, m_silf); else return true;};
+    bool runGraphite(VMScratch & scratch) { if (m_silf) return m_face->runGraphite(this, m_silf, scratch); else return true;};
     void chooseSilf(uint32 script) { m_silf = m_face->chooseSilf(script); }
     const Silf *silf() const { return m_silf; }
     unsigned int charInfoCount() const { return m_numCharinfo; }
@@ -103,6 +101,10 @@ public:
 
     Segment(unsigned int numchars, const Face* face, uint32 script, int dir);
     ~Segment();
+    // Empties the segment to take numchars new characters, keeping its memory.
+    //  On failure the segment is left unable to take text.
+    bool reset(unsigned int numchars, const Face* face, uint32 script, int dir);
+    operator bool () const throw() { return m_charinfo != 0; }
 #ifndef GRAPHITE2_NSEGCACHE
     SegmentScopeState setScope(Slot * firstSlot, Slot * lastSlot, size_t subLength);
     void removeScope(SegmentScopeState & state);
@@ -127,21 +129,15 @@ public:
     void linkClusters(Slot *first, Slot *last);
     uint16 getClassGlyph(uint16 cid, uint16 offset) const { return m_silf->getClassGlyph(cid, offset); }
     uint16 findClassIndex(uint16 cid, uint16 gid) const { return m_silf->findClassIndex(cid, gid); }
-    int addFeatures(const Features& feats) { m_feats.push_back(feats); return m_feats.size() - 1; }
-    uint32 getFeature(int index, uint8 findex) const { const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex); if (!pFR) return 0; else return pFR->getFeatureVal(m_feats[index]); }
-    void setFeature(int index, uint8 findex, uint32 val) {
-        const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex); 
-        if (pFR)
-        {
-            if (val > pFR->maxVal()) val = pFR->maxVal();
-            pFR->applyValToFeature(val, m_feats[index]);
-        } }
+    int addFeatures(const Features& feats);
+    uint32 getFeature(int index, uint8 findex) const { const FeatureRef* pFR=m_face->theSill().theFeatureMap().featureRef(findex); if (!pFR) return 0; else return pFR->getFeatureVal(*m_feats[index]); }
+    void setFeature(int index, uint8 findex, uint32 val);
     int8 dir() const { return m_dir; }
     void dir(int8 val) { m_dir = val; }
     bool currdir() const { return ((m_dir >> 6) ^ m_dir) & 1; }
     unsigned int passBits() const { return m_passBits; }
     void mergePassBits(const unsigned int val) { m_passBits &= val; }
-    int16 glyphAttr(uint16 gid, uint16 gattr) const { const GlyphFace * p = m_face->glyphs().glyphSafe(gid); return p ? p->attrs()[gattr] : 0; }
+    int16 glyphAttr(uint16 gid, uint16 gattr) const { return int16(m_face->glyphs().glyphAttr(gid, gattr)); }
     int32 getGlyphMetric(Slot *iSlot, uint8 metric, uint8 attrLevel, bool rtl) const;
     float glyphAdvance(uint16 gid) const { return m_face->glyphs().glyph(gid)->theAdvance().x; }
     const Rect &theGlyphBBoxTemporary(uint16 gid) const { return m_face->glyphs().glyph(gid)->theBBox(); }   //warning value may become invalid when another glyph is accessed
@@ -149,13 +145,13 @@ public:
     int numAttrs() const { return m_silf->numUser(); }
     int defaultOriginal() const { return m_defaultOriginal; }
     const Face * getFace() const { return m_face; }
-    const Features & getFeatures(unsigned int /*charIndex*/) { assert(m_feats.size() == 1); return m_feats[0]; }
+    const Features & getFeatures(unsigned int /*charIndex*/) { assert(m_feats.size() == 1); return *m_feats[0]; }
     void bidiPass(int paradir, uint8 aMirror);
     int8 getSlotBidiClass(Slot *s) const;
     void doMirror(uint16 aMirror);
     Slot *addLineEnd(Slot *nSlot);
     void delLineEnd(Slot *s);
-    bool hasJustification() const { return m_justifies.size() != 0; }
+    bool hasJustification() const { return m_hasJustifies; }
     void reverseSlots();
 
     bool isWhitespace(const int cid) const;
@@ -170,11 +166,12 @@ public:       //only used by: GrSegment* makeAndInitialize(const GrFont *font, c
     bool initCollisions();
   
 private:
+    void releaseFeatures();
+
     Position        m_advance;          // whole segment advance
-    SlotRope        m_slots;            // Vector of slot buffers
-    AttributeRope   m_userAttrs;        // Vector of userAttrs buffers
-    JustifyRope     m_justifies;        // Slot justification info buffers
-    FeatureList     m_feats;            // feature settings referenced by charinfos in this segment
+    Arena           m_arena;            // slot, userAttrs, justification, character and collision buffers
+    FeatureList     m_feats;            // feature settings referenced by charinfos in this segment, owned unless interned
+    SlotBlocks      m_slotBlocks;       // the blocks slots are made in, for following links between them
     Slot          * m_freeSlots;        // linked list of free slots
     SlotJustify   * m_freeJustifies;    // Slot justification blocks free list
     CharInfo      * m_charinfo;         // character info, one per input character
@@ -190,6 +187,7 @@ private:
     int             m_defaultOriginal;  // number of whitespace chars in the string
     int8            m_dir;
     uint8           m_flags;            // General purpose flags
+    bool            m_hasJustifies;     // if any justification buffers were made
 };
 
 inline
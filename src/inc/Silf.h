@@ -37,6 +37,8 @@ class Segment;
 class FeatureVal;
 class VMScratch;
 class Error;
+class SnapshotWriter;
+class SnapshotReader;
 
 class Pseudo
 {
@@ -71,14 +73,23 @@ class Silf
     Silf& operator=(const Silf&);
 
 public:
+    // The most attributes denseAttrs() gives.
+    static const size_t MAX_DENSE_ATTRS = 23;
+
     Silf() throw();
     ~Silf() throw();
     
-    bool readGraphite(const byte * const pSilf, size_t lSilf, Face &face, uint32 version);
-    bool runGraphite(Segment *seg, uint8 firstPass=0, uint8 lastPass=0, int dobidi = 0) const;
+    bool readGraphite(const byte * const pSilf, size_t lSilf, Face &face, uint32 version, bool lazyPasses = false);
+    bool readPendingPasses(Face &face);
+    bool writeSnapshot(SnapshotWriter & w, const Face & face) const;
+    bool readSnapshot(SnapshotReader & r, Face &face);
+    bool runGraphite(Segment *seg, VMScratch & scratch, uint8 firstPass=0, uint8 lastPass=0, int dobidi = 0) const;
     uint16 findClassIndex(uint16 cid, uint16 gid) const;
     uint16 getClassGlyph(uint16 cid, unsigned int index) const;
     uint16 findPseudo(uint32 uid) const;
+    uint16 numPseudo() const { return m_numPseudo; }
+    const Pseudo & pseudo(uint16 i) const { return m_pseudos[i]; }
+    size_t denseAttrs(uint16 * attrs) const;
     uint8 numUser() const { return m_aUser; }
     uint8 aPseudo() const { return m_aPseudo; }
     uint8 aBreak() const { return m_aBreak; }
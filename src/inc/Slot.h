@@ -26,9 +26,11 @@ of the License or (at your option) any later version.
 */
 #pragma once
 
+#include <cstddef>
 #include "graphite2/Types.h"
 #include "graphite2/Segment.h"
 #include "inc/Main.h"
+#include "inc/List.h"
 #include "inc/Font.h"
 #include "inc/Position.h"
 
@@ -39,6 +41,13 @@ typedef gr_attrCode attrCode;
 class GlyphFace;
 class SegCacheEntry;
 class Segment;
+class Slot;
+
+// Slots are made a block at a time. Each block is preceded by a pointer to
+//  its owner's table of blocks and each slot holds its own place in that
+//  table, so a link between slots, held as an index, can be followed from
+//  the slot alone.
+typedef Vector<Slot *> SlotBlocks;
 
 struct SlotJustify
 {
@@ -56,6 +65,23 @@ public:
     int16 values[1];
 };
 
+// The attributes most passes never look at, kept apart from the slot so that
+//  walking the slot list touches fewer cache lines. Each is followed by the
+//  slot's user attributes.
+struct SlotExtra
+{
+    static size_t size_of(size_t numUserAttrs) { return offsetof(SlotExtra, userAttrs) + numUserAttrs*sizeof(int16); }
+    // The spacing of an array of them, keeping each one's pointer aligned.
+    static size_t stride(size_t numUserAttrs) { return (size_of(numUserAttrs) + sizeof(void *) - 1) & ~(sizeof(void *) - 1); }
+
+    Position shift;         // .shift slot attribute
+    Position attach;        // attachment point on us
+    Position with;          // attachment point position on parent
+    float    just;          // Justification inserted space
+    SlotJustify *justs;     // pointer to justification parameters
+    int16    userAttrs[1];
+};
+
 class Slot
 {
     enum Flag
@@ -67,9 +93,22 @@ class Slot
         ATTACHED    = 16
     };
 
+    static const uint32 NONE = 0xFFFFFFFF;     // the index of no slot
+
 public:
     struct iterator;
 
+    enum {
+        BLOCK_BITS = 16,
+        MAX_BLOCK_SLOTS = 1 << BLOCK_BITS,
+        MAX_BLOCKS = (1 << (32 - BLOCK_BITS)) - 1   // keeps NONE out of reach
+    };
+
+    static size_t blockSize(size_t n) { return sizeof(const SlotBlocks *) + n * sizeof(Slot); }
+    // Lays out n slots in mem, as block number block of owner.
+    static Slot * makeBlock(void * mem, const SlotBlocks * owner, uint32 block, size_t n, byte * extras, size_t extraStride);
+    static void * blockMemory(Slot * first) { return reinterpret_cast<byte *>(first) - sizeof(const SlotBlocks *); }
+
     unsigned short gid() const { return m_glyphid; }
     Position origin() const { return m_position; }
     float advance() const { return m_advance.x; }
@@ -80,22 +119,24 @@ public:
     uint32 index() const { return m_index; }
     void index(uint32 val) { m_index = val; }
 
-    Slot(int16 *m_userAttr = NULL);
+    Slot(SlotExtra *extra = NULL, uint32 self = 0);
     void set(const Slot & slot, int charOffset, size_t numUserAttr, size_t justLevels, size_t numChars);
-    Slot *next() const { return m_next; }
-    void next(Slot *s) { m_next = s; }
-    Slot *prev() const { return m_prev; }
-    void prev(Slot *s) { m_prev = s; }
+    // Takes on everything of orig's but its place in the blocks.
+    void copy(const Slot & orig) { const uint32 self = m_self; *this = orig; m_self = self; }
+    Slot *next() const { return slot(m_next); }
+    void next(Slot *s) { m_next = link(s); }
+    Slot *prev() const { return slot(m_prev); }
+    void prev(Slot *s) { m_prev = link(s); }
     uint16 glyph() const { return m_realglyphid ? m_realglyphid : m_glyphid; }
     void setGlyph(Segment *seg, uint16 glyphid, const GlyphFace * theGlyph = NULL);
     void setRealGid(uint16 realGid) { m_realglyphid = realGid; }
-    void adjKern(const Position &pos) { m_shift = m_shift + pos; m_advance = m_advance + pos; }
-    void origin(const Position &pos) { m_position = pos + m_shift; }
+    void adjKern(const Position &pos) { m_extra->shift = m_extra->shift + pos; m_advance = m_advance + pos; }
+    void origin(const Position &pos) { m_position = pos + m_extra->shift; }
     void originate(int ind) { m_original = ind; }
     int original() const { return m_original; }
     void before(int ind) { m_before = ind; }
     void after(int ind) { m_after = ind; }
-    bool isBase() const { return (!m_parent); }
+    bool isBase() const { return m_parent == NONE; }
     void update(int numSlots, int numCharInfo, Position &relpos);
     Position finalise(const Segment* seg, const Font* font, Position & base, Rect & bbox, uint8 attrLevel, float & clusterMin, bool rtl, bool isFinal, int depth = 0);
     bool isDeleted() const { return (m_flags & DELETED) ? true : false; }
@@ -110,58 +151,67 @@ public:
     int8 getBidiClass(const Segment *seg);
     int8 getBidiClass() const { return m_bidiCls; }
     void setBidiClass(int8 cls) { m_bidiCls = cls; }
-    int16 *userAttrs() const { return m_userAttr; }
-    void userAttrs(int16 *p) { m_userAttr = p; }
+    SlotExtra *extra() const { return m_extra; }
+    void extra(SlotExtra *p) { m_extra = p; }
+    int16 *userAttrs() const { return m_extra->userAttrs; }
     void markInsertBefore(bool state) { if (!state) m_flags |= INSERTED; else m_flags &= ~INSERTED; }
     void setAttr(Segment* seg, attrCode ind, uint8 subindex, int16 val, const SlotMap & map);
     int getAttr(const Segment *seg, attrCode ind, uint8 subindex) const;
     int getJustify(const Segment *seg, uint8 level, uint8 subindex) const;
     void setJustify(Segment *seg, uint8 level, uint8 subindex, int16 value);
-    bool isLocalJustify() const { return m_justs != NULL; };
-    void attachTo(Slot *ap) { m_parent = ap; }
-    Slot *attachedTo() const { return m_parent; }
-    Position attachOffset() const { return m_attach - m_with; }
-    Slot* firstChild() const { return m_child; }
-    void firstChild(Slot *ap) { m_child = ap; }
+    bool isLocalJustify() const { return m_extra->justs != NULL; };
+    void attachTo(Slot *ap) { m_parent = link(ap); }
+    Slot *attachedTo() const { return slot(m_parent); }
+    Position attachOffset() const { return m_extra->attach - m_extra->with; }
+    Slot* firstChild() const { return slot(m_child); }
+    void firstChild(Slot *ap) { m_child = link(ap); }
     bool child(Slot *ap);
-    Slot* nextSibling() const { return m_sibling; }
-    void nextSibling(Slot *ap) { m_sibling = ap; }
+    Slot* nextSibling() const { return slot(m_sibling); }
+    void nextSibling(Slot *ap) { m_sibling = link(ap); }
     bool sibling(Slot *ap);
     bool removeChild(Slot *ap);
     int32 clusterMetric(const Segment* seg, uint8 metric, uint8 attrLevel, bool rtl);
     void positionShift(Position a) { m_position += a; }
     void floodShift(Position adj, int depth = 0);
-    float just() const { return m_just; }
-    void just(float j) { m_just = j; }
+    float just() const { return m_extra->just; }
+    void just(float j) { m_extra->just = j; }
     Slot *nextInCluster(const Slot *s) const;
     bool isChildOf(const Slot *base) const;
 
     CLASS_NEW_DELETE
 
 private:
-    Slot *m_next;           // linked list of slots
-    Slot *m_prev;
+    // A link into this slot's own block is found by offset from it, any
+    //  other through the owner's table of blocks.
+    Slot * slot(uint32 i) const
+    {
+        if (((i ^ m_self) >> BLOCK_BITS) == 0)
+            return const_cast<Slot *>(this) + (int(i & (MAX_BLOCK_SLOTS - 1)) - int(m_self & (MAX_BLOCK_SLOTS - 1)));
+        return i == NONE ? NULL : otherBlock(i);
+    }
+    Slot * otherBlock(uint32 i) const;
+    static uint32 link(const Slot *s) { return s ? s->m_self : uint32(NONE); }
+
+    // The fields every pass uses come first, so they share a cache line.
+    uint32 m_next;          // index of the next slot in the list
+    uint32 m_prev;
+    uint32 m_self;          // this slot's own block and place in it
     unsigned short m_glyphid;        // glyph id
     uint16 m_realglyphid;
     uint32 m_original;      // charinfo that originated this slot (e.g. for feature values)
-    uint32 m_before;        // charinfo index of before association
-    uint32 m_after;         // charinfo index of after association
-    uint32 m_index;         // slot index given to this slot during finalising
-    Slot *m_parent;         // index to parent we are attached to
-    Slot *m_child;          // index to first child slot that attaches to us
-    Slot *m_sibling;        // index to next child that attaches to our parent
-    Position m_position;    // absolute position of glyph
-    Position m_shift;       // .shift slot attribute
-    Position m_advance;     // .advance slot attribute
-    Position m_attach;      // attachment point on us
-    Position m_with;        // attachment point position on parent
-    float    m_just;        // Justification inserted space
     uint8    m_flags;       // holds bit flags
     byte     m_attLevel;    // attachment level
     int8     m_bidiCls;     // bidirectional class
     byte     m_bidiLevel;   // bidirectional level
-    int16   *m_userAttr;    // pointer to user attributes
-    SlotJustify *m_justs;   // pointer to justification parameters
+    Position m_advance;     // .advance slot attribute
+    uint32 m_index;         // slot index given to this slot during finalising
+    uint32 m_parent;        // index to parent we are attached to
+    uint32 m_child;         // index to first child slot that attaches to us
+    uint32 m_sibling;       // index to next child that attaches to our parent
+    Position m_position;    // absolute position of glyph
+    uint32 m_before;        // charinfo index of before association
+    uint32 m_after;         // charinfo index of after association
+    SlotExtra *m_extra;     // shift, attachment, justification and user attributes
 
     friend class SegCacheEntry;
     friend class Segment;
@@ -0,0 +1,155 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#pragma once
+
+#include <cstring>
+
+#include "inc/Main.h"
+
+namespace graphite2 {
+
+// A face snapshot is a native endian image of a fully loaded face's decoded
+// tables.  Nothing in it is an absolute address: cross references are held as
+// offsets or indices and machine code as opcode numbers, so an image can be
+// read back in at any address by copying it out and fixing up the pointers.
+
+namespace snapshot
+{
+    uint32 hash(const void * data, size_t n, uint32 seed=0) throw();
+}
+
+
+// Writes into a caller supplied buffer.  If the buffer is too small (or
+// absent) nothing is written but the size needed is still accumulated.
+class SnapshotWriter
+{
+    SnapshotWriter(const SnapshotWriter &);
+    SnapshotWriter & operator = (const SnapshotWriter &);
+
+public:
+    SnapshotWriter(byte * buf, size_t len) throw();
+
+    byte  * reserve(size_t n) throw();
+    void    write(const void * data, size_t n) throw();
+    template<typename T>
+    void    write(const T & v) throw()  { write(&v, sizeof v); }
+
+    bool    fits() const throw()        { return _buf && _size <= _len; }
+    size_t  size() const throw()        { return _size; }
+    byte  * buffer() const throw()      { return fits() ? _buf : 0; }
+
+private:
+    byte  * const   _buf;
+    const size_t    _len;
+    size_t          _size;
+};
+
+inline
+SnapshotWriter::SnapshotWriter(byte * buf, size_t len) throw()
+: _buf(buf), _len(buf ? len : 0), _size(0)
+{
+}
+
+inline
+byte * SnapshotWriter::reserve(size_t n) throw()
+{
+    byte * const p = _buf && _size <= _len && n <= _len - _size ? _buf + _size : 0;
+    _size += n;
+    return p;
+}
+
+inline
+void SnapshotWriter::write(const void * data, size_t n) throw()
+{
+    byte * const p = reserve(n);
+    if (p && n) memcpy(p, data, n);
+}
+
+
+// Bounds checked sequential reads from a snapshot.  Once a read fails all
+// further reads fail.
+class SnapshotReader
+{
+    SnapshotReader(const SnapshotReader &);
+    SnapshotReader & operator = (const SnapshotReader &);
+
+public:
+    SnapshotReader(const byte * buf, size_t len) throw();
+
+    const byte    * take(size_t n) throw();
+    bool            read(void * data, size_t n) throw();
+    template<typename T>
+    bool            read(T & v) throw()     { return read(&v, sizeof v); }
+    template<typename T>
+    T             * read_array(size_t n) throw();
+
+    size_t          remaining() const throw()   { return _end - _p; }
+    operator bool () const throw()              { return _ok; }
+    bool            fail() throw()              { _ok = false; return false; }
+
+private:
+    const byte    * _p,
+                  * const _end;
+    bool            _ok;
+};
+
+inline
+SnapshotReader::SnapshotReader(const byte * buf, size_t len) throw()
+: _p(buf), _end(buf ? buf + len : 0), _ok(buf != 0)
+{
+}
+
+inline
+const byte * SnapshotReader::take(size_t n) throw()
+{
+    if (!_ok || n > remaining()) { fail(); return 0; }
+    const byte * const p = _p;
+    _p += n;
+    return p;
+}
+
+inline
+bool SnapshotReader::read(void * data, size_t n) throw()
+{
+    const byte * const p = take(n);
+    if (p && n) memcpy(data, p, n);
+    return _ok;
+}
+
+// Returns a freshly gralloc'd copy of the next n elements, or 0 if n is 0 or
+// the read fails.
+template<typename T>
+inline T * SnapshotReader::read_array(size_t n) throw()
+{
+    if (n == 0 || n > remaining() / sizeof(T)) { if (n) fail(); return 0; }
+    T * const a = gralloc<T>(n);
+    if (!a) { fail(); return 0; }
+    read(a, n * sizeof(T));
+    return a;
+}
+
+} // namespace graphite2
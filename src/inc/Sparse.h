@@ -25,19 +25,27 @@ License, as published by the Free Software Foundation, either version 2
 of the License or (at your option) any later version.
 */
 #pragma once
+#include <cstring>
 #include <iterator>
 #include <utility>
 
 #include "inc/Main.h"
+#include "inc/Arena.h"
+#include "inc/bits.h"
 
 namespace graphite2 {
 
+class SnapshotWriter;
+class SnapshotReader;
 
 // A read-only packed fast sparse array of uint16 with uint16 keys.
 // Like most container classes this has capacity and size properties and these
 // refer to the number of stored entries and the number of addressable entries
 // as normal. However due the sparse nature the capacity is always <= than the
 // size.
+// The keys are split into chunks of a machine word's worth. One block holds
+// a presence mask per chunk, then an offset per chunk to where its values
+// start, then the values, so a lookup is a mask test and a population count.
 class sparse
 {
 public:
@@ -48,56 +56,55 @@ public:
 private:
     typedef unsigned long   mask_t;
 
-    static const unsigned char  SIZEOF_CHUNK = (sizeof(mask_t) - sizeof(key_type))*8;
+    static const unsigned char  SIZEOF_CHUNK = sizeof(mask_t)*8;
 
-    struct chunk
-    {
-        mask_t          mask:SIZEOF_CHUNK;
-        key_type        offset;
-    };
-
-    static const chunk  empty_chunk;
+    static const mask_t empty_chunk;
     sparse(const sparse &);
     sparse & operator = (const sparse &);
 
+    static size_t   block_size(size_t n_chunks, size_t n_values) throw();
+    const key_type * offsets() const throw();
+
 public:
+    // The values may be placed in an arena, to go when it does.
     template<typename I>
-    sparse(I first, const I last);
+    sparse(I first, const I last, Arena * arena = 0);
     sparse() throw();
     ~sparse() throw();
 
     operator bool () const throw();
     mapped_type     operator [] (const key_type k) const throw();
+    void            get_many(const key_type * keys, mapped_type * values, size_t n) const throw();
 
     size_t capacity() const throw();
     size_t size()     const throw();
 
     size_t _sizeof() const throw();
 
+    void   writeSnapshot(SnapshotWriter &) const throw();
+    bool   readSnapshot(SnapshotReader &) throw();
+
     CLASS_NEW_DELETE;
 
 private:
-    union {
-        chunk         * map;
-        mapped_type   * values;
-    }           m_array;
+    mask_t    * m_masks;    // the start of the block
     key_type    m_nchunks;
+    bool        m_in_arena;
 };
 
 
 inline
-sparse::sparse() throw() : m_nchunks(0)
+sparse::sparse() throw() : m_masks(const_cast<mask_t *>(&empty_chunk)), m_nchunks(0), m_in_arena(false)
 {
-    m_array.map = const_cast<graphite2::sparse::chunk *>(&empty_chunk);
 }
 
 
 template <typename I>
-sparse::sparse(I attr, const I last)
-: m_nchunks(0)
+sparse::sparse(I attr, const I last, Arena * const arena)
+: m_masks(0),
+  m_nchunks(0),
+  m_in_arena(arena != 0)
 {
-    m_array.map = 0;
-
     // Find the maximum extent of the key space.
     size_t n_values=0;
     long lastkey = -1;
@@ -113,44 +120,84 @@ sparse::sparse(I attr, const I last)
     }
     if (m_nchunks == 0)
     {
-        m_array.map=const_cast<graphite2::sparse::chunk *>(&empty_chunk);
+        m_masks = const_cast<mask_t *>(&empty_chunk);
+        return;
+    }
+    // The offsets must be able to reach every value.
+    if (m_nchunks + n_values > 0xFFFF)
+    {
+        m_nchunks = 0;
         return;
     }
 
-    m_array.values = grzeroalloc<mapped_type>((m_nchunks*sizeof(chunk) + sizeof(mapped_type)-1)
-                                                 / sizeof(mapped_type)
-                                                 + n_values);
+    const size_t n_bytes = block_size(m_nchunks, n_values);
+    if (arena)
+    {
+        m_masks = static_cast<mask_t *>(arena->allocate(n_bytes));
+        if (m_masks)
+            memset(m_masks, 0, n_bytes);
+    }
+    else
+        m_masks = grzeroalloc<mask_t>(n_bytes / sizeof(mask_t));
 
-    if (m_array.values == 0)
+    if (m_masks == 0)
+    {
+        m_nchunks = 0;
         return;
+    }
 
-    // coverity[forward_null : FALSE] Since m_array is union and m_array.values is not NULL
-    chunk * ci = m_array.map;
-    ci->offset = (m_nchunks*sizeof(chunk) + sizeof(mapped_type)-1)/sizeof(mapped_type);
-    mapped_type * vi = m_array.values + ci->offset;
-    for (; attr != last; ++attr, ++vi)
+    key_type * const offsets = reinterpret_cast<key_type *>(m_masks + m_nchunks);
+    size_t vi = m_nchunks;
+    long chunk = -1;
+    for (; attr != last; ++attr)
     {
         const typename std::iterator_traits<I>::value_type v = *attr;
-        if (v.second == 0)  { --vi; continue; }
+        if (v.second == 0)  continue;
 
-        chunk * const ci_ = m_array.map + v.first/SIZEOF_CHUNK;
-
-        if (ci != ci_)
+        const key_type c = v.first / SIZEOF_CHUNK;
+        if (c != chunk)
         {
-            ci = ci_;
-            ci->offset = vi - m_array.values;
+            chunk = c;
+            offsets[c] = key_type(vi);
         }
-
-        ci->mask |= 1UL << (SIZEOF_CHUNK - 1 - (v.first % SIZEOF_CHUNK));
-        *vi = v.second;
+        m_masks[c] |= mask_t(1) << (v.first % SIZEOF_CHUNK);
+        offsets[vi++] = v.second;
     }
 }
 
 
+inline
+size_t sparse::block_size(const size_t n_chunks, const size_t n_values) throw()
+{
+    const size_t n = n_chunks*sizeof(mask_t) + (n_chunks + n_values)*sizeof(key_type);
+    return (n + sizeof(mask_t)-1) & ~(sizeof(mask_t)-1);
+}
+
+inline
+const sparse::key_type * sparse::offsets() const throw()
+{
+    return reinterpret_cast<const key_type *>(m_masks + m_nchunks);
+}
+
+inline
+sparse::mapped_type sparse::operator [] (const key_type k) const throw()
+{
+    const key_type c = k / SIZEOF_CHUNK;
+    if (c >= m_nchunks) return 0;
+
+    const mask_t m = m_masks[c],
+                 bit = mask_t(1) << (k % SIZEOF_CHUNK);
+    if (!(m & bit))     return 0;
+
+    const key_type * const o = offsets();
+    return o[o[c] + bit_set_count(m & (bit - 1))];
+}
+
+
 inline
 sparse::operator bool () const throw()
 {
-    return m_array.map != 0;
+    return m_masks != 0;
 }
 
 inline
@@ -162,7 +209,7 @@ size_t sparse::size() const throw()
 inline
 size_t sparse::_sizeof() const throw()
 {
-    return sizeof(sparse) + capacity()*sizeof(mapped_type) + m_nchunks*sizeof(chunk);
+    return sizeof(sparse) + capacity()*sizeof(mapped_type) + m_nchunks*(sizeof(mask_t) + sizeof(key_type));
 }
 
 } // namespace graphite2
@@ -0,0 +1,74 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+#pragma once
+
+#include <cstddef>
+
+namespace graphite2 {
+
+// Spreads independent pieces of work over a few short lived threads, or runs
+// one in the background. Used to speed up or hide face construction.
+namespace parallel {
+
+typedef void (*task)(void * data, size_t i);
+
+// The number of threads run() will use, 1 where threads are unavailable.
+size_t  concurrency() throw();
+
+// Calls t(data, i) for every i in [0, n), with the calling thread taking a
+// share of the work, and returns once they have all finished. The order the
+// calls are made in is unspecified, so each should write its own results.
+void    run(size_t n, task t, void * data) throw();
+
+// Gives up the rest of the calling thread's time slice, for waiting on work
+// another thread has claimed.
+void    yield() throw();
+
+// Runs t(data, 0) on a thread of its own. Any number of threads may wait for
+// it to finish, or for it to call finish() first if it has more to do that
+// they needn't wait for. The destructor waits for the thread to exit.
+class Background
+{
+    void  * _thread;
+
+    Background(const Background &);
+    Background & operator = (const Background &);
+
+public:
+    Background() throw() : _thread(0) {}
+    ~Background() throw()   { join(); }
+
+    // Returns false, without calling t, if no thread could be had.
+    bool    start(task t, void * data) throw();
+    void    finish() const throw();
+    void    wait() const throw();
+    void    join() throw();
+};
+
+} // namespace parallel
+
+} // namespace graphite2
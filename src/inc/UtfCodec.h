@@ -27,7 +27,9 @@ of the License or (at your option) any later version.
 #pragma once
 
 #include <cstdlib>
+#include <cstring>
 #include "inc/Main.h"
+#include "inc/bits.h"
 
 namespace graphite2 {
 
@@ -41,6 +43,8 @@ struct _utf_codec
     static void     put(codeunit_t * cp, const uchar_t , int8 & len) throw();
     static uchar_t  get(const codeunit_t * cp, int8 & len) throw();
     static bool     validate(const codeunit_t * s, const codeunit_t * e) throw();
+    // The number of the first n code units that are each a non nul character.
+    static size_t   simple_run(const codeunit_t * cp, size_t n) throw();
 };
 
 
@@ -70,6 +74,14 @@ public:
     {
         return e > s;
     }
+
+    inline
+    static size_t simple_run(const codeunit_t * cp, size_t n) throw()
+    {
+        const codeunit_t * const s = cp;
+        for (; n && *cp && *cp < limit; --n) ++cp;
+        return cp - s;
+    }
 };
 
 
@@ -115,6 +127,24 @@ public:
         const uint32 u = *(s+(n-1)); // Get the last codepoint
         return (u < 0xD800 || u > 0xDBFF);
     }
+
+    // Everything but nul and surrogates, a word of code units at a time.
+    inline
+    static size_t simple_run(const codeunit_t * cp, size_t n) throw()
+    {
+        typedef unsigned long word;
+        const word  ones = ~word(0)/0xFFFF,
+                    high = ones*0x8000;
+        const codeunit_t * const s = cp;
+        for (word w; n >= sizeof w/sizeof *cp; n -= sizeof w/sizeof *cp, cp += sizeof w/sizeof *cp)
+        {
+            memcpy(&w, cp, sizeof w);
+            const word sur = (w & ones*0xF800) ^ ones*0xD800;
+            if (((w - ones) & ~w & high) || ((sur - ones) & ~sur & high))  break;
+        }
+        for (; n && *cp && (*cp < 0xD800 || *cp > 0xDFFF); --n) ++cp;
+        return cp - s;
+    }
 };
 
 
@@ -182,6 +212,20 @@ public:
         return true;
     }
 
+    // ASCII but nul, a word of code units at a time.
+    inline
+    static size_t simple_run(const codeunit_t * cp, size_t n) throw()
+    {
+        typedef unsigned long word;
+        const codeunit_t * const s = cp;
+        for (word w; n >= sizeof w; n -= sizeof w, cp += sizeof w)
+        {
+            memcpy(&w, cp, sizeof w);
+            if ((w & ~word(0)/255*128) || has_zero(w))  break;
+        }
+        for (; n && *cp && *cp < 0x80; --n) ++cp;
+        return cp - s;
+    }
 };
 
 
@@ -225,6 +269,9 @@ public:
     operator codeunit_type * () const throw() { return cp; }
 
     bool error() const throw()  { return sl < 1; }
+
+    // How many of the next n characters need no decoding, one code unit each.
+    size_t simple_run(size_t n) const throw() { return codec::simple_run(cp, n); }
 };
 
 template <typename C>
@@ -239,6 +286,38 @@ struct utf
     static bool validate(codeunit_t * s, codeunit_t * e) throw() {
         return _utf_codec<sizeof(C)*8>::validate(s,e);
     }
+
+    // Decodes up to n characters from s into usv, which may be NULL, stopping
+    //  early at e if that is not NULL, a nul or an invalid sequence. s is left
+    //  at the first code unit not decoded and invalid is set if that starts an
+    //  invalid sequence. Returns the number of characters decoded.
+    static size_t decode(const codeunit_t * & s, const codeunit_t * const e, uchar_t * usv, const size_t n, bool & invalid) throw()
+    {
+        typedef _utf_codec<sizeof(C)*8> codec;
+        size_t i = 0;
+        invalid = false;
+        while (i != n && (!e || s < e))
+        {
+            const size_t run = e ? codec::simple_run(s, min(n - i, size_t(e - s))) : 0;
+            if (run)
+            {
+                if (usv)
+                    for (size_t k = 0; k != run; ++k) usv[i + k] = s[k];
+                i += run;
+                s += run;
+                continue;
+            }
+
+            int8 l = 1;
+            const uchar_t u = codec::get(s, l);
+            if (l < 1)  invalid = true;
+            if (l < 1 || u == 0)    break;
+            if (usv)    usv[i] = u;
+            ++i;
+            s += l;
+        }
+        return i;
+    }
 };
 
 
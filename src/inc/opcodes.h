@@ -248,15 +248,15 @@ STARTOP(put_copy)
         slotref ref = slotat(slot_ref);
         if (ref && ref != is)
         {
-            int16 *tempUserAttrs = is->userAttrs();
+            SlotExtra *tempExtra = is->extra();
             if (is->attachedTo() || is->firstChild()) DIE
             Slot *prev = is->prev();
             Slot *next = is->next();
-            memcpy(tempUserAttrs, ref->userAttrs(), seg.numAttrs() * sizeof(uint16));
-            memcpy(is, ref, sizeof(Slot));
+            memcpy(tempExtra, ref->extra(), SlotExtra::size_of(seg.numAttrs()));
+            is->copy(*ref);
             is->firstChild(NULL);
             is->nextSibling(NULL);
-            is->userAttrs(tempUserAttrs);
+            is->extra(tempExtra);
             is->next(next);
             is->prev(prev);
             if (is->attachedTo())
@@ -646,10 +646,10 @@ ENDOP
 STARTOP(temp_copy)
     slotref newSlot = seg.newSlot();
     if (!newSlot || !is) DIE;
-    int16 *tempUserAttrs = newSlot->userAttrs();
-    memcpy(newSlot, is, sizeof(Slot));
-    memcpy(tempUserAttrs, is->userAttrs(), seg.numAttrs() * sizeof(uint16));
-    newSlot->userAttrs(tempUserAttrs);
+    SlotExtra *tempExtra = newSlot->extra();
+    newSlot->copy(*is);
+    memcpy(tempExtra, is->extra(), SlotExtra::size_of(seg.numAttrs()));
+    newSlot->extra(tempExtra);
     newSlot->markCopied(true);
     *map = newSlot;
 ENDOP
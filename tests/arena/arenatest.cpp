@@ -0,0 +1,95 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "inc/Arena.h"
+
+using namespace graphite2;
+
+template <typename T> void testAssert(const char * msg, const T b)
+{
+    if (!b)
+    {
+        fprintf(stderr, "%s", msg);
+        exit(1);
+    }
+}
+
+namespace
+{
+    // A mix of small allocations, ones that fill several blocks and ones
+    //  large enough to take the large path.
+    const size_t sizes[] = { 1, 24, 7, 3000, 100, 2049, 40000, 8, 5000, 16, 2048, 9000, 3 };
+    const size_t n_sizes = sizeof sizes / sizeof *sizes;
+
+    inline bool aligned(const void * p) { return (reinterpret_cast<size_t>(p) & (sizeof(double) - 1)) == 0; }
+
+    // Makes every allocation, fills each with its own byte and checks none
+    //  overwrote another.
+    void fill(Arena & arena, byte * (&ptrs)[n_sizes])
+    {
+        for (size_t i = 0; i != n_sizes; ++i)
+        {
+            ptrs[i] = static_cast<byte *>(arena.allocate(sizes[i]));
+            testAssert("allocation failed\n", ptrs[i]);
+            testAssert("allocation misaligned\n", aligned(ptrs[i]));
+            memset(ptrs[i], int(i + 1), sizes[i]);
+        }
+        for (size_t i = 0; i != n_sizes; ++i)
+            for (size_t j = 0; j != sizes[i]; ++j)
+                testAssert("allocations overlap\n", ptrs[i][j] == byte(i + 1));
+    }
+}
+
+int main(int, char **)
+{
+    Arena arena;
+    byte * first[n_sizes], * second[n_sizes], * third[n_sizes];
+
+    // Resetting an arena that never allocated leaves it usable.
+    arena.reset();
+    fill(arena, first);
+
+    // After a reset everything comes from the one block it kept, the large
+    //  allocations included, so the second pass is laid out contiguously.
+    arena.reset();
+    fill(arena, second);
+    for (size_t i = 1; i != n_sizes; ++i)
+        testAssert("allocation after reset didn't come from the kept block\n",
+                   second[i] == second[i-1] + ((sizes[i-1] + sizeof(double) - 1) & ~(sizeof(double) - 1)));
+
+    // With only one block to keep a reset rewinds it in place.
+    arena.reset();
+    fill(arena, third);
+    for (size_t i = 0; i != n_sizes; ++i)
+        testAssert("reset didn't reuse its block\n", third[i] == second[i]);
+
+    // Outgrowing the kept block goes back to separate blocks.
+    byte * const big = static_cast<byte *>(arena.allocate(100000));
+    testAssert("large allocation failed\n", big && aligned(big));
+    memset(big, 0xFF, 100000);
+    for (size_t i = 0; i != n_sizes; ++i)
+        testAssert("large allocation overlaps\n", big + 100000 <= third[i] || third[i] + sizes[i] <= big);
+
+    return 0;
+}
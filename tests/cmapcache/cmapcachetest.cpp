@@ -0,0 +1,120 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <graphite2/Font.h>
+#include "inc/Face.h"
+#include "inc/CmapCache.h"
+
+using namespace graphite2;
+
+template <typename T> void testAssert(const char * msg, const T b)
+{
+    if (!b)
+    {
+        fprintf(stderr, "%s", msg);
+        exit(1);
+    }
+}
+
+// Every character in the first blocks must map as the uncached cmap maps it,
+//  whether looked up alone or a block at a time.
+void testMapping(const Cmap & cmap, const Cmap & ref, const uint32 blocks = 0x100)
+{
+    uint32 usvs[0x100];
+    uint16 gids[0x100];
+    for (uint32 block = 0; block != blocks; ++block)
+    {
+        for (uint32 lo = 0; lo != 0x100; ++lo)
+            usvs[lo] = (block << 8) + lo;
+        cmap.map(usvs, gids, 0x100);
+        for (uint32 lo = 0; lo != 0x100; ++lo)
+        {
+            const uint16 gid = ref[usvs[lo]];
+            if (cmap[usvs[lo]] != gid || gids[lo] != gid)
+            {
+                fprintf(stderr, "U+%04X maps to %u and %u, not %u\n", usvs[lo], cmap[usvs[lo]], gids[lo], gid);
+                exit(1);
+            }
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s font\n", argv[0]);
+        return 1;
+    }
+
+    gr_face * const direct = gr_make_file_face(argv[1], gr_face_dumbRendering),
+            * const cached = gr_make_file_face(argv[1], gr_face_dumbRendering | gr_face_cacheCmap);
+    testAssert("failed to load font\n", direct && cached);
+    const Cmap & ref = static_cast<const Face *>(direct)->cmap(),
+               & cmap = static_cast<const Face *>(cached)->cmap();
+    testAssert("no cmap cache\n", gr_face_cmap_footprint(cached) && !gr_face_cmap_footprint(direct));
+
+    // No room for so much as a plane's page table: nothing more is cached.
+    //  Looking every character up in the font is slow, so only try a few pages.
+    const size_t loaded = gr_face_cmap_footprint(cached);
+    gr_face_cmap_budget(cached, loaded);
+    testMapping(cmap, ref, 0x10);
+    testAssert("cache grew past a full budget\n", gr_face_cmap_footprint(cached) == loaded);
+
+    // Room for a page table and a few pages, which the page table counts against.
+    const size_t small = loaded + 0x100 * sizeof(void *) + 64;
+    gr_face_cmap_budget(cached, small);
+    testMapping(cmap, ref);
+    const size_t filled = gr_face_cmap_footprint(cached);
+    testAssert("cache ignored a small budget\n", filled > loaded && filled <= small);
+
+    // Raising the budget gives the pages left out another chance.
+    gr_face_cmap_budget(cached, size_t(-1));
+    testMapping(cmap, ref);
+    const size_t full = gr_face_cmap_footprint(cached);
+    testAssert("cache stayed within a raised budget\n", full > filled);
+    testMapping(cmap, ref);
+    testAssert("cache grew once full\n", gr_face_cmap_footprint(cached) == full);
+
+    // The coverage is read from the cmap table and leaves the cache alone, yet
+    //  holds just the characters the face supports, in the first three planes
+    //  at least. Those are the same for every script of a font with a single
+    //  silf subtable.
+    const gr_coverage * const coverage = gr_face_coverage(cached);
+    testAssert("no coverage\n", coverage);
+    testAssert("coverage filled the cache\n", gr_face_cmap_footprint(cached) == full);
+    for (uint32 usv = 0; usv != 0x30000; ++usv)
+    {
+        const int supported = gr_face_is_char_supported(cached, usv, 0);
+        if (!gr_coverage_has_char(coverage, usv) != !supported)
+        {
+            fprintf(stderr, "U+%04X is %ssupported but %scovered\n", usv, supported ? "" : "not ", supported ? "not " : "");
+            exit(1);
+        }
+    }
+    testAssert("coverage rebuilt\n", gr_face_coverage(cached) == coverage);
+
+    gr_face_destroy(cached);
+    gr_face_destroy(direct);
+    return 0;
+}
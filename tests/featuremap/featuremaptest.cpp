@@ -25,6 +25,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 #include <graphite2/Font.h>
 #include "inc/Endian.h"
 #include "inc/Face.h"
@@ -264,15 +265,91 @@ template <class T> void testFeatTable(const T & table, const char * testName)
                        table.m_settings[settingsIndex+j].m_label);
         }
     }
+    testAssert("test missing feat\n", !testFeatureMap.findFeatureRef(0x7A7A7A7A));
     gr_face_destroy(face);
 }
 
+// Checks each language's shared feature values match a copy of them.
+void testLangFeatures(const char * font)
+{
+    gr_face * face = gr_make_file_face(font, 0);
+    if (!face) throw std::runtime_error("failed to load font");
+    testAssert("test face languages\n", gr_face_n_languages(face));
+
+    for (gr_uint16 i = 0; i <= gr_face_n_languages(face); ++i)
+    {
+        const gr_uint32 lang = i < gr_face_n_languages(face) ? gr_face_lang_by_index(face, i) : 0x7A7A7A00;
+        const gr_feature_val * shared = gr_face_lang_featureval(face, lang);
+        gr_feature_val * copy = gr_face_featureval_for_lang(face, lang);
+        testAssert("test lang featureval\n", shared && copy);
+        testAssert("test lang shared\n", shared == gr_face_lang_featureval(face, lang));
+        testAssert("test lang interned\n", shared == gr_face_intern_featureval(face, copy));
+        for (gr_uint16 j = 0; j != gr_face_n_fref(face); ++j)
+        {
+            const gr_feature_ref * ref = gr_face_fref(face, j);
+            testAssertEqual("test lang feature value %hu %hu\n",
+                gr_fref_feature_value(ref, shared), gr_fref_feature_value(ref, copy));
+        }
+        gr_featureval_destroy(copy);
+    }
+    testAssert("test unknown lang\n", gr_face_lang_featureval(face, 0x7A7A7A00) == gr_face_lang_featureval(face, 0));
+
+    // Changed values intern to a new set, and only once.
+    gr_feature_val * changed = gr_featureval_clone(gr_face_lang_featureval(face, 0));
+    const gr_feature_ref * ref = gr_face_fref(face, 0);
+    gr_fref_set_feature_value(ref, gr_fref_feature_value(ref, changed) ? 0 : 1, changed);
+    const gr_feature_val * interned = gr_face_intern_featureval(face, changed);
+    testAssert("test intern changed\n", interned && interned != gr_face_lang_featureval(face, 0));
+    testAssert("test intern again\n", interned == gr_face_intern_featureval(face, changed));
+    testAssert("test intern interned\n", interned == gr_face_intern_featureval(face, interned));
+    gr_featureval_destroy(changed);
+    gr_face_destroy(face);
+}
+
+// Interning finds equal values again however the table has grown, and stops
+//  adding new ones once full unless told to.
+void testFeatureSets()
+{
+    FeatureMap map;
+    FeatureSets sets;
+    std::vector<const FeatureVal *> interned;
+    for (uint32 i = 0; i != FeatureSets::MAX_SETS; ++i)
+    {
+        FeatureVal feats(2, map);
+        feats[0] = i;
+        feats[1] = ~i;
+        const FeatureVal * const f = sets.intern(feats);
+        testAssert("test intern set\n", f && f != &feats && f->interned() == &sets && *f == feats);
+        testAssert("test intern interned set\n", sets.intern(*f) == f);
+        interned.push_back(f);
+    }
+    testAssertEqual("test interned count %zu %zu\n", sets.count(), FeatureSets::MAX_SETS);
+    for (uint32 i = 0; i != FeatureSets::MAX_SETS; ++i)
+    {
+        FeatureVal feats(2, map);
+        feats[0] = i;
+        feats[1] = ~i;
+        testAssert("test intern existing set\n", sets.intern(feats) == interned[i]);
+    }
+
+    FeatureVal extra(2, map);
+    extra[0] = extra[1] = 0;
+    testAssert("test intern past limit\n", !sets.intern(extra));
+    const FeatureVal * const forced = sets.intern(extra, true);
+    testAssert("test intern forced\n", forced && sets.intern(extra) == forced);
+    testAssertEqual("test forced count %zu %zu\n", sets.count(), FeatureSets::MAX_SETS + 1);
+
+    FeatureVal shorter(1, map);
+    shorter[0] = 0;
+    testAssert("test intern differing length\n", !sets.intern(shorter));
+}
+
 int main(int argc, char * argv[])
 {
     gr_face * face = 0;
     try
 	{
-		if (argc != 2)	throw std::length_error("not enough arguments: need a backing font");
+		if (argc != 3)	throw std::length_error("not enough arguments: need a backing font and a font with languages");
 
 		dummyFace = face_handle(argv[1]);
 		testFeatTable<FeatTableTestA>(testDataA, "A\n");
@@ -281,6 +358,8 @@ int main(int argc, char * argv[])
 		testFeatTable<FeatTableTestC>(testDataCunsorted, "C\n");
 		testFeatTable<FeatTableTestD>(testDataDunsorted, "D\n");
 		testFeatTable<FeatTableTestE>(testDataE, "E\n");
+		testLangFeatures(argv[2]);
+		testFeatureSets();
 
 		// test a bad settings offset stradling the end of the table
 		FeatureMap testFeatureMap;
@@ -0,0 +1,78 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <graphite2/Font.h>
+#include "inc/Face.h"
+#include "inc/GlyphCache.h"
+
+using namespace graphite2;
+
+// Reads every attribute of every glyph from a face loading its glyphs on
+//  demand, both as the read that loads the glyph and once it is loaded, and
+//  checks each against a preloaded face and the glyph's sparse attributes.
+bool testAttrs(const char * path)
+{
+    gr_face * const preloaded = gr_make_file_face(path, gr_face_preloadAll),
+            * const lazy      = gr_make_file_face(path, 0);
+    if (!preloaded || !lazy)
+    {
+        fprintf(stderr, "failed to load %s\n", path);
+        return false;
+    }
+    const GlyphCache & ref = static_cast<const Face *>(preloaded)->glyphs(),
+                     & demand = static_cast<const Face *>(lazy)->glyphs();
+
+    bool ok = ref.numGlyphs() == demand.numGlyphs() && ref.numAttrs() == demand.numAttrs();
+    for (uint16 gid = 0; ok && gid != ref.numGlyphs(); ++gid)
+    {
+        const GlyphFace & g = *ref.glyph(gid);
+        for (uint16 a = 0; a != ref.numAttrs(); ++a)
+        {
+            const uint16 v = g.attrs()[a];
+            if (ref.glyphAttr(gid, a) != v || demand.glyphAttr(gid, a) != v || demand.glyphAttr(gid, a) != v)
+            {
+                fprintf(stderr, "%s: glyph %u attribute %u is %u preloaded, %u on demand, not %u\n",
+                        path, gid, a, ref.glyphAttr(gid, a), demand.glyphAttr(gid, a), v);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    gr_face_destroy(lazy);
+    gr_face_destroy(preloaded);
+    return ok;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s font...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i != argc; ++i)
+        if (!testAttrs(argv[i])) return 1;
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+// Checks the LZ4 decompressor against a simple reference decoder, on blocks
+// made here from data with short and long repeats and on the compressed
+// tables of the fonts given, then times decompressing those tables. Damaged
+// blocks must be rejected, never read or written outside their buffers.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "inc/Decompressor.h"
+
+typedef unsigned char   byte;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const char * what, const char * name)
+    {
+        if (ok) return;
+        fprintf(stderr, "%s: %s\n", name, what);
+        ++failures;
+    }
+
+    unsigned long peek_be(const byte * p, int n)
+    {
+        unsigned long r = 0;
+        while (n--) r = r << 8 | *p++;
+        return r;
+    }
+
+    // A plain byte at a time decoder following the LZ4 block format.
+    long reference_decompress(const byte * src, size_t src_len, byte * dst, size_t dst_len)
+    {
+        const byte * const src_end = src + src_len;
+        size_t n = 0;
+        while (src < src_end)
+        {
+            const byte token = *src++;
+            size_t len = token >> 4;
+            if (len == 15)
+                for (byte b = 0xff; b == 0xff && src < src_end; len += b = *src++) {}
+            if (len > size_t(src_end - src) || len > dst_len - n) return -1;
+            memcpy(dst + n, src, len);
+            src += len; n += len;
+            if (src == src_end) break;
+
+            if (src_end - src < 2) return -1;
+            const size_t dist = src[0] | src[1] << 8;
+            src += 2;
+            len = token & 0xf;
+            if (len == 15)
+                for (byte b = 0xff; b == 0xff && src < src_end; len += b = *src++) {}
+            len += 4;
+            if (dist == 0 || dist > n || len > dst_len - n) return -1;
+            for (; len; --len, ++n) dst[n] = dst[n - dist];
+        }
+        return long(n);
+    }
+
+    void put_length(byte * & p, size_t len)
+    {
+        for (; len >= 255; len -= 255) *p++ = 255;
+        *p++ = byte(len);
+    }
+
+    // A greedy compressor, just good enough to produce valid blocks with a
+    // mix of literal runs and matches at every distance.
+    size_t compress(const byte * src, size_t len, byte * out)
+    {
+        static size_t last_seen[4096];
+        memset(last_seen, 0xff, sizeof last_seen);
+        byte * p = out;
+        size_t anchor = 0, i = 0;
+        while (len >= 12 && i <= len - 12)
+        {
+            const unsigned long quad = peek_be(src + i, 4);
+            const unsigned int h = (quad * 2654435761UL >> 12) & 4095;
+            const size_t cand = last_seen[h];
+            last_seen[h] = i;
+            if (cand == size_t(-1) || i - cand > 65535 || peek_be(src + cand, 4) != quad)
+            {
+                ++i;
+                continue;
+            }
+            size_t mlen = 4;
+            while (i + mlen < len - 5 && src[cand + mlen] == src[i + mlen]) ++mlen;
+
+            const size_t lit = i - anchor;
+            byte * const token = p++;
+            *token = byte((lit < 15 ? lit : 15) << 4 | (mlen - 4 < 15 ? mlen - 4 : 15));
+            if (lit >= 15) put_length(p, lit - 15);
+            memcpy(p, src + anchor, lit);
+            p += lit;
+            *p++ = byte(i - cand);
+            *p++ = byte((i - cand) >> 8);
+            if (mlen - 4 >= 15) put_length(p, mlen - 4 - 15);
+            i += mlen;
+            anchor = i;
+        }
+        const size_t lit = len - anchor;
+        *p++ = byte((lit < 15 ? lit : 15) << 4);
+        if (lit >= 15) put_length(p, lit - 15);
+        memcpy(p, src + anchor, lit);
+        return p + lit - out;
+    }
+
+    // Decompresses a block both ways, then damaged copies of it, which must
+    // be rejected or at least stay within bounds.
+    void test_block(const byte * block, size_t block_len, size_t out_len, const char * name)
+    {
+        byte * const expected = static_cast<byte *>(malloc(out_len)),
+             * const actual   = static_cast<byte *>(malloc(out_len)),
+             * const damaged  = static_cast<byte *>(malloc(block_len));
+        const long n = reference_decompress(block, block_len, expected, out_len);
+        check(n == long(out_len), "reference decoder failed", name);
+        check(lz4::decompress(block, block_len, actual, out_len) == n, "wrong size", name);
+        check(memcmp(expected, actual, out_len) == 0, "wrong contents", name);
+
+        unsigned long seed = 12345;
+        for (int i = 0; i != 200; ++i)
+        {
+            memcpy(damaged, block, block_len);
+            seed = seed * 1103515245 + 12345;
+            damaged[(seed >> 8) % block_len] ^= byte(seed >> 20) | 1;
+            const size_t len = i & 1 ? block_len : (seed >> 4) % block_len + 1;
+            const int r = lz4::decompress(damaged, len, actual, out_len);
+            check(r >= -1 && r <= int(out_len), "damaged block overran", name);
+        }
+
+        free(damaged);
+        free(actual);
+        free(expected);
+    }
+
+    void test_synthetic()
+    {
+        const size_t len = 1 << 18;
+        byte * const data = static_cast<byte *>(malloc(len)),
+             * const block = static_cast<byte *>(malloc(len + len/255 + 16));
+
+        // Runs repeating every 1 to 40 bytes, broken up by noise.
+        unsigned long seed = 1;
+        for (size_t i = 0; i < len;)
+        {
+            seed = seed * 1103515245 + 12345;
+            const size_t period = (seed >> 16) % 40 + 1,
+                         run = (seed >> 8) % 600 + 1;
+            for (size_t j = 0; j != run && i != len; ++j, ++i)
+                data[i] = j < period ? byte(seed >> (j % 24)) : data[i - period];
+        }
+        test_block(block, compress(data, len, block), len, "synthetic");
+
+        for (size_t i = 0; i != len; ++i) data[i] = byte(i / 1000);
+        test_block(block, compress(data, len, block), len, "runs");
+
+        free(block);
+        free(data);
+    }
+
+    byte * read_file(const char * name, size_t & len)
+    {
+        FILE * f = fopen(name, "rb");
+        if (!f) return 0;
+        fseek(f, 0, SEEK_END);
+        len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        byte * data = static_cast<byte *>(malloc(len));
+        if (data && fread(data, 1, len, f) != len)
+        {
+            free(data);
+            data = 0;
+        }
+        fclose(f);
+        return data;
+    }
+
+    // Checks and times every LZ4 compressed table in a font.
+    void test_font(const char * name)
+    {
+        size_t len = 0;
+        byte * const font = read_file(name, len);
+        check(font && len > 12, "cannot read font", name);
+        if (!font || len <= 12) return;
+
+        const size_t num_tables = peek_be(font + 4, 2);
+        for (size_t t = 0; t != num_tables && 12 + 16*(t+1) <= len; ++t)
+        {
+            const byte * const entry = font + 12 + 16*t;
+            const size_t offset = peek_be(entry + 8, 4),
+                         size   = peek_be(entry + 12, 4);
+            if (offset > len || size > len - offset || size < 8) continue;
+            char tag[5] = { char(entry[0]), char(entry[1]), char(entry[2]), char(entry[3]), 0 };
+            if (strcmp(tag, "Glat") != 0 && strcmp(tag, "Silf") != 0) continue;
+            const byte * const table = font + offset;
+            const unsigned long hdr = peek_be(table + 4, 4);
+            if (hdr >> 27 != 1) continue;   // not LZ4
+
+            const size_t out_len = hdr & 0x07ffffff;
+            test_block(table + 8, size - 8, out_len, tag);
+
+            // The decompressed table starts with the table's own version.
+            byte * const out = static_cast<byte *>(malloc(out_len));
+            lz4::decompress(table + 8, size - 8, out, out_len);
+            check(peek_be(out, 4) == peek_be(table, 4), "version mismatch", tag);
+
+            int runs = 0;
+            const clock_t start = clock();
+            clock_t elapsed;
+            do
+            {
+                lz4::decompress(table + 8, size - 8, out, out_len);
+                ++runs;
+            } while ((elapsed = clock() - start) < CLOCKS_PER_SEC/5);
+            const double secs = double(elapsed) / CLOCKS_PER_SEC;
+            printf("%s: %lu -> %lu bytes, %.1f MB/s\n", tag, (unsigned long)(size - 8),
+                   (unsigned long)out_len, out_len * double(runs) / secs / 1e6);
+            free(out);
+        }
+        free(font);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    test_synthetic();
+    for (int i = 1; i < argc; ++i)
+        test_font(argv[i]);
+
+    return failures ? 1 : 0;
+}
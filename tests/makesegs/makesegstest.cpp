@@ -0,0 +1,177 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// Shapes batches of strings with gr_make_segs, fresh and then reusing the
+//  segments for strings of other lengths, and checks every segment matches
+//  what gr_make_seg makes of the same string.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <graphite2/Font.h>
+#include <graphite2/Segment.h>
+
+namespace
+{
+    const size_t MAX_STRINGS = 16;
+
+    struct test_font
+    {
+        const char    * file;
+        const char    * lang;
+        int             dir;
+        gr_uint32       text[16];
+    };
+
+    const test_font fonts[] = {
+        { "Padauk.ttf", 0, 0, { 0x101e, 0x1004, 0x103a, 0x1039, 0x1001, 0x103b, 0x102d, 0x102f, 0x1004, 0x103a, 0x1038, 0 } },
+        { "Scheherazadegr.ttf", 0, 1, { 0x0628, 0x0628, 0x064E, 0x0644, 0x064E, 0x0654, 0x0627, 0x064E, 0x20, 0x0628, 0x064A, 0x062A, 0 } },
+        { "charis_r_gr.ttf", "vie", 0, { 0x0054, 0x0069, 0x1ec3, 0x0075, 0x20, 0x66, 0x69, 0x20, 0x0041, 0x0301, 0x56, 0x41, 0 } },
+        { "Awami_test.ttf", 0, 1, { 0x0628, 0x0627, 0x0644, 0x0628, 0x0631, 0x20, 0x0641, 0x062A, 0x0647, 0 } }
+    };
+
+    size_t length(const gr_uint32 * s) { size_t n = 0; while (s[n]) ++n; return n; }
+
+    bool sameSlot(const gr_slot * a, const gr_slot * b, const gr_face * face, const gr_font * font)
+    {
+        const gr_slot * const pa = gr_slot_attached_to(a),
+                      * const pb = gr_slot_attached_to(b);
+        return gr_slot_gid(a) == gr_slot_gid(b)
+            && gr_slot_origin_X(a) == gr_slot_origin_X(b)
+            && gr_slot_origin_Y(a) == gr_slot_origin_Y(b)
+            && gr_slot_advance_X(a, face, font) == gr_slot_advance_X(b, face, font)
+            && gr_slot_before(a) == gr_slot_before(b)
+            && gr_slot_after(a) == gr_slot_after(b)
+            && gr_slot_index(a) == gr_slot_index(b)
+            && (pa ? pb && gr_slot_index(pa) == gr_slot_index(pb) : !pb);
+    }
+
+    bool sameSeg(const gr_segment * a, gr_segment * b, const gr_face * face, const gr_font * font)
+    {
+        if (!a || !b) return !a && !b;
+        if (gr_seg_n_slots(a) != gr_seg_n_slots(b) || gr_seg_n_cinfo(a) != gr_seg_n_cinfo(b)
+                || gr_seg_advance_X(a) != gr_seg_advance_X(b) || gr_seg_advance_Y(a) != gr_seg_advance_Y(b))
+            return false;
+        for (unsigned int i = 0; i != gr_seg_n_cinfo(a); ++i)
+        {
+            const gr_char_info * const ca = gr_seg_cinfo(a, i),
+                               * const cb = gr_seg_cinfo(b, i);
+            if (gr_cinfo_before(ca) != gr_cinfo_before(cb) || gr_cinfo_after(ca) != gr_cinfo_after(cb)
+                    || gr_cinfo_base(ca) != gr_cinfo_base(cb) || gr_cinfo_break_weight(ca) != gr_cinfo_break_weight(cb))
+                return false;
+        }
+        const gr_slot * sa = gr_seg_first_slot(const_cast<gr_segment *>(a)),
+                      * sb = gr_seg_first_slot(b);
+        for (; sa && sb; sa = gr_slot_next_in_segment(sa), sb = gr_slot_next_in_segment(sb))
+            if (!sameSlot(sa, sb, face, font)) return false;
+        return !sa && !sb;
+    }
+
+    // Strings of the font's text cut to different lengths, the empty one
+    //  included, and the whole text repeated.
+    size_t makeStrings(const gr_uint32 * text, gr_uint32 (&buf)[MAX_STRINGS][64], const void * (&texts)[MAX_STRINGS], size_t (&lens)[MAX_STRINGS])
+    {
+        const size_t len = length(text);
+        size_t n = 0;
+        for (size_t l = 0; l <= len && n != MAX_STRINGS - 1; l += 3, ++n)
+        {
+            memcpy(buf[n], text, l * sizeof(gr_uint32));
+            lens[n] = l;
+        }
+        for (size_t r = 0; r != 4; ++r)
+            memcpy(buf[n] + r * len, text, len * sizeof(gr_uint32));
+        lens[n++] = 4 * len;
+        for (size_t i = 0; i != n; ++i)
+            texts[i] = buf[i];
+        return n;
+    }
+
+    bool testFont(const char * dir, const test_font & t)
+    {
+        char path[1024];
+        snprintf(path, sizeof path, "%s/%s", dir, t.file);
+        gr_face * const face = gr_make_file_face(path, 0);
+        gr_font * const font = face ? gr_make_font(12, face) : 0;
+        if (!font)
+        {
+            fprintf(stderr, "failed to load %s\n", path);
+            return false;
+        }
+        gr_feature_val * const feats = t.lang ? gr_face_featureval_for_lang(face, gr_str_to_tag(t.lang)) : 0;
+
+        gr_uint32 buf[MAX_STRINGS][64];
+        const void * texts[MAX_STRINGS];
+        size_t lens[MAX_STRINGS];
+        const size_t n = makeStrings(t.text, buf, texts, lens);
+        gr_segment * segs[MAX_STRINGS] = { 0 };
+
+        bool ok = true;
+        // Shape into new segments, then reuse them with the strings reversed
+        //  so each takes one of a different length.
+        for (int round = 0; ok && round != 2; ++round)
+        {
+            if (round)
+                for (size_t i = 0; i != n / 2; ++i)
+                {
+                    const void * const tt = texts[i]; texts[i] = texts[n - 1 - i]; texts[n - 1 - i] = tt;
+                    const size_t tl = lens[i]; lens[i] = lens[n - 1 - i]; lens[n - 1 - i] = tl;
+                }
+            size_t made = gr_make_segs(font, face, 0, feats, gr_utf32, texts, lens, n, t.dir, segs), expected = 0;
+            for (size_t i = 0; ok && i != n; ++i)
+            {
+                gr_segment * const ref = gr_make_seg(font, face, 0, feats, gr_utf32, texts[i], lens[i], t.dir);
+                expected += ref != 0;
+                if (!sameSeg(ref, segs[i], face, font))
+                {
+                    fprintf(stderr, "%s: round %d, string %u of length %u differs from gr_make_seg\n",
+                            t.file, round, unsigned(i), unsigned(lens[i]));
+                    ok = false;
+                }
+                gr_seg_destroy(ref);
+            }
+            if (ok && made != expected)
+            {
+                fprintf(stderr, "%s: round %d, gr_make_segs shaped %u strings, not %u\n", t.file, round, unsigned(made), unsigned(expected));
+                ok = false;
+            }
+        }
+
+        for (size_t i = 0; i != n; ++i)
+            gr_seg_destroy(segs[i]);
+        gr_featureval_destroy(feats);
+        gr_font_destroy(font);
+        gr_face_destroy(face);
+        return ok;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s fontdir\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (size_t i = 0; i != sizeof fonts / sizeof *fonts; ++i)
+        ok &= testFont(argv[1], fonts[i]);
+    return ok ? 0 : 1;
+}
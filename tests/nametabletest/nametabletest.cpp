@@ -128,6 +128,7 @@ void testLangId(void * data, size_t length, const char * id, uint16 expected)
     if (lId != expected)
     {
         fprintf(stderr, "%s lang id: %d expected: %d\n", id, lId, expected);
+        exit(1);
     }
 }
 
@@ -165,9 +166,10 @@ template <class T> T * toBigEndian1(T & table)
     bigEndian->m_langTagCount = be::swap<uint16>(table.m_langTagCount);
     for (size_t i = 0; i < table.m_langTagCount; i++)
     {
-        bigEndian->m_languages[i] = be::swap<uint16>(table.m_languages[i]);
-        bigEndian->m_languages[i] = be::swap<uint16>(table.m_languages[i]);
+        bigEndian->m_languages[i].length = be::swap<uint16>(table.m_languages[i].length);
+        bigEndian->m_languages[i].offset = be::swap<uint16>(table.m_languages[i].offset);
     }
+    return bigEndian;
 }
 
 int main(int, char **)
@@ -192,7 +194,7 @@ int main(int, char **)
     testLangId(testAData, sizeof(NameTestA), "en-GB-Cockney", 0x809);
     free(testAData);
 
-    struct NameTestB* testBData = toBigEndian<struct NameTestB>(testB);
+    struct NameTestB* testBData = toBigEndian1<struct NameTestB>(testB);
     testLangId(testBData, sizeof(NameTestB), "en-US", 0x409);
     testLangId(testBData, sizeof(NameTestB), "en-GB", 0x809);
     testLangId(testBData, sizeof(NameTestB), "ksw-MM", 0x8000);
@@ -54,7 +54,7 @@ void resolve_unicode_to_glyphs(const Face & face, utf_itr first, size_t n_chars,
 bool checkEntries(CachedFace
  * face, const char * testString, uint16 * glyphString, size_t testLength)
 {
-    gr_feature_val * defaultFeatures = gr_face_featureval_for_lang(api_cast(face), 0);
+    const gr_feature_val * defaultFeatures = gr_face_lang_featureval(api_cast(face), 0);
     SegCache * segCache = face->cacheStore()->getOrCreate(0, *defaultFeatures);
     const SegCacheEntry * entry = segCache->find(glyphString, testLength);
     if (!entry)
@@ -103,7 +103,6 @@ bool checkEntries(CachedFace
             return false;
         }
     }
-    gr_featureval_destroy(defaultFeatures);
     return true;
 }
 
@@ -160,7 +159,7 @@ int main(int argc, char ** argv)
     {
         testSeg(face, sizedFont, testStrings[i], &(testLengths[i]), &(testGlyphStrings[i]));
     }
-    gr_feature_val * defaultFeatures = gr_face_featureval_for_lang(api_cast(face), 0);
+    const gr_feature_val * defaultFeatures = gr_face_lang_featureval(api_cast(face), 0);
     SegCache * segCache = face->cacheStore()->getOrCreate(0, *defaultFeatures);
     unsigned int segCount = segCache->segmentCount();
     long long accessCount = segCache->totalAccessCount();
@@ -197,8 +196,42 @@ int main(int argc, char ** argv)
             segCount, accessCount);
         return -2;
     }
+
+    // Once the face has interned all the feature settings it will, segments
+    //  with new ones shape from a copy of their own, bypassing the cache.
+    FeatureSets & sets = face->featureSets();
+    for (uint32 i = 0; sets.count() < FeatureSets::MAX_SETS; ++i)
+    {
+        Features feats(*defaultFeatures);
+        feats.push_back(i);
+        if (!sets.intern(feats))
+        {
+            fprintf(stderr, "Failed to intern feature settings %u\n", i);
+            return -4;
+        }
+    }
+    Features uninterned(*defaultFeatures);
+    uninterned.push_back(~0U);
+    if (sets.intern(uninterned))
+    {
+        fprintf(stderr, "Interned feature settings past the limit\n");
+        return -4;
+    }
+    gr_segment * const segA = gr_make_seg(sizedFont, api_cast(face), 0, NULL, gr_utf8, "aaab", 4, 0);
+    segCount = segCache->segmentCount();
+    gr_segment * const segB = gr_make_seg(sizedFont, api_cast(face), 0, static_cast<gr_feature_val *>(&uninterned), gr_utf8, "aaab", 4, 0);
+    bool same = segA && segB && gr_seg_n_slots(segA) == gr_seg_n_slots(segB);
+    for (const gr_slot * a = same ? gr_seg_first_slot(segA) : 0, * b = same ? gr_seg_first_slot(segB) : 0;
+         a && b; a = gr_slot_next_in_segment(a), b = gr_slot_next_in_segment(b))
+        same = same && gr_slot_gid(a) == gr_slot_gid(b);
+    gr_seg_destroy(segA);
+    gr_seg_destroy(segB);
+    if (!same || segCache->segmentCount() != segCount)
+    {
+        fprintf(stderr, "Segment with uninterned feature settings differs\n");
+        return -4;
+    }
     gr_font_destroy(sizedFont);
-    gr_featureval_destroy(defaultFeatures);
 
     gr_stop_logging(api_cast(face));
     gr_face_destroy(api_cast(face));
@@ -0,0 +1,150 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// Links slots made in many blocks of a segment together and follows them
+//  back, then shapes a text too long for one block and walks its slots.
+
+#include <cstdio>
+#include <cstdlib>
+#include <graphite2/Font.h>
+#include <graphite2/Segment.h>
+#include "inc/Face.h"
+#include "inc/Segment.h"
+
+using namespace graphite2;
+
+template <typename T> void testAssert(const char * msg, const T b)
+{
+    if (!b)
+    {
+        fprintf(stderr, "%s", msg);
+        exit(1);
+    }
+}
+
+namespace
+{
+    const int NUM_SLOTS = 40,
+              NUM_BASES = 5,
+              LONG_TEXT = Slot::MAX_BLOCK_SLOTS + 5000;
+
+    // A one character segment makes its first block small and every one
+    //  after holds a single slot, so most links here cross blocks.
+    void testLinks(const Face & face)
+    {
+        Segment seg(1, &face, 0, 0);
+        testAssert("segment failed\n", bool(seg));
+        Slot * slots[NUM_SLOTS];
+        for (int i = 0; i != NUM_SLOTS; ++i)
+        {
+            slots[i] = seg.newSlot();
+            testAssert("newSlot failed\n", slots[i]);
+            for (int j = 0; j != i; ++j)
+                testAssert("newSlot returned a slot twice\n", slots[i] != slots[j]);
+        }
+
+        // Chain them last made first.
+        for (int i = 0; i != NUM_SLOTS; ++i)
+        {
+            slots[i]->next(i ? slots[i - 1] : NULL);
+            slots[i]->prev(i + 1 != NUM_SLOTS ? slots[i + 1] : NULL);
+        }
+
+        const Slot * s = slots[NUM_SLOTS - 1];
+        for (int i = NUM_SLOTS - 1; i >= 0; --i, s = s->next())
+            testAssert("next went astray\n", s == slots[i]);
+        testAssert("list didn't end\n", !s);
+        s = slots[0];
+        for (int i = 0; i != NUM_SLOTS; ++i, s = s->prev())
+            testAssert("prev went astray\n", s == slots[i]);
+        testAssert("list didn't start\n", !s);
+
+        // Hang the rest off the first few.
+        for (int i = NUM_BASES; i != NUM_SLOTS; ++i)
+        {
+            Slot * const base = slots[(i * 7) % NUM_BASES];
+            slots[i]->attachTo(base);
+            testAssert("child refused\n", base->child(slots[i]));
+        }
+
+        for (int i = NUM_BASES; i != NUM_SLOTS; ++i)
+        {
+            const Slot * const base = slots[(i * 7) % NUM_BASES];
+            testAssert("attachedTo went astray\n", slots[i]->attachedTo() == base);
+            bool found = false;
+            int n = 0;
+            for (const Slot * c = base->firstChild(); c && n != NUM_SLOTS; c = c->nextSibling(), ++n)
+                found |= c == slots[i];
+            testAssert("child not among its base's children\n", found);
+        }
+
+        // Freed slots come back with no links left over.
+        for (int i = NUM_SLOTS - 1; i != 0; --i)
+            seg.freeSlot(slots[i]);
+        for (int i = 1; i != NUM_SLOTS; ++i)
+        {
+            Slot * const r = seg.newSlot();
+            testAssert("reused slot kept links\n", r && !r->next() && !r->prev() && !r->attachedTo() && !r->firstChild() && !r->nextSibling());
+        }
+    }
+
+    // A text too long for one block is walked both ways through the API.
+    void testLongText(const gr_face * face, const gr_font * font)
+    {
+        gr_uint32 * const text = static_cast<gr_uint32 *>(malloc(LONG_TEXT * sizeof(gr_uint32)));
+        testAssert("out of memory\n", text);
+        for (int i = 0; i != LONG_TEXT; ++i)
+            text[i] = i % 5 == 4 ? 0x20 : 0x61 + i % 3;
+        gr_segment * const seg = gr_make_seg(font, face, 0, 0, gr_utf32, text, LONG_TEXT, 0);
+        testAssert("long segment failed\n", seg);
+
+        unsigned int n = 0;
+        const gr_slot * s = gr_seg_first_slot(seg), * last = 0;
+        for (; s && n <= gr_seg_n_slots(seg); last = s, s = gr_slot_next_in_segment(s))
+            testAssert("slots out of order\n", gr_slot_index(s) == n++);
+        testAssert("forward walk missed slots\n", n == gr_seg_n_slots(seg) && last == gr_seg_last_slot(seg));
+        for (s = last; s && n; s = gr_slot_prev_in_segment(s))
+            testAssert("backward walk went astray\n", gr_slot_index(s) == --n);
+        testAssert("backward walk missed slots\n", n == 0 && !s);
+
+        gr_seg_destroy(seg);
+        free(text);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s font.ttf\n", argv[0]);
+        return 1;
+    }
+    gr_face * const face = gr_make_file_face(argv[1], 0);
+    gr_font * const font = face ? gr_make_font(12, face) : 0;
+    testAssert("failed to load font\n", font);
+
+    testLinks(*static_cast<const Face *>(face));
+    testLongText(face, font);
+
+    gr_font_destroy(font);
+    gr_face_destroy(face);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <graphite2/Font.h>
+#include <graphite2/Segment.h>
+#include "inc/Face.h"
+#include "inc/GlyphCache.h"
+#include "inc/Snapshot.h"
+#include "inc/TtfUtil.h"
+
+using namespace graphite2;
+
+// A font held in memory so its tables can be altered between loads.
+class font_image
+{
+public:
+    font_image(const char * path)
+    {
+        std::ifstream file(path, std::ifstream::binary);
+        _data.resize(size_t(file.seekg(0, std::ios::end).tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(&_data[0], _data.size());
+    }
+
+    char * table(const TtfUtil::Tag name, size_t & len)
+    {
+        size_t dir_off, dir_len, off;
+        if (_data.empty() || !TtfUtil::CheckHeader(&_data[0])
+            || !TtfUtil::GetTableDirInfo(&_data[0], dir_off, dir_len)
+            || !TtfUtil::GetTableInfo(name, &_data[0], &_data[dir_off], off, len))
+            return 0;
+        return &_data[off];
+    }
+
+    // Recomputes the table directory checksums and head's checksum
+    //  adjustment, as a font tool does after changing a table.
+    void update_checksums()
+    {
+        size_t dir_off, dir_len, head_len;
+        char * const head = table(TtfUtil::Tag::head, head_len);
+        if (!head || !TtfUtil::GetTableDirInfo(&_data[0], dir_off, dir_len)) return;
+        put32(head + 8, 0);
+        for (size_t e = dir_off; e + 16 <= dir_off + dir_len; e += 16)
+            put32(&_data[e + 4], sum(get32(&_data[e + 8]), get32(&_data[e + 12])));
+        put32(head + 8, 0xB1B0AFBA - sum(0, _data.size()));
+    }
+
+    static const gr_face_ops ops;
+
+private:
+    static gr_uint32 get32(const char * p)
+    {
+        const unsigned char * const b = reinterpret_cast<const unsigned char *>(p);
+        return (gr_uint32(b[0]) << 24) | (gr_uint32(b[1]) << 16) | (gr_uint32(b[2]) << 8) | b[3];
+    }
+
+    static void put32(char * p, gr_uint32 v)
+    {
+        p[0] = char(v >> 24); p[1] = char(v >> 16); p[2] = char(v >> 8); p[3] = char(v);
+    }
+
+    gr_uint32 sum(size_t off, size_t len) const
+    {
+        gr_uint32 s = 0;
+        char word[4];
+        for (size_t i = off; i < off + len && i < _data.size(); i += 4)
+        {
+            for (size_t j = 0; j != 4; ++j)
+                word[j] = i + j < off + len && i + j < _data.size() ? _data[i + j] : 0;
+            s += get32(word);
+        }
+        return s;
+    }
+
+    static const void * get_table_fn(const void * afh, unsigned int name, size_t * len)
+    {
+        return const_cast<font_image *>(static_cast<const font_image *>(afh))->table(name, *len);
+    }
+
+    std::vector<char>   _data;
+};
+
+const gr_face_ops font_image::ops = { sizeof(gr_face_ops), font_image::get_table_fn, 0 };
+
+
+template <typename T> void testAssert(const char * msg, const T b)
+{
+    if (!b)
+    {
+        fprintf(stderr, "%s", msg);
+        exit(1);
+    }
+}
+
+bool matches(const gr_face * face, const std::vector<byte> & snap)
+{
+    SnapshotReader r(&snap[0], snap.size());
+    return static_cast<const Face *>(face)->matchSnapshot(r);
+}
+
+// Shapes the same text with both faces and compares the glyphs and positions.
+bool sameShaping(const gr_face * a, const gr_face * b)
+{
+    static const gr_uint16 text[] = { 0x1015, 0x102F, 0x100F, 0x1039, 0x100F, 0x1031, 0x1038, 0x1000, 0x103C, 0x102D, 0x102F };
+    const size_t n = sizeof text / sizeof *text;
+    gr_font * const fa = gr_make_font(12, a),
+            * const fb = gr_make_font(12, b);
+    gr_segment * const sa = gr_make_seg(fa, a, 0, 0, gr_utf16, text, n, 0),
+               * const sb = gr_make_seg(fb, b, 0, 0, gr_utf16, text, n, 0);
+    bool same = sa && sb && gr_seg_n_slots(sa) == gr_seg_n_slots(sb)
+                && gr_seg_advance_X(sa) == gr_seg_advance_X(sb);
+    for (const gr_slot * s = same ? gr_seg_first_slot(sa) : 0, * t = same ? gr_seg_first_slot(sb) : 0;
+         s && t; s = gr_slot_next_in_segment(s), t = gr_slot_next_in_segment(t))
+        same = same && gr_slot_gid(s) == gr_slot_gid(t)
+                    && gr_slot_origin_X(s) == gr_slot_origin_X(t)
+                    && gr_slot_origin_Y(s) == gr_slot_origin_Y(t);
+    gr_seg_destroy(sa); gr_seg_destroy(sb);
+    gr_font_destroy(fa); gr_font_destroy(fb);
+    return same;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s font\n", argv[0]);
+        return 1;
+    }
+
+    font_image font(argv[1]);
+    gr_face * face = gr_make_face_with_ops(&font, &font_image::ops, gr_face_preloadAll);
+    testAssert("failed to load font\n", face);
+
+    std::vector<byte> snap(gr_face_snapshot(face, 0, 0));
+    testAssert("empty snapshot\n", !snap.empty());
+    testAssert("snapshot size changed\n", gr_face_snapshot(face, &snap[0], snap.size()) == snap.size());
+    testAssert("snapshot doesn't match its own font\n", matches(face, snap));
+
+    // Round trip: a face read from the snapshot shapes as the original does.
+    gr_face * copy = gr_make_face_from_snapshot_with_ops(&font, &font_image::ops, &snap[0], snap.size(), 0);
+    testAssert("failed to load face from snapshot\n", copy);
+    testAssert("snapshot face shapes differently\n", sameShaping(face, copy));
+    const GlyphCache & glyphs = static_cast<const Face *>(face)->glyphs(),
+                     & copied = static_cast<const Face *>(copy)->glyphs();
+    testAssert("snapshot glyph count differs\n", glyphs.numGlyphs() == copied.numGlyphs());
+    for (unsigned short gid = 0; gid != glyphs.numGlyphs(); ++gid)
+        testAssert("snapshot glyph box differs\n", glyphs.glyph(gid)->theBBox().tr.y == copied.glyph(gid)->theBBox().tr.y);
+    gr_face_destroy(copy);
+
+    // A damaged snapshot is ignored.
+    snap.back() ^= 0xFF;
+    testAssert("damaged snapshot matched\n", !matches(face, snap));
+    snap.back() ^= 0xFF;
+
+    // So is one taken before the glyph outlines changed, once the font's
+    //  checksums are updated, and the changed bounding box is read from the
+    //  font instead.
+    size_t glyf_len, loca_len, head_len;
+    char * const glyf = font.table(TtfUtil::Tag::glyf, glyf_len);
+    const char * const loca = font.table(TtfUtil::Tag::loca, loca_len),
+               * const head = font.table(TtfUtil::Tag::head, head_len);
+    testAssert("font has no glyf table\n", glyf && loca && head);
+    unsigned short gid = 1;
+    byte * outline = 0;
+    for (; gid != glyphs.numGlyphs() && !outline; ++gid)
+        outline = static_cast<byte *>(TtfUtil::GlyfLookup(gid, glyf, loca, glyf_len, loca_len, head));
+    testAssert("font has no outlines\n", outline);
+    --gid;
+    const float y_max = glyphs.glyph(gid)->theBBox().tr.y;
+    outline[8] ^= 0x40;     // high byte of yMax
+    font.update_checksums();
+    testAssert("snapshot of changed glyf matched\n", !matches(face, snap));
+    gr_face * changed = gr_make_face_from_snapshot_with_ops(&font, &font_image::ops, &snap[0], snap.size(), gr_face_preloadAll);
+    testAssert("failed to load changed face\n", changed);
+    testAssert("changed glyph box read from snapshot\n",
+               static_cast<const Face *>(changed)->glyphs().glyph(gid)->theBBox().tr.y != y_max);
+    gr_face_destroy(changed);
+
+    gr_face_destroy(face);
+    return 0;
+}
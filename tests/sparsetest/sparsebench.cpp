@@ -0,0 +1,218 @@
+/*-----------------------------------------------------------------------------
+Copyright (C) 2011 SIL International
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+
+Description:
+A microbenchmark of sparse lookups over the glyph attributes in the Glat
+tables of real fonts. Each glyph's attributes are loaded into a sparse array
+as the glyph cache does, checked against a plain array, and then every
+attribute of every glyph is looked up repeatedly, one at a time and in bulk.
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "inc/Sparse.h"
+
+using namespace graphite2;
+
+namespace
+{
+    typedef std::pair<sparse::key_type, sparse::mapped_type>  attr;
+
+    unsigned long peek(const unsigned char * p, int n)
+    {
+        unsigned long v = 0;
+        while (n--) v = (v << 8) | *p++;
+        return v;
+    }
+
+    // Finds a table in the font's sfnt directory.
+    const unsigned char * find_table(const std::vector<unsigned char> & font, const char * tag, size_t & len)
+    {
+        if (font.size() < 12) return 0;
+        const unsigned long name = peek(reinterpret_cast<const unsigned char *>(tag), 4);
+        const size_t num_tables = peek(&font[4], 2);
+        for (size_t i = 0; i != num_tables && 12 + i*16 + 16 <= font.size(); ++i)
+        {
+            const unsigned char * const e = &font[12 + i*16];
+            if (peek(e, 4) != name) continue;
+            const size_t offset = peek(e + 8, 4);
+            len = peek(e + 12, 4);
+            return offset <= font.size() && len <= font.size() - offset ? &font[offset] : 0;
+        }
+        return 0;
+    }
+
+    // Reads the attributes of every glyph, as attribute number and value
+    //  pairs, from an uncompressed Glat table, returning the number of
+    //  attributes per glyph or 0 if the tables can't be read.
+    unsigned int read_glat(const std::vector<unsigned char> & font, std::vector<std::vector<attr> > & glyphs)
+    {
+        size_t glat_len = 0, gloc_len = 0;
+        const unsigned char * const glat = find_table(font, "Glat", glat_len),
+                            * const gloc = find_table(font, "Gloc", gloc_len);
+        if (!glat || !gloc || glat_len < 8 || gloc_len < 8) return 0;
+
+        const unsigned long version = peek(glat, 4);
+        if (version >= 0x00040000 || (version >= 0x00030000 && peek(glat + 4, 4) >> 27))
+            return 0;   // too new or compressed
+
+        const unsigned int flags = peek(gloc + 4, 2),
+                           num_attrs = peek(gloc + 6, 2),
+                           width = flags & 1 ? 4 : 2;
+        const size_t num_glyphs = (gloc_len - 8 - (flags & 2 ? num_attrs*2 : 0)) / width - 1;
+        for (size_t gid = 0; gid != num_glyphs; ++gid)
+        {
+            size_t p = peek(gloc + 8 + gid*width, width);
+            const size_t e = peek(gloc + 8 + (gid + 1)*width, width);
+            if (e > glat_len || p > e) return 0;
+            if (version >= 0x00030000)
+            {
+                unsigned int bmap = peek(glat + p, 2), subs = 0;
+                for (; bmap; bmap &= bmap - 1) ++subs;
+                p += 6 + 8*subs;
+            }
+
+            std::vector<attr> attrs;
+            const int w = version >= 0x00020000 ? 2 : 1;
+            while (p + 2*w <= e)
+            {
+                const unsigned int k = peek(glat + p, w),
+                                   n = peek(glat + p + w, w);
+                p += 2*w;
+                for (unsigned int i = 0; i != n && p + 2 <= e; ++i, p += 2)
+                    attrs.push_back(attr(k + i, peek(glat + p, 2)));
+            }
+            glyphs.push_back(attrs);
+        }
+        return num_attrs;
+    }
+
+    double seconds(const clock_t start)
+    {
+        return double(clock() - start) / CLOCKS_PER_SEC;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Each measurement runs for at least this long.
+    const double run_time = argc > 1 && std::string(argv[1]) == "-long" ? 2.0 : 0.1;
+    if (run_time > 0.1) { --argc; ++argv; }
+
+    for (int a = 1; a < argc; ++a)
+    {
+        std::vector<unsigned char> font;
+        if (FILE * f = fopen(argv[a], "rb"))
+        {
+            unsigned char buf[4096];
+            for (size_t n; (n = fread(buf, 1, sizeof buf, f)) != 0;)
+                font.insert(font.end(), buf, buf + n);
+            fclose(f);
+        }
+
+        std::vector<std::vector<attr> > attrs;
+        const unsigned int num_attrs = read_glat(font, attrs);
+        if (!num_attrs)
+        {
+            std::cout << argv[a] << ": no uncompressed Glat table, skipped" << std::endl;
+            continue;
+        }
+
+        // Build the sparse arrays and check them against plain arrays.
+        std::vector<sparse *> glyphs;
+        std::vector<sparse::key_type> keys(num_attrs);
+        std::vector<sparse::mapped_type> expected(num_attrs), got(num_attrs);
+        for (unsigned int k = 0; k != num_attrs; ++k)
+            keys[k] = sparse::key_type(k);
+        for (size_t gid = 0; gid != attrs.size(); ++gid)
+        {
+            const attr * const first = attrs[gid].empty() ? 0 : &attrs[gid][0];
+            sparse * const sp = new sparse(first, first + attrs[gid].size());
+            if (!*sp) return 1;
+            glyphs.push_back(sp);
+
+            std::fill(expected.begin(), expected.end(), 0);
+            for (size_t i = 0; i != attrs[gid].size(); ++i)
+                if (attrs[gid][i].first < num_attrs)
+                    expected[attrs[gid][i].first] = attrs[gid][i].second;
+            sp->get_many(&keys[0], &got[0], num_attrs);
+            for (unsigned int k = 0; k != num_attrs; ++k)
+            {
+                if ((*sp)[k] != expected[k])    return 2;
+                if (got[k] != expected[k])      return 3;
+            }
+        }
+
+        // Look every attribute of every glyph up, one at a time.
+        unsigned long sum = 0, lookups = 0;
+        clock_t start = clock();
+        do
+        {
+            for (size_t gid = 0; gid != glyphs.size(); ++gid)
+            {
+                const sparse & sp = *glyphs[gid];
+                for (unsigned int k = 0; k != num_attrs; ++k)
+                    sum += sp[sparse::key_type(k)];
+            }
+            lookups += glyphs.size() * num_attrs;
+        } while (seconds(start) < run_time);
+        const double single = lookups / seconds(start);
+
+        // And in bulk.
+        lookups = 0;
+        start = clock();
+        do
+        {
+            for (size_t gid = 0; gid != glyphs.size(); ++gid)
+            {
+                glyphs[gid]->get_many(&keys[0], &got[0], num_attrs);
+                sum += got[gid % num_attrs];
+            }
+            lookups += glyphs.size() * num_attrs;
+        } while (seconds(start) < run_time);
+        const double bulk = lookups / seconds(start);
+
+        size_t bytes = 0;
+        for (size_t gid = 0; gid != glyphs.size(); ++gid)
+        {
+            bytes += glyphs[gid]->_sizeof();
+            delete glyphs[gid];
+        }
+
+        std::cout << argv[a] << ":" << std::endl
+                  << "\tglyphs:         " << glyphs.size() << std::endl
+                  << "\tattributes:     " << num_attrs << std::endl
+                  << "\tsize:           " << bytes << std::endl
+                  << "\tlookups/s:      " << single << std::endl
+                  << "\tbulk lookups/s: " << bulk << std::endl
+                  << "\t(checksum " << sum << ")" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street,
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the
+    internet at http://www.fsf.org/licenses/lgpl.html.
+*/
+// Has several threads update shared state under one SpinLock and checks no
+// two were ever inside it at once and no update was lost.
+
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include "inc/Atomic.h"
+
+using namespace graphite2;
+
+namespace
+{
+    const int NUM_THREADS = 4,
+              NUM_LOCKS   = 1000000;
+
+    SpinLock        lock;
+    volatile long   inside = 0;
+    volatile long   counter = 0;
+    volatile bool   overlapped = false;
+
+    void * worker(void *)
+    {
+        for (int i = 0; i != NUM_LOCKS; ++i)
+        {
+            SpinLock::holder h(lock);
+            if (inside++ != 0) overlapped = true;
+            const long c = counter;
+            counter = c + 1;
+            --inside;
+        }
+        return 0;
+    }
+}
+
+int main(int, char **)
+{
+    // The lock is usable again once released, with no other thread about.
+    lock.lock();
+    lock.unlock();
+    {
+        SpinLock::holder h(lock);
+    }
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i != NUM_THREADS; ++i)
+        if (pthread_create(threads + i, 0, worker, 0))
+        {
+            fprintf(stderr, "failed to start thread %d\n", i);
+            return 1;
+        }
+    for (int i = 0; i != NUM_THREADS; ++i)
+        pthread_join(threads[i], 0);
+
+    if (overlapped)
+    {
+        fprintf(stderr, "two threads held the lock at once\n");
+        return 1;
+    }
+    if (counter != NUM_THREADS * NUM_LOCKS)
+    {
+        fprintf(stderr, "lost updates: counted %ld of %d\n", counter, NUM_THREADS * NUM_LOCKS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*  GRAPHITE2 LICENSING
+
+    Copyright 2015, SIL International
+    All rights reserved.
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should also have received a copy of the GNU Lesser General Public
+    License along with this library in the file named "LICENSE".
+    If not, write to the Free Software Foundation, 51 Franklin Street, 
+    Suite 500, Boston, MA 02110-1335, USA or visit their web page on the 
+    internet at http://www.fsf.org/licenses/lgpl.html.
+
+Alternatively, the contents of this file may be used under the terms of the
+Mozilla Public License (http://mozilla.org/MPL) or the GNU General Public
+License, as published by the Free Software Foundation, either version 2
+of the License or (at your option) any later version.
+*/
+// Shapes text from several threads at once through a single face that loads
+// its glyphs and passes on demand, and checks every thread gets the same
+// result as shaping with a fully preloaded face. Then checks a face loaded in
+// the background can be shaped with while its ready callback still runs.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <pthread.h>
+#include <graphite2/Segment.h>
+
+namespace
+{
+    const int NUM_THREADS = 4,
+              NUM_RUNS    = 50,
+              TEXT_LEN    = 64;
+
+    struct glyph_info
+    {
+        float           x, y;
+        unsigned int    gid;
+    };
+
+    struct job
+    {
+        const gr_face * face;
+        const gr_font * font;
+        unsigned int    text[TEXT_LEN];
+        glyph_info      expected[TEXT_LEN*4];
+        size_t          num_expected;
+        bool            failed;
+    };
+
+    size_t shape(const gr_face * face, const gr_font * font, const unsigned int * text, glyph_info * out, size_t max)
+    {
+        gr_segment * seg = gr_make_seg(font, face, 0, 0, gr_utf32, text, TEXT_LEN, 0);
+        if (!seg) return 0;
+        size_t n = 0;
+        for (const gr_slot * s = gr_seg_first_slot(seg); s && n != max; s = gr_slot_next_in_segment(s), ++n)
+        {
+            out[n].gid = gr_slot_gid(s);
+            out[n].x = gr_slot_origin_X(s);
+            out[n].y = gr_slot_origin_Y(s);
+        }
+        gr_seg_destroy(seg);
+        return n;
+    }
+
+    void * worker(void * data)
+    {
+        job & j = *static_cast<job *>(data);
+        glyph_info result[TEXT_LEN*4];
+        for (int run = 0; run != NUM_RUNS && !j.failed; ++run)
+        {
+            const size_t n = shape(j.face, j.font, j.text, result, TEXT_LEN*4);
+            j.failed = n != j.num_expected || memcmp(result, j.expected, n * sizeof(glyph_info)) != 0;
+        }
+        return 0;
+    }
+
+    // A font read into memory, for gr_make_face_async.
+    struct font_data
+    {
+        std::vector<unsigned char> bytes;
+
+        static size_t be(const unsigned char * p, int n)
+        {
+            size_t v = 0;
+            while (n--) v = (v << 8) | *p++;
+            return v;
+        }
+
+        static const void * get_table(const void * afh, unsigned int name, size_t * len)
+        {
+            const std::vector<unsigned char> & b = static_cast<const font_data *>(afh)->bytes;
+            if (b.size() < 12 || b.size() < 12 + be(&b[4], 2) * 16) return 0;
+            for (size_t e = 12, end = e + be(&b[4], 2) * 16; e != end; e += 16)
+            {
+                if (be(&b[e], 4) != name) continue;
+                const size_t offset = be(&b[e + 8], 4), length = be(&b[e + 12], 4);
+                if (offset > b.size() || length > b.size() - offset) return 0;
+                *len = length;
+                return &b[offset];
+            }
+            return 0;
+        }
+    };
+
+    // The ready callback holds on until the main thread has shaped with the
+    //  face, or gives up after a few seconds if it never does.
+    struct ready_wait
+    {
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+        bool            shaped,
+                        called,
+                        timed_out;
+    };
+
+    void on_ready(gr_face *, int, void * data)
+    {
+        ready_wait & w = *static_cast<ready_wait *>(data);
+        timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 5;
+        pthread_mutex_lock(&w.lock);
+        w.called = true;
+        while (!w.shaped && !w.timed_out)
+            w.timed_out = pthread_cond_timedwait(&w.cond, &w.lock, &until) != 0;
+        pthread_mutex_unlock(&w.lock);
+    }
+
+    bool shape_during_callback(const char * path, const job & ref)
+    {
+        font_data font;
+        FILE * f = fopen(path, "rb");
+        if (!f) return false;
+        unsigned char buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof buf, f)) != 0;)
+            font.bytes.insert(font.bytes.end(), buf, buf + n);
+        fclose(f);
+
+        ready_wait w = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, false, false };
+        const gr_face_ops ops = { sizeof(gr_face_ops), &font_data::get_table, 0 };
+        gr_face * const face = gr_make_face_async(&font, &ops, gr_face_lazyPasses, on_ready, &w);
+        gr_font * const font12 = face ? gr_make_font(12, face) : 0;
+        glyph_info result[TEXT_LEN*4];
+        const size_t n = font12 ? shape(face, font12, ref.text, result, TEXT_LEN*4) : 0;
+
+        pthread_mutex_lock(&w.lock);
+        w.shaped = true;
+        pthread_cond_signal(&w.cond);
+        pthread_mutex_unlock(&w.lock);
+
+        gr_font_destroy(font12);
+        gr_face_destroy(face);      // waits for the callback to return
+        return w.called && !w.timed_out
+            && n == ref.num_expected && memcmp(result, ref.expected, n * sizeof(glyph_info)) == 0;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s font [first_usv]\n", argv[0]);
+        return 1;
+    }
+    const unsigned int first_usv = argc > 2 ? strtoul(argv[2], 0, 16) : 0x41;
+
+    gr_face * const preloaded = gr_make_file_face(argv[1], gr_face_preloadAll),
+            * const lazy      = gr_make_file_face(argv[1], gr_face_lazyPasses);
+    if (!preloaded || !lazy)
+    {
+        fprintf(stderr, "failed to load %s\n", argv[1]);
+        return 2;
+    }
+    gr_font * const ref_font  = gr_make_font(12, preloaded),
+            * const lazy_font = gr_make_font(12, lazy);
+
+    // Each thread gets a different stretch of text so they race to load
+    //  overlapping but different sets of glyphs.
+    job jobs[NUM_THREADS];
+    for (int t = 0; t != NUM_THREADS; ++t)
+    {
+        job & j = jobs[t];
+        for (int i = 0; i != TEXT_LEN; ++i)
+            j.text[i] = first_usv + (i * 7 + t * 13) % 0x3A;
+        j.face = lazy;
+        j.font = lazy_font;
+        j.failed = false;
+        j.num_expected = shape(preloaded, ref_font, j.text, j.expected, TEXT_LEN*4);
+        if (!j.num_expected)
+        {
+            fprintf(stderr, "failed to shape reference text %d\n", t);
+            return 3;
+        }
+    }
+
+    pthread_t threads[NUM_THREADS];
+    for (int t = 0; t != NUM_THREADS; ++t)
+        pthread_create(threads + t, 0, worker, jobs + t);
+    int res = 0;
+    for (int t = 0; t != NUM_THREADS; ++t)
+    {
+        pthread_join(threads[t], 0);
+        if (jobs[t].failed)
+        {
+            fprintf(stderr, "thread %d did not match the preloaded face\n", t);
+            res = 4;
+        }
+    }
+
+    if (!shape_during_callback(argv[1], jobs[0]))
+    {
+        fprintf(stderr, "shaping waited for the async face's ready callback\n");
+        res = 5;
+    }
+
+    gr_font_destroy(lazy_font);
+    gr_font_destroy(ref_font);
+    gr_face_destroy(lazy);
+    gr_face_destroy(preloaded);
+    return res;
+}
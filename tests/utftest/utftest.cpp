@@ -1,5 +1,6 @@
 #include <graphite2/Segment.h>
 #include <stdio.h>
+#include <string.h>
 
 struct test8
 {
@@ -42,6 +43,8 @@ struct test16 tests16[] = {
 
 const int numtests16 = sizeof(tests16)/sizeof(test16);
 
+const int LONG_LEN = 40;
+
 int main(int argc, char * argv[]) {
     int i;
     const void * error;
@@ -76,7 +79,7 @@ int main(int argc, char * argv[]) {
 
     for (i = 0; i < numtests16; ++i)
     {
-        int res = gr_count_unicode_characters(gr_utf16, tests16[i].str, tests16[i].str + sizeof(tests16[i].str), &error);
+        int res = gr_count_unicode_characters(gr_utf16, tests16[i].str, tests16[i].str + sizeof(tests16[i].str)/sizeof(*tests16[i].str), &error);
         if (tests16[i].error >= 0)
         {
         	if (!error)
@@ -101,5 +104,61 @@ int main(int argc, char * argv[]) {
             return (i+1);
         }
     }
+
+    // Long enough runs to be decoded a word at a time, broken at every
+    //  position by a character that needs decoding or is invalid.
+    for (i = 0; i < LONG_LEN - 1; ++i)
+    {
+        unsigned char       str8[LONG_LEN + 2];
+        unsigned short      str16[LONG_LEN + 1];
+        unsigned int        usv[LONG_LEN + 1];
+        memset(str8, 'a', sizeof str8);
+        for (int j = 0; j < LONG_LEN + 1; ++j)
+            str16[j] = j % 2 ? 0x0915 : 'a';        // alternate latin and devanagari
+
+        // A two byte sequence, U+E9, decodes.
+        str8[i] = 0xC3; str8[i+1] = 0xA9;
+        size_t res = gr_decode_unicode_characters(gr_utf8, str8, str8 + LONG_LEN, usv, LONG_LEN + 1, &error);
+        if (error || res != size_t(LONG_LEN - 1) || usv[i] != 0xE9 || usv[0] != (i ? 'a' : 0xE9) || usv[res-1] != (i == LONG_LEN - 2 ? 0xE9 : 'a'))
+        {
+            fprintf(stderr, "%s: long test 8:%d failed: decoding failure\n", argv[0], i + 1);
+            return 100 + i;
+        }
+
+        // A lone continuation byte stops it.
+        str8[i] = 0x80;
+        res = gr_count_unicode_characters(gr_utf8, str8, str8 + LONG_LEN, &error);
+        if (res != size_t(i) || !error || (const unsigned char *)error - str8 != i)
+        {
+            fprintf(stderr, "%s: long test 8:%d failed: error not found\n", argv[0], i + 1);
+            return 100 + i;
+        }
+
+        // As does a lone low surrogate, but not the characters around it.
+        res = gr_decode_unicode_characters(gr_utf16, str16, str16 + LONG_LEN, usv, LONG_LEN + 1, &error);
+        if (error || res != size_t(LONG_LEN) || usv[i] != str16[i])
+        {
+            fprintf(stderr, "%s: long test 16:%d failed: decoding failure\n", argv[0], i + 1);
+            return 100 + i;
+        }
+        str16[i] = 0xDC00;
+        res = gr_count_unicode_characters(gr_utf16, str16, str16 + LONG_LEN, &error);
+        if (res != size_t(i) || !error || (const unsigned short *)error - str16 != i)
+        {
+            fprintf(stderr, "%s: long test 16:%d failed: error not found\n", argv[0], i + 1);
+            return 100 + i;
+        }
+
+        // A nul ends a string early without an error, and the decode respects
+        //  the room it is given.
+        str16[i] = 0;
+        res = gr_count_unicode_characters(gr_utf16, str16, str16 + LONG_LEN, &error);
+        if (res != size_t(i) || error
+            || gr_decode_unicode_characters(gr_utf16, str16, str16 + LONG_LEN, usv, i / 2, &error) != size_t(i / 2) || error)
+        {
+            fprintf(stderr, "%s: long test 16:%d failed: nul not found\n", argv[0], i + 1);
+            return 100 + i;
+        }
+    }
     return 0;
 }